@@ -0,0 +1,269 @@
+/*
+ * filetea-buffer-pool.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#include "filetea-buffer-pool.h"
+
+G_DEFINE_TYPE (FileteaBufferPool, filetea_buffer_pool, G_TYPE_OBJECT)
+
+#define FILETEA_BUFFER_POOL_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                              FILETEA_TYPE_BUFFER_POOL, \
+                                              FileteaBufferPoolPrivate))
+
+/* buffers come in power-of-two size classes, from 4 KB to 1 MB */
+#define MIN_CLASS_SHIFT 12
+#define MAX_CLASS_SHIFT 20
+#define NUM_CLASSES     (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1)
+
+#define CLASS_SIZE(class) ((gsize) 1 << ((class) + MIN_CLASS_SHIFT))
+
+/* private data */
+struct _FileteaBufferPoolPrivate
+{
+  gsize budget;
+  gsize in_use;
+  gsize cached;
+  guint64 failures;
+
+  /* unused buffers of each class, linked through their first bytes */
+  gpointer free_lists[NUM_CLASSES];
+};
+
+static void     filetea_buffer_pool_class_init         (FileteaBufferPoolClass *class);
+static void     filetea_buffer_pool_init               (FileteaBufferPool *self);
+
+static void     filetea_buffer_pool_finalize           (GObject *obj);
+
+static void
+filetea_buffer_pool_class_init (FileteaBufferPoolClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->finalize = filetea_buffer_pool_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaBufferPoolPrivate));
+}
+
+static void
+filetea_buffer_pool_init (FileteaBufferPool *self)
+{
+  FileteaBufferPoolPrivate *priv;
+  gint i;
+
+  priv = FILETEA_BUFFER_POOL_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->budget = 0;
+  priv->in_use = 0;
+  priv->cached = 0;
+  priv->failures = 0;
+
+  for (i=0; i<NUM_CLASSES; i++)
+    priv->free_lists[i] = NULL;
+}
+
+static void
+filetea_buffer_pool_finalize (GObject *obj)
+{
+  FileteaBufferPool *self = FILETEA_BUFFER_POOL (obj);
+  gint i;
+
+  for (i=0; i<NUM_CLASSES; i++)
+    while (self->priv->free_lists[i] != NULL)
+      {
+        gpointer buf = self->priv->free_lists[i];
+
+        self->priv->free_lists[i] = *(gpointer *) buf;
+        g_free (buf);
+      }
+
+  G_OBJECT_CLASS (filetea_buffer_pool_parent_class)->finalize (obj);
+}
+
+static gint
+get_size_class (gsize size)
+{
+  gint class = 0;
+
+  while (class < NUM_CLASSES - 1 && CLASS_SIZE (class) < size)
+    class++;
+
+  return class;
+}
+
+/* gives an unused buffer back to the system, largest first */
+static gboolean
+filetea_buffer_pool_release_one (FileteaBufferPool *self)
+{
+  gint i;
+
+  for (i=NUM_CLASSES-1; i>=0; i--)
+    if (self->priv->free_lists[i] != NULL)
+      {
+        gpointer buf = self->priv->free_lists[i];
+
+        self->priv->free_lists[i] = *(gpointer *) buf;
+        self->priv->cached -= CLASS_SIZE (i);
+        g_free (buf);
+
+        return TRUE;
+      }
+
+  return FALSE;
+}
+
+/* public methods */
+
+/**
+ * filetea_buffer_pool_new:
+ * @budget: maximum memory in bytes held by the pool, or 0 for unlimited
+ *
+ * Creates a pool of buffers shared by all transfers of a node.
+ **/
+FileteaBufferPool *
+filetea_buffer_pool_new (gsize budget)
+{
+  FileteaBufferPool *self;
+
+  self = g_object_new (FILETEA_TYPE_BUFFER_POOL, NULL);
+
+  self->priv->budget = budget;
+
+  return self;
+}
+
+/**
+ * filetea_buffer_pool_alloc:
+ * @size: (inout): the requested size, which is updated to the actual size of
+ * the buffer
+ * @force: whether to go over budget if needed
+ *
+ * Returns: a new buffer of at least @size bytes, or %NULL if the budget is
+ * exhausted and @force is %FALSE.
+ **/
+gchar *
+filetea_buffer_pool_alloc (FileteaBufferPool *self,
+                           gsize             *size,
+                           gboolean           force)
+{
+  gint class;
+  gsize class_size;
+  gpointer buf;
+
+  g_return_val_if_fail (FILETEA_IS_BUFFER_POOL (self), NULL);
+  g_return_val_if_fail (size != NULL, NULL);
+  g_return_val_if_fail (*size <= CLASS_SIZE (NUM_CLASSES - 1), NULL);
+
+  class = get_size_class (*size);
+  class_size = CLASS_SIZE (class);
+
+  if (self->priv->free_lists[class] != NULL)
+    {
+      buf = self->priv->free_lists[class];
+      self->priv->free_lists[class] = *(gpointer *) buf;
+      self->priv->cached -= class_size;
+    }
+  else
+    {
+      if (! force && ! filetea_buffer_pool_has_room (self, class_size))
+        {
+          self->priv->failures++;
+          return NULL;
+        }
+
+      /* unused buffers of other classes make room for this one */
+      while (self->priv->budget > 0 &&
+             self->priv->in_use + self->priv->cached + class_size > self->priv->budget)
+        {
+          if (! filetea_buffer_pool_release_one (self))
+            break;
+        }
+
+      buf = g_malloc (class_size);
+    }
+
+  self->priv->in_use += class_size;
+  *size = class_size;
+
+  return buf;
+}
+
+void
+filetea_buffer_pool_free (FileteaBufferPool *self,
+                          gchar             *buf,
+                          gsize              size)
+{
+  gint class;
+
+  g_return_if_fail (FILETEA_IS_BUFFER_POOL (self));
+  g_return_if_fail (buf != NULL);
+
+  class = get_size_class (size);
+  g_assert (CLASS_SIZE (class) == size);
+
+  self->priv->in_use -= size;
+
+  /* keep it for later, unless that goes over budget */
+  if (self->priv->budget > 0 &&
+      self->priv->in_use + self->priv->cached + size > self->priv->budget)
+    {
+      g_free (buf);
+      return;
+    }
+
+  *(gpointer *) buf = self->priv->free_lists[class];
+  self->priv->free_lists[class] = buf;
+  self->priv->cached += size;
+}
+
+/**
+ * filetea_buffer_pool_has_room:
+ *
+ * Returns: %TRUE if a buffer of @size bytes can be handed out within
+ * budget, %FALSE otherwise.
+ **/
+gboolean
+filetea_buffer_pool_has_room (FileteaBufferPool *self, gsize size)
+{
+  g_return_val_if_fail (FILETEA_IS_BUFFER_POOL (self), FALSE);
+
+  return self->priv->budget == 0 ||
+    self->priv->in_use + size <= self->priv->budget;
+}
+
+void
+filetea_buffer_pool_get_stats (FileteaBufferPool *self,
+                               gsize             *budget,
+                               gsize             *in_use,
+                               gsize             *cached,
+                               guint64           *failures)
+{
+  g_return_if_fail (FILETEA_IS_BUFFER_POOL (self));
+
+  if (budget != NULL)
+    *budget = self->priv->budget;
+  if (in_use != NULL)
+    *in_use = self->priv->in_use;
+  if (cached != NULL)
+    *cached = self->priv->cached;
+  if (failures != NULL)
+    *failures = self->priv->failures;
+}
@@ -0,0 +1,76 @@
+/*
+ * filetea-buffer-pool.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#ifndef __FILETEA_BUFFER_POOL_H__
+#define __FILETEA_BUFFER_POOL_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaBufferPool FileteaBufferPool;
+typedef struct _FileteaBufferPoolClass FileteaBufferPoolClass;
+typedef struct _FileteaBufferPoolPrivate FileteaBufferPoolPrivate;
+
+struct _FileteaBufferPool
+{
+  GObject parent;
+
+  FileteaBufferPoolPrivate *priv;
+};
+
+struct _FileteaBufferPoolClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_BUFFER_POOL           (filetea_buffer_pool_get_type ())
+#define FILETEA_BUFFER_POOL(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_BUFFER_POOL, FileteaBufferPool))
+#define FILETEA_BUFFER_POOL_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_BUFFER_POOL, FileteaBufferPoolClass))
+#define FILETEA_IS_BUFFER_POOL(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_BUFFER_POOL))
+#define FILETEA_IS_BUFFER_POOL_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_BUFFER_POOL))
+#define FILETEA_BUFFER_POOL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_BUFFER_POOL, FileteaBufferPoolClass))
+
+
+GType               filetea_buffer_pool_get_type     (void) G_GNUC_CONST;
+
+FileteaBufferPool * filetea_buffer_pool_new          (gsize budget);
+
+gchar *             filetea_buffer_pool_alloc        (FileteaBufferPool *self,
+                                                      gsize             *size,
+                                                      gboolean           force);
+void                filetea_buffer_pool_free         (FileteaBufferPool *self,
+                                                      gchar             *buf,
+                                                      gsize              size);
+
+gboolean            filetea_buffer_pool_has_room     (FileteaBufferPool *self,
+                                                      gsize              size);
+
+void                filetea_buffer_pool_get_stats    (FileteaBufferPool *self,
+                                                      gsize             *budget,
+                                                      gsize             *in_use,
+                                                      gsize             *cached,
+                                                      guint64           *failures);
+
+G_END_DECLS
+
+#endif /* __FILETEA_BUFFER_POOL_H__ */
@@ -0,0 +1,432 @@
+/*
+ * filetea-cache.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+#include "filetea-cache.h"
+
+G_DEFINE_TYPE (FileteaCache, filetea_cache, G_TYPE_OBJECT)
+
+#define FILETEA_CACHE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                        FILETEA_TYPE_CACHE, \
+                                        FileteaCachePrivate))
+
+#define FILE_SUFFIX ".cache"
+
+typedef struct
+{
+  FileteaCache *cache;
+
+  gchar *source_id;
+  gchar *signature;
+  gchar *path;
+  gsize size;
+
+  /* while being filled */
+  FileteaTransfer *filler;
+  gint fd;
+  gsize written;
+
+  /* once complete */
+  GList *lru_link;
+} Entry;
+
+/* private data */
+struct _FileteaCachePrivate
+{
+  gchar *directory;
+  guint64 max_size;
+  guint64 size;
+
+  GHashTable *entries;
+
+  /* complete entries, least recently used first */
+  GQueue *lru;
+};
+
+static void     filetea_cache_class_init         (FileteaCacheClass *class);
+static void     filetea_cache_init               (FileteaCache *self);
+
+static void     filetea_cache_finalize           (GObject *obj);
+static void     filetea_cache_dispose            (GObject *obj);
+
+static void     entry_free                       (Entry *entry);
+static void     entry_on_fill_data               (FileteaTransfer *transfer,
+                                                  const gchar     *buf,
+                                                  gsize            size,
+                                                  gpointer         user_data);
+
+static void
+filetea_cache_class_init (FileteaCacheClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->dispose = filetea_cache_dispose;
+  obj_class->finalize = filetea_cache_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaCachePrivate));
+}
+
+static void
+filetea_cache_init (FileteaCache *self)
+{
+  FileteaCachePrivate *priv;
+
+  priv = FILETEA_CACHE_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->size = 0;
+
+  priv->entries = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         NULL,
+                                         (GDestroyNotify) entry_free);
+  priv->lru = g_queue_new ();
+}
+
+static void
+filetea_cache_dispose (GObject *obj)
+{
+  FileteaCache *self = FILETEA_CACHE (obj);
+
+  if (self->priv->entries != NULL)
+    {
+      g_hash_table_unref (self->priv->entries);
+      self->priv->entries = NULL;
+    }
+
+  G_OBJECT_CLASS (filetea_cache_parent_class)->dispose (obj);
+}
+
+static void
+filetea_cache_finalize (GObject *obj)
+{
+  FileteaCache *self = FILETEA_CACHE (obj);
+
+  g_queue_free (self->priv->lru);
+  g_free (self->priv->directory);
+
+  G_OBJECT_CLASS (filetea_cache_parent_class)->finalize (obj);
+}
+
+static void
+entry_free (Entry *entry)
+{
+  FileteaCache *self = entry->cache;
+
+  if (entry->filler != NULL)
+    {
+      filetea_transfer_remove_tee (entry->filler, entry_on_fill_data, entry);
+      g_object_unref (entry->filler);
+    }
+
+  if (entry->fd != -1)
+    close (entry->fd);
+
+  if (entry->lru_link != NULL)
+    g_queue_delete_link (self->priv->lru, entry->lru_link);
+
+  /* transfers reading the file keep their own descriptor */
+  g_unlink (entry->path);
+
+  self->priv->size -= entry->size;
+
+  g_free (entry->source_id);
+  g_free (entry->signature);
+  g_free (entry->path);
+
+  g_slice_free (Entry, entry);
+}
+
+static void
+entry_on_fill_data (FileteaTransfer *transfer,
+                    const gchar     *buf,
+                    gsize            size,
+                    gpointer         user_data)
+{
+  Entry *entry = user_data;
+  FileteaCache *self = entry->cache;
+
+  if (buf == NULL)
+    {
+      /* transfer is over, the tee is already gone */
+      g_object_unref (entry->filler);
+      entry->filler = NULL;
+
+      close (entry->fd);
+      entry->fd = -1;
+
+      if (entry->written == entry->size)
+        {
+          g_queue_push_tail (self->priv->lru, entry);
+          entry->lru_link = g_queue_peek_tail_link (self->priv->lru);
+        }
+      else
+        {
+          g_hash_table_remove (self->priv->entries, entry->source_id);
+        }
+
+      return;
+    }
+
+  /* written synchronously, the cache directory is expected to be on a
+     local disk */
+  while (size > 0)
+    {
+      gssize written;
+
+      written = write (entry->fd, buf, size);
+      if (written < 0)
+        {
+          if (errno == EINTR)
+            continue;
+
+          g_printerr ("Error writing to cache file: %s\n", g_strerror (errno));
+          g_hash_table_remove (self->priv->entries, entry->source_id);
+          return;
+        }
+
+      buf += written;
+      size -= written;
+      entry->written += written;
+    }
+}
+
+static gchar *
+filetea_cache_get_path (FileteaCache *self, FileteaSource *source)
+{
+  gchar *key;
+  gchar *hash;
+  gchar *file_name;
+  gchar *path;
+
+  /* file name is derived from both id and signature, so that a source
+     claimed back by a different seeder never maps to an old file */
+  key = g_strdup_printf ("%s:%s",
+                         filetea_source_get_id (source),
+                         filetea_source_get_signature (source));
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, key, -1);
+
+  file_name = g_strconcat (hash, FILE_SUFFIX, NULL);
+  path = g_build_filename (self->priv->directory, file_name, NULL);
+
+  g_free (file_name);
+  g_free (hash);
+  g_free (key);
+
+  return path;
+}
+
+static void
+filetea_cache_remove_stale_files (FileteaCache *self)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (self->priv->directory, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_suffix (name, FILE_SUFFIX))
+        {
+          gchar *path;
+
+          path = g_build_filename (self->priv->directory, name, NULL);
+          g_unlink (path);
+          g_free (path);
+        }
+    }
+
+  g_dir_close (dir);
+}
+
+/* public methods */
+
+FileteaCache *
+filetea_cache_new (const gchar  *directory,
+                   guint64       max_size,
+                   GError      **error)
+{
+  FileteaCache *self;
+
+  g_return_val_if_fail (directory != NULL, NULL);
+
+  if (g_mkdir_with_parents (directory, 0700) != 0)
+    {
+      gint err_no = errno;
+
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (err_no),
+                   "Failed to create cache directory '%s': %s",
+                   directory,
+                   g_strerror (err_no));
+      return NULL;
+    }
+
+  self = g_object_new (FILETEA_TYPE_CACHE, NULL);
+
+  self->priv->directory = g_strdup (directory);
+  self->priv->max_size = max_size;
+
+  /* entries are not persistent, files left by a previous run are useless */
+  filetea_cache_remove_stale_files (self);
+
+  return self;
+}
+
+/**
+ * filetea_cache_open:
+ *
+ * Returns: a new file descriptor to read the cached content of @source, or
+ * -1 if it is not (yet) cached.
+ **/
+gint
+filetea_cache_open (FileteaCache *self, FileteaSource *source)
+{
+  Entry *entry;
+  gint fd;
+
+  g_return_val_if_fail (FILETEA_IS_CACHE (self), -1);
+  g_return_val_if_fail (FILETEA_IS_SOURCE (source), -1);
+
+  entry = g_hash_table_lookup (self->priv->entries,
+                               filetea_source_get_id (source));
+  if (entry == NULL)
+    return -1;
+
+  /* content changed since it was cached */
+  if (g_strcmp0 (entry->signature, filetea_source_get_signature (source)) != 0 ||
+      entry->size != filetea_source_get_size (source))
+    {
+      g_hash_table_remove (self->priv->entries, entry->source_id);
+      return -1;
+    }
+
+  if (entry->filler != NULL)
+    return -1;
+
+  fd = open (entry->path, O_RDONLY);
+  if (fd == -1)
+    {
+      g_printerr ("Error opening cache file: %s\n", g_strerror (errno));
+      g_hash_table_remove (self->priv->entries, entry->source_id);
+      return -1;
+    }
+
+  /* mark as most recently used */
+  g_queue_unlink (self->priv->lru, entry->lru_link);
+  g_queue_push_tail_link (self->priv->lru, entry->lru_link);
+
+  return fd;
+}
+
+/**
+ * filetea_cache_fill:
+ * @transfer: a not yet started transfer of the whole content of @source
+ *
+ * Caches the content of @source as it flows through @transfer. Only public
+ * sources are cached. Least recently used entries are evicted to make room
+ * for it.
+ *
+ * Returns: %TRUE if @transfer will fill the cache, %FALSE otherwise.
+ **/
+gboolean
+filetea_cache_fill (FileteaCache    *self,
+                    FileteaSource   *source,
+                    FileteaTransfer *transfer)
+{
+  Entry *entry;
+  gsize size;
+  gint fd;
+  gchar *path;
+
+  g_return_val_if_fail (FILETEA_IS_CACHE (self), FALSE);
+  g_return_val_if_fail (FILETEA_IS_SOURCE (source), FALSE);
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (transfer), FALSE);
+
+  if ((filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_PUBLIC) == 0)
+    return FALSE;
+
+  /* already cached or being cached */
+  if (g_hash_table_lookup (self->priv->entries,
+                           filetea_source_get_id (source)) != NULL)
+    {
+      return FALSE;
+    }
+
+  size = filetea_source_get_size (source);
+  if (size == 0 || size > self->priv->max_size)
+    return FALSE;
+
+  /* make room, evicting least recently used entries first */
+  while (self->priv->size + size > self->priv->max_size &&
+         ! g_queue_is_empty (self->priv->lru))
+    {
+      entry = g_queue_peek_head (self->priv->lru);
+      g_hash_table_remove (self->priv->entries, entry->source_id);
+    }
+
+  /* the rest of the space is taken by entries being filled */
+  if (self->priv->size + size > self->priv->max_size)
+    return FALSE;
+
+  path = filetea_cache_get_path (self, source);
+  fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd == -1)
+    {
+      g_printerr ("Error creating cache file: %s\n", g_strerror (errno));
+      g_free (path);
+      return FALSE;
+    }
+
+  entry = g_slice_new0 (Entry);
+  entry->cache = self;
+  entry->source_id = g_strdup (filetea_source_get_id (source));
+  entry->signature = g_strdup (filetea_source_get_signature (source));
+  entry->path = path;
+  entry->size = size;
+  entry->fd = fd;
+  entry->filler = g_object_ref (transfer);
+
+  g_hash_table_insert (self->priv->entries, entry->source_id, entry);
+  self->priv->size += size;
+
+  filetea_transfer_add_tee (transfer, entry_on_fill_data, entry);
+
+  return TRUE;
+}
+
+void
+filetea_cache_invalidate (FileteaCache *self, FileteaSource *source)
+{
+  g_return_if_fail (FILETEA_IS_CACHE (self));
+  g_return_if_fail (FILETEA_IS_SOURCE (source));
+
+  g_hash_table_remove (self->priv->entries, filetea_source_get_id (source));
+}
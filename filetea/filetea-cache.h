@@ -0,0 +1,73 @@
+/*
+ * filetea-cache.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#ifndef __FILETEA_CACHE_H__
+#define __FILETEA_CACHE_H__
+
+#include <evd.h>
+
+#include "filetea-source.h"
+#include "filetea-transfer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaCache FileteaCache;
+typedef struct _FileteaCacheClass FileteaCacheClass;
+typedef struct _FileteaCachePrivate FileteaCachePrivate;
+
+struct _FileteaCache
+{
+  GObject parent;
+
+  FileteaCachePrivate *priv;
+};
+
+struct _FileteaCacheClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_CACHE           (filetea_cache_get_type ())
+#define FILETEA_CACHE(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_CACHE, FileteaCache))
+#define FILETEA_CACHE_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_CACHE, FileteaCacheClass))
+#define FILETEA_IS_CACHE(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_CACHE))
+#define FILETEA_IS_CACHE_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_CACHE))
+#define FILETEA_CACHE_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_CACHE, FileteaCacheClass))
+
+
+GType          filetea_cache_get_type      (void) G_GNUC_CONST;
+
+FileteaCache * filetea_cache_new           (const gchar  *directory,
+                                            guint64       max_size,
+                                            GError      **error);
+
+gint           filetea_cache_open          (FileteaCache  *self,
+                                            FileteaSource *source);
+gboolean       filetea_cache_fill          (FileteaCache    *self,
+                                            FileteaSource   *source,
+                                            FileteaTransfer *transfer);
+void           filetea_cache_invalidate    (FileteaCache  *self,
+                                            FileteaSource *source);
+
+G_END_DECLS
+
+#endif /* __FILETEA_CACHE_H__ */
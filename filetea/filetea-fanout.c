@@ -0,0 +1,464 @@
+/*
+ * filetea-fanout.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#include <string.h>
+
+#include "filetea-fanout.h"
+
+G_DEFINE_TYPE (FileteaFanout, filetea_fanout, G_TYPE_OBJECT)
+
+#define FILETEA_FANOUT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                         FILETEA_TYPE_FANOUT, \
+                                         FileteaFanoutPrivate))
+
+typedef struct
+{
+  FileteaTransfer *transfer;
+  gsize cursor;
+  gsize end;
+} Reader;
+
+/* private data */
+struct _FileteaFanoutPrivate
+{
+  FileteaTransfer *upstream;
+  gsize offset;
+  gsize end;
+
+  /* content in [window_start, window_end) is held in the ring buffer, at
+     position 'offset % buffer_size'. Offsets are in the source */
+  gchar *buf;
+  gsize buffer_size;
+  gsize window_start;
+  gsize window_end;
+
+  GList *readers;
+
+  FileteaFanoutFallbackFunc fallback_func;
+  gpointer user_data;
+};
+
+static void     filetea_fanout_class_init         (FileteaFanoutClass *class);
+static void     filetea_fanout_init               (FileteaFanout *self);
+
+static void     filetea_fanout_finalize           (GObject *obj);
+static void     filetea_fanout_dispose            (GObject *obj);
+
+static void     filetea_fanout_on_upstream_data   (FileteaTransfer *transfer,
+                                                   const gchar     *buf,
+                                                   gsize            size,
+                                                   gpointer         user_data);
+
+static void
+filetea_fanout_class_init (FileteaFanoutClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->dispose = filetea_fanout_dispose;
+  obj_class->finalize = filetea_fanout_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaFanoutPrivate));
+}
+
+static void
+filetea_fanout_init (FileteaFanout *self)
+{
+  FileteaFanoutPrivate *priv;
+
+  priv = FILETEA_FANOUT_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->upstream = NULL;
+  priv->buf = NULL;
+  priv->window_start = 0;
+  priv->window_end = 0;
+  priv->readers = NULL;
+}
+
+static void
+reader_free (Reader *reader)
+{
+  g_object_unref (reader->transfer);
+
+  g_slice_free (Reader, reader);
+}
+
+static void
+filetea_fanout_dispose (GObject *obj)
+{
+  FileteaFanout *self = FILETEA_FANOUT (obj);
+
+  if (self->priv->upstream != NULL)
+    {
+      filetea_transfer_remove_tee (self->priv->upstream,
+                                   filetea_fanout_on_upstream_data,
+                                   self);
+      self->priv->upstream = NULL;
+    }
+
+  while (self->priv->readers != NULL)
+    {
+      Reader *reader = self->priv->readers->data;
+
+      self->priv->readers = g_list_delete_link (self->priv->readers,
+                                                self->priv->readers);
+
+      filetea_transfer_cancel (reader->transfer);
+      reader_free (reader);
+    }
+
+  G_OBJECT_CLASS (filetea_fanout_parent_class)->dispose (obj);
+}
+
+static void
+filetea_fanout_finalize (GObject *obj)
+{
+  FileteaFanout *self = FILETEA_FANOUT (obj);
+
+  g_free (self->priv->buf);
+
+  G_OBJECT_CLASS (filetea_fanout_parent_class)->finalize (obj);
+}
+
+static Reader *
+filetea_fanout_find_reader (FileteaFanout *self, FileteaTransfer *transfer)
+{
+  GList *node;
+
+  for (node = self->priv->readers; node != NULL; node = node->next)
+    {
+      Reader *reader = node->data;
+
+      if (reader->transfer == transfer)
+        return reader;
+    }
+
+  return NULL;
+}
+
+static void
+filetea_fanout_fall_back (FileteaFanout *self, Reader *reader)
+{
+  self->priv->readers = g_list_remove (self->priv->readers, reader);
+
+  /* reader continues on its own, from where it is */
+  filetea_transfer_stop_feed (reader->transfer);
+  self->priv->fallback_func (self,
+                             reader->transfer,
+                             reader->cursor,
+                             self->priv->user_data);
+
+  reader_free (reader);
+}
+
+static void
+filetea_fanout_pump (FileteaFanout *self, Reader *reader)
+{
+  guint status;
+
+  /* a finished or failed transfer is removed once completed */
+  filetea_transfer_get_status (reader->transfer, &status, NULL, NULL);
+  if (status != FILETEA_TRANSFER_STATUS_ACTIVE)
+    return;
+
+  while (reader->cursor < MIN (self->priv->window_end, reader->end))
+    {
+      gsize pos;
+      gsize len;
+      gssize size;
+
+      g_assert (reader->cursor >= self->priv->window_start);
+
+      pos = reader->cursor % self->priv->buffer_size;
+      len = MIN (MIN (self->priv->window_end, reader->end) - reader->cursor,
+                 self->priv->buffer_size - pos);
+
+      size = filetea_transfer_feed (reader->transfer, self->priv->buf + pos, len);
+      if (size < 0)
+        return;
+
+      reader->cursor += size;
+
+      /* target is full, wait for it to pull again */
+      if ((gsize) size < len)
+        return;
+    }
+
+  /* upstream is gone before delivering everything, or it didn't cover
+     all of what the reader wants */
+  if (self->priv->upstream == NULL &&
+      reader->cursor < reader->end)
+    {
+      filetea_fanout_fall_back (self, reader);
+    }
+}
+
+static void
+filetea_fanout_pump_all (FileteaFanout *self)
+{
+  GList *node;
+
+  node = self->priv->readers;
+  while (node != NULL)
+    {
+      Reader *reader = node->data;
+
+      /* pumping can remove the reader */
+      node = node->next;
+
+      filetea_fanout_pump (self, reader);
+    }
+}
+
+static void
+filetea_fanout_on_upstream_data (FileteaTransfer *transfer,
+                                 const gchar     *buf,
+                                 gsize            size,
+                                 gpointer         user_data)
+{
+  FileteaFanout *self = FILETEA_FANOUT (user_data);
+  gsize new_start = 0;
+  GList *node;
+
+  g_object_ref (self);
+
+  if (buf == NULL)
+    {
+      /* upstream transfer is over */
+      self->priv->upstream = NULL;
+      filetea_fanout_pump_all (self);
+
+      goto out;
+    }
+
+  /* readers that have not consumed the content about to be overwritten
+     cannot keep up with upstream, let them go */
+  if (self->priv->window_end + size - self->priv->offset > self->priv->buffer_size)
+    new_start = self->priv->window_end + size - self->priv->buffer_size;
+
+  node = self->priv->readers;
+  while (node != NULL)
+    {
+      Reader *reader = node->data;
+
+      node = node->next;
+
+      if (reader->cursor < new_start)
+        filetea_fanout_fall_back (self, reader);
+    }
+
+  /* copy block into the ring */
+  if (self->priv->buf == NULL)
+    self->priv->buf = g_malloc (self->priv->buffer_size);
+
+  if (size > self->priv->buffer_size)
+    {
+      buf += size - self->priv->buffer_size;
+      self->priv->window_end += size - self->priv->buffer_size;
+      size = self->priv->buffer_size;
+    }
+
+  while (size > 0)
+    {
+      gsize pos;
+      gsize len;
+
+      pos = self->priv->window_end % self->priv->buffer_size;
+      len = MIN (size, self->priv->buffer_size - pos);
+
+      memcpy (self->priv->buf + pos, buf, len);
+
+      buf += len;
+      size -= len;
+      self->priv->window_end += len;
+    }
+
+  self->priv->window_start = MAX (self->priv->window_start, new_start);
+
+  filetea_fanout_pump_all (self);
+
+ out:
+  g_object_unref (self);
+}
+
+static void
+filetea_fanout_on_reader_can_write (FileteaTransfer *transfer,
+                                    gpointer         user_data)
+{
+  FileteaFanout *self = FILETEA_FANOUT (user_data);
+  Reader *reader;
+
+  reader = filetea_fanout_find_reader (self, transfer);
+  if (reader == NULL)
+    return;
+
+  g_object_ref (self);
+  filetea_fanout_pump (self, reader);
+  g_object_unref (self);
+}
+
+/* public methods */
+
+/**
+ * filetea_fanout_new:
+ * @upstream: a not yet started transfer of a whole source, or of a single
+ * range of it
+ * @offset: where the content of @upstream starts in the source
+ * @length: size of the content of @upstream
+ * @buffer_size: how much content is kept for readers, in bytes
+ * @fallback_func: function called when a reader has to leave the fanout
+ * @user_data: user data for @fallback_func
+ *
+ * Creates a fanout that shares the content flowing through @upstream with
+ * other transfers of the same source. Readers that don't keep up with
+ * @upstream, or that are left behind when it ends, are handed to
+ * @fallback_func together with the offset they were at, so that they can
+ * be completed by a push of their own.
+ **/
+FileteaFanout *
+filetea_fanout_new (FileteaTransfer           *upstream,
+                    gsize                      offset,
+                    gsize                      length,
+                    gsize                      buffer_size,
+                    FileteaFanoutFallbackFunc  fallback_func,
+                    gpointer                   user_data)
+{
+  FileteaFanout *self;
+
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (upstream), NULL);
+  g_return_val_if_fail (buffer_size > 0, NULL);
+  g_return_val_if_fail (fallback_func != NULL, NULL);
+
+  self = g_object_new (FILETEA_TYPE_FANOUT, NULL);
+
+  self->priv->upstream = upstream;
+  self->priv->offset = offset;
+  self->priv->end = offset + length;
+  self->priv->window_start = offset;
+  self->priv->window_end = offset;
+  self->priv->buffer_size = buffer_size;
+  self->priv->fallback_func = fallback_func;
+  self->priv->user_data = user_data;
+
+  filetea_transfer_add_tee (upstream, filetea_fanout_on_upstream_data, self);
+
+  return self;
+}
+
+/**
+ * filetea_fanout_attach:
+ * @transfer: a not yet started transfer of the same source
+ * @offset: where the content of @transfer starts in the source
+ * @length: size of the content of @transfer
+ *
+ * Starts @transfer fed from the fanout, if the beginning of its content is
+ * still available or about to come through @upstream. Content beyond the
+ * end of @upstream is left to the fallback function.
+ *
+ * Returns: %TRUE if @transfer was attached, %FALSE if it came too late or
+ * its content is not covered.
+ **/
+gboolean
+filetea_fanout_attach (FileteaFanout   *self,
+                       FileteaTransfer *transfer,
+                       gsize            offset,
+                       gsize            length)
+{
+  Reader *reader;
+
+  g_return_val_if_fail (FILETEA_IS_FANOUT (self), FALSE);
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (transfer), FALSE);
+
+  /* readers that start too far ahead would wait for long, better to have
+     their own push */
+  if (self->priv->upstream == NULL ||
+      offset < self->priv->window_start ||
+      offset >= self->priv->end ||
+      offset > self->priv->window_end + self->priv->buffer_size)
+    {
+      return FALSE;
+    }
+
+  reader = g_slice_new (Reader);
+  reader->transfer = g_object_ref (transfer);
+  reader->cursor = offset;
+  reader->end = offset + length;
+
+  self->priv->readers = g_list_append (self->priv->readers, reader);
+
+  filetea_transfer_start_fed (transfer,
+                              filetea_fanout_on_reader_can_write,
+                              self);
+
+  g_object_ref (self);
+  filetea_fanout_pump (self, reader);
+  g_object_unref (self);
+
+  return TRUE;
+}
+
+void
+filetea_fanout_remove (FileteaFanout *self, FileteaTransfer *transfer)
+{
+  Reader *reader;
+
+  g_return_if_fail (FILETEA_IS_FANOUT (self));
+  g_return_if_fail (FILETEA_IS_TRANSFER (transfer));
+
+  if (transfer == self->priv->upstream)
+    {
+      filetea_transfer_remove_tee (transfer,
+                                   filetea_fanout_on_upstream_data,
+                                   self);
+      filetea_fanout_on_upstream_data (transfer, NULL, 0, self);
+      return;
+    }
+
+  reader = filetea_fanout_find_reader (self, transfer);
+  if (reader != NULL)
+    {
+      self->priv->readers = g_list_remove (self->priv->readers, reader);
+      reader_free (reader);
+    }
+}
+
+gboolean
+filetea_fanout_is_idle (FileteaFanout *self)
+{
+  g_return_val_if_fail (FILETEA_IS_FANOUT (self), FALSE);
+
+  return self->priv->upstream == NULL && self->priv->readers == NULL;
+}
+
+/**
+ * filetea_fanout_get_upstream:
+ *
+ * Returns: (transfer none): the transfer feeding the readers, or %NULL if
+ * it is already gone.
+ **/
+FileteaTransfer *
+filetea_fanout_get_upstream (FileteaFanout *self)
+{
+  g_return_val_if_fail (FILETEA_IS_FANOUT (self), NULL);
+
+  return self->priv->upstream;
+}
@@ -0,0 +1,83 @@
+/*
+ * filetea-fanout.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#ifndef __FILETEA_FANOUT_H__
+#define __FILETEA_FANOUT_H__
+
+#include <evd.h>
+
+#include "filetea-transfer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaFanout FileteaFanout;
+typedef struct _FileteaFanoutClass FileteaFanoutClass;
+typedef struct _FileteaFanoutPrivate FileteaFanoutPrivate;
+
+typedef void (* FileteaFanoutFallbackFunc) (FileteaFanout   *self,
+                                            FileteaTransfer *transfer,
+                                            gsize            offset,
+                                            gpointer         user_data);
+
+struct _FileteaFanout
+{
+  GObject parent;
+
+  FileteaFanoutPrivate *priv;
+};
+
+struct _FileteaFanoutClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_FANOUT           (filetea_fanout_get_type ())
+#define FILETEA_FANOUT(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_FANOUT, FileteaFanout))
+#define FILETEA_FANOUT_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_FANOUT, FileteaFanoutClass))
+#define FILETEA_IS_FANOUT(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_FANOUT))
+#define FILETEA_IS_FANOUT_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_FANOUT))
+#define FILETEA_FANOUT_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_FANOUT, FileteaFanoutClass))
+
+
+GType           filetea_fanout_get_type      (void) G_GNUC_CONST;
+
+FileteaFanout * filetea_fanout_new           (FileteaTransfer           *upstream,
+                                              gsize                      offset,
+                                              gsize                      length,
+                                              gsize                      buffer_size,
+                                              FileteaFanoutFallbackFunc  fallback_func,
+                                              gpointer                   user_data);
+
+gboolean        filetea_fanout_attach        (FileteaFanout   *self,
+                                              FileteaTransfer *transfer,
+                                              gsize            offset,
+                                              gsize            length);
+void            filetea_fanout_remove        (FileteaFanout   *self,
+                                              FileteaTransfer *transfer);
+
+gboolean        filetea_fanout_is_idle       (FileteaFanout *self);
+FileteaTransfer *
+                filetea_fanout_get_upstream  (FileteaFanout *self);
+
+G_END_DECLS
+
+#endif /* __FILETEA_FANOUT_H__ */
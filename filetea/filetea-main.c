@@ -20,13 +20,19 @@
  * for more details.
  */
 
+#include <string.h>
 #include <evd.h>
 
 #include "filetea-protocol.h"
+#include "filetea-transfer.h"
 
 #define DEFAULT_SERVICE_URL "http://localhost:8080"
 #define SERVICE_HOST        "localhost:8080"
-#define BLOCK_SIZE          4096
+#define MIN_BLOCK_SIZE      0x1000
+#define MAX_BLOCK_SIZE      0x40000
+#define CHANNEL_BLOCK_SIZE  0x8000
+#define STDIN_PATH          "/dev/stdin"
+#define STDIN_SOURCE_NAME   "stdin"
 
 struct SharedFile
 {
@@ -34,27 +40,61 @@ struct SharedFile
   const gchar *file_type;
   guint64 file_time_modified;
   FileteaSource *source;
+
+  /* standard input can only be streamed once */
+  gboolean live;
+  gboolean live_streamed;
 };
 
 struct PushRequest
 {
   struct SharedFile *shared_file;
   EvdHttpConnection *conn;
+  gchar *transfer_id;
   gchar *transfer_url;
   gboolean is_chunked;
-  goffset byte_start;
-  goffset byte_end;
+  SoupRange *byte_ranges;
+  guint n_ranges;
+  guint range_index;
+  gsize range_left;
   GInputStream *input_stream;
   void *buf;
+  gsize buf_size;
+  gsize block_size;
+  gsize push_len;
   gsize total_sent;
   GCancellable *cancellable;
   gboolean keep_alive;
+
+  /* the service waits to know if the push is coming */
+  GAsyncResult *result;
+
+  /* the service can abort a push nobody downloads anymore */
+  gboolean aborted;
+  gboolean waiting_write;
+  gboolean reading_response;
+
+  /* small content goes over the transport, as far as the service lets */
+  gboolean over_channel;
+  gsize credit;
+  gboolean waiting_credit;
+  gboolean finished;
+};
+
+/* an idle push connection the service binds transfers to */
+struct ParkedPush
+{
+  gchar *token;
+  EvdHttpConnection *conn;
 };
 
 struct SharedFile shared_file;
 
 static FileteaProtocol *protocol;
 static EvdConnectionPool *conn_pool;
+static GHashTable *push_requests;
+static GHashTable *parked_pushes;
+static guint parking = 0;
 static gint reconnect_timeout = 1000;
 
 static gchar *ws_service_url = NULL;
@@ -62,10 +102,12 @@ static gboolean tls_enabled = FALSE;
 
 static gchar *service_url = NULL;
 static gboolean is_public = FALSE;
+static gint max_parked_pushes = 0;
 
 static GOptionEntry entries[] = {
   { "service", 's', 0, G_OPTION_ARG_STRING, &service_url, "Target service URL, '" DEFAULT_SERVICE_URL "' by default" },
   { "public", 'p', 0, G_OPTION_ARG_NONE, &is_public, "Share the file publicly" },
+  { "parked-pushes", 'k', 0, G_OPTION_ARG_INT, &max_parked_pushes, "Number of idle push connections to keep open to the service, none by default" },
   { NULL }
 };
 
@@ -73,8 +115,20 @@ static gboolean    transport_reconnect       (gpointer user_data);
 
 static void        protocol_register_sources (void);
 
+static void        parked_pushes_fill        (void);
+static void        parked_push_on_close      (EvdConnection *conn,
+                                              gpointer       user_data);
+
 static void        push_request_read_block   (struct PushRequest *push_req);
 static void        push_request_free         (struct PushRequest *push_req);
+static void        push_request_stop         (struct PushRequest *push_req);
+static void        push_request_open_file    (struct PushRequest *push_req);
+static void        push_request_acknowledge  (struct PushRequest *push_req,
+                                              gint64              size,
+                                              const GError       *error);
+static gboolean    push_request_seek_range   (struct PushRequest  *push_req,
+                                              guint                index,
+                                              GError             **error);
 
 static void
 transport_on_open (GObject      *obj,
@@ -163,6 +217,8 @@ protocol_on_register_sources (GObject      *obj,
 
           node = g_list_next (node);
         }
+
+      parked_pushes_fill ();
     }
 
   g_list_free (sources);
@@ -183,11 +239,61 @@ protocol_register_sources (void)
                                    NULL);
 }
 
+/* accepts the push request, or refuses it if @error is set */
+static void
+push_request_acknowledge (struct PushRequest *push_req,
+                          gint64              size,
+                          const GError       *error)
+{
+  if (push_req->result == NULL)
+    return;
+
+  filetea_protocol_respond_push_request (protocol,
+                                         push_req->result,
+                                         size,
+                                         error);
+
+  g_object_unref (push_req->result);
+  push_req->result = NULL;
+}
+
 static void
 push_request_free (struct PushRequest *push_req)
 {
+  if (g_hash_table_lookup (push_requests, push_req->transfer_id) == push_req)
+    g_hash_table_remove (push_requests, push_req->transfer_id);
+
+  /* the service waits for the rest of an accepted push */
+  if (push_req->over_channel &&
+      push_req->result == NULL &&
+      ! push_req->finished &&
+      ! push_req->aborted)
+    {
+      EvdPeer *peer;
+
+      peer = filetea_source_get_peer (push_req->shared_file->source);
+      if (peer != NULL && ! evd_peer_is_closed (peer))
+        filetea_protocol_send_push_data (protocol,
+                                         peer,
+                                         push_req->transfer_id,
+                                         NULL,
+                                         0,
+                                         NULL);
+    }
+
+  if (push_req->result != NULL)
+    {
+      GError *error;
+
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_CANCELLED,
+                           "Push request dropped");
+      push_request_acknowledge (push_req, -1, error);
+      g_error_free (error);
+    }
+
   if (push_req->buf != NULL)
-    g_slice_free1 (BLOCK_SIZE, push_req->buf);
+    g_slice_free1 (push_req->buf_size, push_req->buf);
 
   if (push_req->input_stream != NULL)
     g_object_unref (push_req->input_stream);
@@ -202,7 +308,9 @@ push_request_free (struct PushRequest *push_req)
 
   if (push_req->cancellable != NULL)
     g_object_unref (push_req->cancellable);
+  g_free (push_req->transfer_id);
   g_free (push_req->transfer_url);
+  g_free (push_req->byte_ranges);
 
   g_slice_free (struct PushRequest, push_req);
 }
@@ -241,6 +349,129 @@ push_request_on_response (GObject      *obj,
   push_request_free (push_req);
 }
 
+/* tells the service how much of an aborted push was sent, so it can
+   answer the push and the connection is recycled */
+static void
+push_request_stop (struct PushRequest *push_req)
+{
+  EvdPeer *peer;
+  GError *error = NULL;
+
+  /* nothing to reconcile without a push connection */
+  if (push_req->over_channel)
+    {
+      push_request_free (push_req);
+      return;
+    }
+
+  peer = filetea_source_get_peer (push_req->shared_file->source);
+  if (peer == NULL ||
+      ! filetea_protocol_push_aborted (protocol,
+                                       peer,
+                                       push_req->transfer_id,
+                                       push_req->total_sent,
+                                       &error))
+    {
+      if (error != NULL)
+        {
+          g_printerr ("Error stopping push: %s\n", error->message);
+          g_error_free (error);
+        }
+
+      push_request_free (push_req);
+      return;
+    }
+
+  g_print ("Transfer '%s' aborted after %" G_GSIZE_FORMAT " bytes\n",
+           push_req->transfer_id,
+           push_req->total_sent);
+
+  /* already waiting for the response */
+  if (push_req->reading_response)
+    return;
+
+  push_req->reading_response = TRUE;
+  evd_http_connection_read_response_headers (push_req->conn,
+                                             NULL,
+                                             push_request_on_response,
+                                             push_req);
+}
+
+static void
+push_request_on_live_flushed (GObject      *obj,
+                              GAsyncResult *res,
+                              gpointer      user_data)
+{
+  struct PushRequest *push_req = user_data;
+  GError *error = NULL;
+
+  if (! g_output_stream_flush_finish (G_OUTPUT_STREAM (obj), res, &error))
+    {
+      g_printerr ("Error sending live stream contents: %s\n", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_print ("Live stream ended after %" G_GSIZE_FORMAT " bytes\n",
+               push_req->total_sent);
+    }
+
+  /* closing the connection tells the service the stream is over */
+  push_request_free (push_req);
+}
+
+static void
+push_request_send_channel_block (struct PushRequest *push_req, gsize size)
+{
+  EvdPeer *peer;
+  GError *error = NULL;
+
+  push_req->total_sent += size;
+  push_req->range_left -= size;
+  push_req->credit -= size;
+
+  peer = filetea_source_get_peer (push_req->shared_file->source);
+  if (peer == NULL ||
+      ! filetea_protocol_send_push_data (protocol,
+                                         peer,
+                                         push_req->transfer_id,
+                                         (const gchar *) push_req->buf,
+                                         size,
+                                         &error))
+    {
+      if (error != NULL)
+        {
+          g_printerr ("Error sending file contents: %s\n", error->message);
+          g_error_free (error);
+        }
+
+      push_request_free (push_req);
+      return;
+    }
+
+  if (push_req->total_sent == push_req->push_len)
+    {
+      push_req->finished = TRUE;
+      push_request_free (push_req);
+      return;
+    }
+
+  /* continue reading, from the next range if this one is done */
+  if (push_req->range_left == 0 &&
+      ! push_request_seek_range (push_req,
+                                 push_req->range_index + 1,
+                                 &error))
+    {
+      g_printerr ("Error seeking file: %s\n", error->message);
+      g_error_free (error);
+
+      push_request_free (push_req);
+      return;
+    }
+
+  push_request_read_block (push_req);
+}
+
 static void
 push_request_on_block_read (GObject      *obj,
                             GAsyncResult *res,
@@ -250,14 +481,23 @@ push_request_on_block_read (GObject      *obj,
   GError *error = NULL;
   gssize size;
 
-  if (g_io_stream_is_closed (G_IO_STREAM (push_req->conn)))
+  if (push_req->conn != NULL &&
+      g_io_stream_is_closed (G_IO_STREAM (push_req->conn)))
     {
       push_request_free (push_req);
       return;
     }
 
   size = g_input_stream_read_finish (G_INPUT_STREAM (obj), res, &error);
-  if (size < 0)
+  if (push_req->aborted)
+    {
+      /* what was read is not sent */
+      if (error != NULL)
+        g_error_free (error);
+
+      push_request_stop (push_req);
+    }
+  else if (size < 0)
     {
       g_printerr ("Error reading from file: %s\n", error->message);
       g_error_free (error);
@@ -265,12 +505,30 @@ push_request_on_block_read (GObject      *obj,
       /* abort and free push request */
       push_request_free (push_req);
     }
+  else if (size > 0 && push_req->over_channel)
+    {
+      push_request_send_channel_block (push_req, size);
+    }
   else if (size > 0)
     {
       gsize bytes_left;
+      EvdStreamThrottle *throttle;
 
       push_req->total_sent += size;
-      bytes_left = filetea_source_get_size (push_req->shared_file->source) - push_req->total_sent;
+
+      /* adapt the size of next read to how the upload is doing */
+      throttle =
+        evd_io_stream_get_output_throttle (EVD_IO_STREAM (push_req->conn));
+      push_req->block_size =
+        filetea_transfer_adapt_block_size (push_req->block_size,
+                       MIN_BLOCK_SIZE,
+                       MAX_BLOCK_SIZE,
+                       size,
+                       evd_connection_get_max_writable (EVD_CONNECTION (push_req->conn)),
+                       evd_stream_throttle_get_actual_bandwidth (throttle),
+                       FALSE);
+      bytes_left = push_req->push_len - push_req->total_sent;
+      push_req->range_left -= size;
 
       if (! evd_http_connection_write_content (push_req->conn,
                                                (gchar *) push_req->buf,
@@ -286,18 +544,44 @@ push_request_on_block_read (GObject      *obj,
         }
       else if (bytes_left > 0)
         {
-          /* continue reading */
-          push_request_read_block (push_req);
+          /* continue reading, from the next range if this one is done */
+          if (push_req->range_left == 0 &&
+              ! push_request_seek_range (push_req,
+                                         push_req->range_index + 1,
+                                         &error))
+            {
+              g_printerr ("Error seeking file: %s\n", error->message);
+              g_error_free (error);
+
+              push_request_free (push_req);
+            }
+          else
+            {
+              push_request_read_block (push_req);
+            }
         }
       else
         {
           /* done pushing file, read response headers */
+          push_req->reading_response = TRUE;
           evd_http_connection_read_response_headers (push_req->conn,
                                                      NULL,
                                                      push_request_on_response,
                                                      push_req);
         }
     }
+  else if (push_req->shared_file->live)
+    {
+      GOutputStream *stream;
+
+      /* end of standard input */
+      stream = g_io_stream_get_output_stream (G_IO_STREAM (push_req->conn));
+      g_output_stream_flush_async (stream,
+                                   G_PRIORITY_DEFAULT,
+                                   NULL,
+                                   push_request_on_live_flushed,
+                                   push_req);
+    }
   else
     {
       g_assert_not_reached ();
@@ -312,6 +596,7 @@ push_request_conn_can_write (EvdConnection *conn, gpointer user_data)
   g_signal_handlers_disconnect_by_func (conn,
                                         push_request_conn_can_write,
                                         push_req);
+  push_req->waiting_write = FALSE;
 
   push_request_read_block (push_req);
 }
@@ -319,24 +604,72 @@ push_request_conn_can_write (EvdConnection *conn, gpointer user_data)
 static void
 push_request_read_block (struct PushRequest *push_req)
 {
-  if (evd_connection_get_max_writable (EVD_CONNECTION (push_req->conn)) == 0)
+  gsize len;
+
+  if (push_req->over_channel)
+    {
+      /* wait for the service to take some of what was pushed */
+      if (push_req->credit == 0)
+        {
+          push_req->waiting_credit = TRUE;
+          return;
+        }
+    }
+  else if (evd_connection_get_max_writable (EVD_CONNECTION (push_req->conn)) == 0)
     {
       g_signal_connect (push_req->conn,
                         "write",
                         G_CALLBACK (push_request_conn_can_write),
                         push_req);
+      push_req->waiting_write = TRUE;
       return;
     }
 
+  /* block size could have changed since the last read */
+  if (push_req->buf_size != push_req->block_size)
+    {
+      if (push_req->buf != NULL)
+        g_slice_free1 (push_req->buf_size, push_req->buf);
+
+      push_req->buf_size = push_req->block_size;
+      push_req->buf = g_slice_alloc (push_req->buf_size);
+    }
+
+  len = MIN (push_req->block_size, push_req->range_left);
+  if (push_req->over_channel)
+    len = MIN (len, push_req->credit);
+
   g_input_stream_read_async (push_req->input_stream,
                              push_req->buf,
-                             BLOCK_SIZE,
+                             len,
                              G_PRIORITY_DEFAULT,
                              push_req->cancellable,
                              push_request_on_block_read,
                              push_req);
 }
 
+static gboolean
+push_request_seek_range (struct PushRequest  *push_req,
+                         guint                index,
+                         GError             **error)
+{
+  SoupRange *range = &push_req->byte_ranges[index];
+
+  if (! g_seekable_seek (G_SEEKABLE (push_req->input_stream),
+                         range->start,
+                         G_SEEK_SET,
+                         NULL,
+                         error))
+    {
+      return FALSE;
+    }
+
+  push_req->range_index = index;
+  push_req->range_left = range->end - range->start + 1;
+
+  return TRUE;
+}
+
 static void
 push_request_on_file_open (GObject      *obj,
                            GAsyncResult *res,
@@ -345,11 +678,22 @@ push_request_on_file_open (GObject      *obj,
   GFileInputStream *input_stream;
   GError *error = NULL;
   struct PushRequest *push_req = user_data;
+  goffset file_size;
 
   input_stream = g_file_read_finish (G_FILE (obj),
                                      res,
                                      &error);
-  if (input_stream == NULL)
+  if (push_req->aborted)
+    {
+      if (input_stream != NULL)
+        g_object_unref (input_stream);
+      else
+        g_error_free (error);
+
+      push_request_stop (push_req);
+      return;
+    }
+  else if (input_stream == NULL)
     {
       g_printerr ("Error opening file for reading: %s\n", error->message);
       g_error_free (error);
@@ -360,11 +704,66 @@ push_request_on_file_open (GObject      *obj,
 
   push_req->input_stream = G_INPUT_STREAM (input_stream);
 
+  /* only push the requested ranges, one after the other */
+  file_size = filetea_source_get_size (push_req->shared_file->source);
+  if (push_req->is_chunked)
+    {
+      guint i;
+
+      push_req->push_len = 0;
+      for (i = 0; i < push_req->n_ranges; i++)
+        {
+          SoupRange *range = &push_req->byte_ranges[i];
+
+          if (range->end < 0 || range->end >= file_size)
+            range->end = file_size - 1;
+
+          push_req->push_len += range->end - range->start + 1;
+        }
+
+      if (! push_request_seek_range (push_req, 0, &error))
+        {
+          g_printerr ("Error seeking file: %s\n", error->message);
+          g_error_free (error);
+
+          push_request_free (push_req);
+          return;
+        }
+    }
+  else if (push_req->shared_file->live)
+    {
+      /* streamed until the end of input */
+      push_req->push_len = G_MAXSIZE;
+      push_req->range_left = G_MAXSIZE;
+    }
+  else
+    {
+      push_req->push_len = file_size;
+      push_req->range_left = file_size;
+    }
+
   /* start reading from file */
-  push_req->buf = g_slice_alloc (BLOCK_SIZE);
+  push_req->block_size =
+    push_req->over_channel ? CHANNEL_BLOCK_SIZE : MIN_BLOCK_SIZE;
   push_request_read_block (push_req);
 }
 
+static void
+push_request_open_file (struct PushRequest *push_req)
+{
+  if (push_req->aborted)
+    {
+      push_request_stop (push_req);
+      return;
+    }
+
+  g_file_read_async (shared_file.file,
+                     G_PRIORITY_DEFAULT,
+                     push_req->cancellable,
+                     push_request_on_file_open,
+                     push_req);
+}
+
 static void
 push_request_on_headers_sent (GObject      *obj,
                               GAsyncResult *res,
@@ -384,11 +783,7 @@ push_request_on_headers_sent (GObject      *obj,
       return;
     }
 
-  g_file_read_async (shared_file.file,
-                     G_PRIORITY_DEFAULT,
-                     NULL,
-                     push_request_on_file_open,
-                     push_req);
+  push_request_open_file (push_req);
 }
 
 static void
@@ -406,13 +801,23 @@ on_connection (GObject      *obj,
                                                 &error));
   if (push_req->conn == NULL)
     {
-      g_printerr ("Error setting up data connection: %s\n", error->message);
+      if (! push_req->aborted)
+        g_printerr ("Error setting up data connection: %s\n", error->message);
       g_error_free (error);
 
       push_request_free (push_req);
       return;
     }
 
+  /* aborted before anything was sent, the connection is still clean */
+  if (push_req->aborted)
+    {
+      push_req->keep_alive = TRUE;
+      evd_connection_pool_recycle (conn_pool, EVD_CONNECTION (push_req->conn));
+      push_request_free (push_req);
+      return;
+    }
+
   request = evd_http_request_new (SOUP_METHOD_POST, push_req->transfer_url);
   g_free (push_req->transfer_url);
   push_req->transfer_url = NULL;
@@ -442,8 +847,14 @@ on_shared_file_info (GObject      *obj,
                                         &error);
   if (file_info == NULL)
     {
-      g_printerr ("Error quering file info: %s\n", error->message);
+      if (! push_req->aborted)
+        g_printerr ("Error quering file info: %s\n", error->message);
+
+      /* the service fails the download right away */
+      push_request_acknowledge (push_req, -1, error);
       g_error_free (error);
+
+      push_request_free (push_req);
       return;
     }
 
@@ -452,37 +863,307 @@ on_shared_file_info (GObject      *obj,
                                                              "standard::size"));
   g_object_unref (file_info);
 
+  push_request_acknowledge (push_req,
+                            filetea_source_get_size (shared_file.source),
+                            NULL);
+
+  /* a parked connection already sent the headers of the push, and a push
+     over the transport needs none */
+  if (push_req->conn != NULL || push_req->over_channel)
+    {
+      push_request_open_file (push_req);
+      return;
+    }
+
   /* get an HTTP connection with the service */
   evd_connection_pool_get_connection (conn_pool,
-                                      NULL,
+                                      push_req->cancellable,
                                       on_connection,
                                       push_req);
 }
 
+static void
+parked_push_free (gpointer data)
+{
+  struct ParkedPush *parked = data;
+
+  if (parked->conn != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (parked->conn,
+                                            parked_push_on_close,
+                                            parked);
+      g_io_stream_close (G_IO_STREAM (parked->conn), NULL, NULL);
+      g_object_unref (parked->conn);
+    }
+
+  g_free (parked->token);
+
+  g_slice_free (struct ParkedPush, parked);
+}
+
+/* the service drops parked connections that are not used for a while */
+static void
+parked_push_on_close (EvdConnection *conn, gpointer user_data)
+{
+  struct ParkedPush *parked = user_data;
+
+  g_hash_table_remove (parked_pushes, parked->token);
+
+  parked_pushes_fill ();
+}
+
+static void
+parked_push_on_headers_sent (GObject      *obj,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  struct ParkedPush *parked = user_data;
+  GError *error = NULL;
+
+  parking--;
+
+  if (! evd_http_connection_write_request_headers_finish (EVD_HTTP_CONNECTION (obj),
+                                                          res,
+                                                          &error))
+    {
+      g_printerr ("Error parking push connection: %s\n", error->message);
+      g_error_free (error);
+
+      parked_push_free (parked);
+      return;
+    }
+
+  g_signal_connect (parked->conn,
+                    "close",
+                    G_CALLBACK (parked_push_on_close),
+                    parked);
+  g_hash_table_insert (parked_pushes, parked->token, parked);
+}
+
+static void
+parked_push_on_connection (GObject      *obj,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+  struct ParkedPush *parked = user_data;
+  EvdHttpRequest *request;
+  SoupMessageHeaders *headers;
+  gchar *url;
+  GError *error = NULL;
+
+  parked->conn = EVD_HTTP_CONNECTION
+    (evd_connection_pool_get_connection_finish (EVD_CONNECTION_POOL (obj),
+                                                res,
+                                                &error));
+  if (parked->conn == NULL)
+    {
+      g_printerr ("Error parking push connection: %s\n", error->message);
+      g_error_free (error);
+
+      parking--;
+      parked_push_free (parked);
+      return;
+    }
+
+  /* the body follows once the service binds a transfer to the token */
+  url = g_strdup_printf ("%s/%s", service_url, parked->token);
+  request = evd_http_request_new (SOUP_METHOD_POST, url);
+  g_free (url);
+
+  headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (request));
+  soup_message_headers_replace (headers, "Connection", "keep-alive");
+
+  evd_http_connection_write_request_headers (parked->conn,
+                                             request,
+                                             NULL,
+                                             parked_push_on_headers_sent,
+                                             parked);
+  g_object_unref (request);
+}
+
+static void
+parked_push_on_token (GObject      *obj,
+                      GAsyncResult *res,
+                      gpointer      user_data)
+{
+  struct ParkedPush *parked;
+  gchar *token;
+  GError *error = NULL;
+
+  token = filetea_protocol_park_push_finish (FILETEA_PROTOCOL (obj),
+                                             res,
+                                             &error);
+  if (token == NULL)
+    {
+      g_printerr ("Error parking push connection: %s\n", error->message);
+      g_error_free (error);
+
+      parking--;
+      return;
+    }
+
+  parked = g_slice_new0 (struct ParkedPush);
+  parked->token = token;
+
+  evd_connection_pool_get_connection (conn_pool,
+                                      NULL,
+                                      parked_push_on_connection,
+                                      parked);
+}
+
+/* keeps idle push connections open, so the service can bind new
+   transfers to them without waiting for the seeder to connect */
+static void
+parked_pushes_fill (void)
+{
+  EvdPeer *peer;
+
+  /* standard input is pushed only once */
+  if (shared_file.live_streamed)
+    return;
+
+  peer = filetea_source_get_peer (shared_file.source);
+  if (peer == NULL || evd_peer_is_closed (peer))
+    return;
+
+  while (g_hash_table_size (parked_pushes) + parking <
+         (guint) MAX (max_parked_pushes, 0))
+    {
+      parking++;
+      filetea_protocol_park_push (protocol,
+                                  peer,
+                                  NULL,
+                                  parked_push_on_token,
+                                  NULL);
+    }
+}
+
+/* returns the parked connection of @token, or %NULL if it is gone */
+static EvdHttpConnection *
+parked_push_take (const gchar *token)
+{
+  struct ParkedPush *parked;
+  EvdHttpConnection *conn;
+
+  parked = g_hash_table_lookup (parked_pushes, token);
+  if (parked == NULL)
+    return NULL;
+
+  conn = parked->conn;
+  parked->conn = NULL;
+  g_signal_handlers_disconnect_by_func (conn, parked_push_on_close, parked);
+
+  g_hash_table_remove (parked_pushes, token);
+
+  return conn;
+}
+
 static void
 protocol_seeder_push_request (FileteaProtocol *protocol,
                               GAsyncResult    *result,
+                              const gchar     *push_token,
+                              gsize            channel_credit,
                               const gchar     *source_id,
                               const gchar     *transfer_id,
                               gboolean         is_chunked,
-                              SoupRange       *byte_range,
+                              SoupRange       *byte_ranges,
+                              guint            n_ranges,
                               gpointer         user_data)
 {
   struct PushRequest *push_req;
+  EvdHttpConnection *conn = NULL;
 
   g_assert_cmpint (g_strcmp0 (filetea_source_get_id (shared_file.source),
                               source_id),
                    ==, 0);
 
+  /* the service bound the transfer to one of the parked connections */
+  if (push_token != NULL)
+    {
+      conn = parked_push_take (push_token);
+      if (conn == NULL)
+        {
+          GError *error;
+
+          error = g_error_new (G_IO_ERROR,
+                               G_IO_ERROR_CLOSED,
+                               "Parked push connection is gone");
+          filetea_protocol_respond_push_request (protocol, result, -1, error);
+          g_error_free (error);
+
+          return;
+        }
+
+      parked_pushes_fill ();
+    }
+
+  if (shared_file.live)
+    {
+      if (shared_file.live_streamed)
+        {
+          GError *error;
+
+          g_printerr ("Standard input was already streamed, ignoring transfer '%s'\n",
+                      transfer_id);
+
+          error = g_error_new (G_IO_ERROR,
+                               G_IO_ERROR_NOT_FOUND,
+                               "Standard input was already streamed");
+          filetea_protocol_respond_push_request (protocol, result, -1, error);
+          g_error_free (error);
+
+          if (conn != NULL)
+            {
+              g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+              g_object_unref (conn);
+            }
+
+          return;
+        }
+
+      shared_file.live_streamed = TRUE;
+    }
+
   push_req = g_slice_new0 (struct PushRequest);
   push_req->shared_file = &shared_file;
+  push_req->transfer_id = g_strdup (transfer_id);
   push_req->transfer_url = g_strdup_printf ("%s/%s", service_url, transfer_id);
+  push_req->cancellable = g_cancellable_new ();
+  push_req->conn = conn;
+  push_req->over_channel = channel_credit > 0;
+  push_req->credit = channel_credit;
+  if (result != NULL)
+    push_req->result = g_object_ref (result);
+  g_hash_table_replace (push_requests, push_req->transfer_id, push_req);
   push_req->is_chunked = is_chunked;
   if (is_chunked)
     {
-      g_assert (byte_range != NULL);
-      push_req->byte_start = byte_range->start;
-      push_req->byte_end = byte_range->end;
+      guint i;
+
+      g_assert (byte_ranges != NULL && n_ranges > 0);
+
+      push_req->byte_ranges = g_new (SoupRange, n_ranges);
+      push_req->n_ranges = n_ranges;
+      for (i = 0; i < n_ranges; i++)
+        push_req->byte_ranges[i] = byte_ranges[i];
+    }
+
+  /* live content has no size to update */
+  if (shared_file.live)
+    {
+      push_request_acknowledge (push_req, -1, NULL);
+
+      if (push_req->conn != NULL)
+        {
+          push_request_open_file (push_req);
+          return;
+        }
+
+      evd_connection_pool_get_connection (conn_pool,
+                                          push_req->cancellable,
+                                          on_connection,
+                                          push_req);
+      return;
     }
 
   /* query file size again, in case it changed until last registration */
@@ -490,13 +1171,89 @@ protocol_seeder_push_request (FileteaProtocol *protocol,
                            "standard::size",
                            G_FILE_QUERY_INFO_NONE,
                            G_PRIORITY_DEFAULT,
-                           NULL,
+                           push_req->cancellable,
                            on_shared_file_info,
                            push_req);
+}
 
-  if (is_chunked)
+/* pushes of the segments of a split transfer go to '<transfer-id>.<n>' */
+static gboolean
+push_request_is_of_transfer (struct PushRequest *push_req,
+                             const gchar        *transfer_id)
+{
+  gsize len;
+
+  len = strlen (transfer_id);
+
+  return strncmp (push_req->transfer_id, transfer_id, len) == 0 &&
+    (push_req->transfer_id[len] == '\0' || push_req->transfer_id[len] == '.');
+}
+
+static void
+protocol_seeder_push_abort (FileteaProtocol *protocol,
+                            const gchar     *transfer_id,
+                            gpointer         user_data)
+{
+  GHashTableIter iter;
+  struct PushRequest *push_req;
+  GList *aborted = NULL;
+  GList *node;
+
+  g_hash_table_iter_init (&iter, push_requests);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &push_req))
+    if (! push_req->aborted && push_request_is_of_transfer (push_req, transfer_id))
+      aborted = g_list_prepend (aborted, push_req);
+
+  for (node = aborted; node != NULL; node = node->next)
+    {
+      push_req = node->data;
+
+      /* pending operations see the flag and stop the push */
+      push_req->aborted = TRUE;
+      g_cancellable_cancel (push_req->cancellable);
+
+      if (push_req->reading_response)
+        {
+          /* all was sent, the service still waits to know it */
+          push_request_stop (push_req);
+        }
+      else if (push_req->waiting_write)
+        {
+          g_signal_handlers_disconnect_by_func (push_req->conn,
+                                                push_request_conn_can_write,
+                                                push_req);
+          push_req->waiting_write = FALSE;
+
+          push_request_stop (push_req);
+        }
+      else if (push_req->waiting_credit)
+        {
+          push_req->waiting_credit = FALSE;
+          push_request_stop (push_req);
+        }
+    }
+
+  g_list_free (aborted);
+}
+
+static void
+protocol_push_credit (FileteaProtocol *protocol,
+                      const gchar     *transfer_id,
+                      gsize            credit,
+                      gpointer         user_data)
+{
+  struct PushRequest *push_req;
+
+  push_req = g_hash_table_lookup (push_requests, transfer_id);
+  if (push_req == NULL || ! push_req->over_channel || push_req->aborted)
+    return;
+
+  push_req->credit += credit;
+
+  if (push_req->waiting_credit)
     {
-      /* @TODO: handle partial requests */
+      push_req->waiting_credit = FALSE;
+      push_request_read_block (push_req);
     }
 }
 
@@ -565,7 +1322,7 @@ main (gint argc, gchar *argv[])
   GError *error = NULL;
   GOptionContext *context = NULL;
   GFileInfo *file_info = NULL;
-  FileteaProtocolVTable vtable;
+  FileteaProtocolVTable vtable = { NULL, };
   EvdJsonrpc *rpc;
   EvdWebsocketClient *transport = NULL;
 
@@ -604,17 +1361,15 @@ main (gint argc, gchar *argv[])
       exit_status = -1;
       goto out;
     }
-  else if (argc > 1)
+  else if (argc > 1 && g_strcmp0 (argv[1], "-") != 0)
     {
       /* one file has been specified, use it as source */
       file_name = g_strdup (argv[1]);
     }
   else
     {
-      /* use standard input as data source, currently not supported */
-      g_printerr ("Error parsing commandline options: No file specified and reading from standard input is currently not supported\n");
-      exit_status = -1;
-      goto out;
+      /* use standard input as data source, streamed live */
+      shared_file.live = TRUE;
     }
 
   /* resolve WebSocket service URL */
@@ -626,42 +1381,68 @@ main (gint argc, gchar *argv[])
       goto out;
     }
 
-  /* query file info */
-  shared_file.file = g_file_new_for_path (file_name);
-  file_info = g_file_query_info (shared_file.file,
-                                 "standard::size,standard::content-type,time::modified",
-                                 G_FILE_QUERY_INFO_NONE,
-                                 NULL,
-                                 &error);
-  if (file_info == NULL)
+  if (shared_file.live)
     {
-      g_printerr ("Error quering file info: %s\n", error->message);
-      g_error_free (error);
-      exit_status = -1;
-      goto out;
+      /* reading from a pipe has no size nor seeking, so the content is
+         offered as a live stream */
+      shared_file.file = g_file_new_for_path (STDIN_PATH);
+      shared_file.source = filetea_source_new (NULL,
+                                               STDIN_SOURCE_NAME,
+                                               "application/octet-stream",
+                                               0,
+                                               FILETEA_SOURCE_FLAGS_LIVE |
+                                               FILETEA_SOURCE_FLAGS_PUBLIC,
+                                               NULL);
     }
+  else
+    {
+      /* query file info */
+      shared_file.file = g_file_new_for_path (file_name);
+      file_info = g_file_query_info (shared_file.file,
+                                     "standard::size,standard::content-type,time::modified",
+                                     G_FILE_QUERY_INFO_NONE,
+                                     NULL,
+                                     &error);
+      if (file_info == NULL)
+        {
+          g_printerr ("Error quering file info: %s\n", error->message);
+          g_error_free (error);
+          g_free (file_name);
+          exit_status = -1;
+          goto out;
+        }
 
-  file_size =
-    g_file_info_get_attribute_uint64 (file_info, "standard::size");
-  file_type =
-    g_file_info_get_attribute_string (file_info, "standard::content-type");
-  shared_file.file_time_modified =
-    g_file_info_get_attribute_uint64 (file_info, "time::modified");
-
-  base_name = g_path_get_basename (file_name);
-  g_free (file_name);
-  shared_file.source = filetea_source_new (NULL,
-                                           base_name,
-                                           file_type,
-                                           file_size,
-                                           FILETEA_SOURCE_FLAGS_CHUNKABLE |
-                                           FILETEA_SOURCE_FLAGS_PUBLIC,
-                                           NULL);
-  g_free (base_name);
-  g_object_unref (file_info);
+      file_size =
+        g_file_info_get_attribute_uint64 (file_info, "standard::size");
+      file_type =
+        g_file_info_get_attribute_string (file_info, "standard::content-type");
+      shared_file.file_time_modified =
+        g_file_info_get_attribute_uint64 (file_info, "time::modified");
+
+      base_name = g_path_get_basename (file_name);
+      g_free (file_name);
+      shared_file.source = filetea_source_new (NULL,
+                                               base_name,
+                                               file_type,
+                                               file_size,
+                                               FILETEA_SOURCE_FLAGS_CHUNKABLE |
+                                               FILETEA_SOURCE_FLAGS_CHANNEL |
+                                               FILETEA_SOURCE_FLAGS_PUBLIC,
+                                               NULL);
+      g_free (base_name);
+      g_object_unref (file_info);
+    }
 
   /* protocol */
   vtable.seeder_push_request = protocol_seeder_push_request;
+  vtable.seeder_push_abort = protocol_seeder_push_abort;
+  vtable.push_credit = protocol_push_credit;
+
+  push_requests = g_hash_table_new (g_str_hash, g_str_equal);
+  parked_pushes = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         NULL,
+                                         parked_push_free);
 
   protocol = filetea_protocol_new (&vtable,
                                    NULL,
@@ -709,6 +1490,10 @@ main (gint argc, gchar *argv[])
     g_object_unref (evd_daemon);
   if (protocol != NULL)
     g_object_unref (protocol);
+  if (push_requests != NULL)
+    g_hash_table_unref (push_requests);
+  if (parked_pushes != NULL)
+    g_hash_table_unref (parked_pushes);
   if (transport != NULL)
     g_object_unref (transport);
   if (conn_pool != NULL)
@@ -20,12 +20,18 @@
  * for more details.
  */
 
+#include <string.h>
 #include <uuid/uuid.h>
 
 #include "filetea-node.h"
 
 #include "filetea-source.h"
+#include "filetea-source-registry.h"
+#include "filetea-search-index.h"
 #include "filetea-transfer.h"
+#include "filetea-fanout.h"
+#include "filetea-cache.h"
+#include "filetea-buffer-pool.h"
 
 G_DEFINE_TYPE (FileteaNode, filetea_node, G_TYPE_OBJECT)
 
@@ -35,23 +41,173 @@ G_DEFINE_TYPE (FileteaNode, filetea_node, G_TYPE_OBJECT)
 
 #define DEFAULT_SOURCE_ID_START_DEPTH 8
 
+#define DEFAULT_TRANSFER_RING_DEPTH 4
+#define MAX_TRANSFER_RING_DEPTH     64
+
+#define DEFAULT_TRANSFER_MIN_BLOCK_SIZE 0x1000
+#define DEFAULT_TRANSFER_MAX_BLOCK_SIZE 0x40000
+#define MAX_TRANSFER_BLOCK_SIZE         0x100000
+
+#define DEFAULT_FANOUT_BUFFER_SIZE 0x400000
+#define MAX_FANOUT_BUFFER_SIZE     0x4000000
+
+#define DEFAULT_TRANSFER_RESUME_TIMEOUT 30 /* in seconds */
+
+/* longest timeout that fits in miliseconds */
+#define MAX_TRANSFER_TIMEOUT (G_MAXUINT / 1000) /* in seconds */
+
+#define DEFAULT_TRANSFER_IDLE_TIMEOUT 60 /* in seconds */
+
+#define DEFAULT_TRANSFER_MAX_SEGMENTS     1
+#define MAX_TRANSFER_SEGMENTS             16
+#define DEFAULT_TRANSFER_SEGMENT_MIN_SIZE 0x1000000
+
+/* relative bandwidth gain for one more segment to be worth it */
+#define PULL_SEGMENTS_GAIN 0.1
+
+#define PULL_HISTORY_KEY  "org.filetea.PullHistory"
+#define PULL_MEASURED_KEY "org.filetea.PullMeasured"
+
+#define DEFAULT_CACHE_MAX_SIZE G_GUINT64_CONSTANT (0x40000000)
+
+#define DEFAULT_BUFFER_POOL_SIZE 0x4000000
+
+/* transfer deadlines are checked 4 times per second, over a minute */
+#define TIMER_WHEEL_RESOLUTION 250
+#define TIMER_WHEEL_SLOTS      256
+
+/* seconds a client is asked to wait when relay memory is exhausted */
+#define BUFFER_POOL_RETRY_AFTER 5
+
+/* how long a seeder has to tell how much of an aborted push it sent,
+   before its connection is closed */
+#define ABORTED_PUSH_TIMEOUT 10000 /* in miliseconds */
+
+#define DEFAULT_TRANSFER_CHANNEL_MAX_SIZE 0x100000
+#define DEFAULT_TRANSFER_CHANNEL_CREDIT   0x40000
+
+#define DEFAULT_TRANSFER_PARKED_PUSHES 4
+#define MAX_TRANSFER_PARKED_PUSHES     16
+#define PARKED_PUSH_TIMEOUT            60000 /* in miliseconds */
+
+#define DEFAULT_SEARCH_RESULTS 50
+#define MAX_SEARCH_RESULTS     200
+
+/* threads signing and verifying registered sources */
+#define SIGNING_THREADS 2
+
+/* how pushes from a seeder did with the number of segments tried */
+typedef struct
+{
+  guint segments;
+  gdouble bandwidth;
+  gboolean probing;
+} PullHistory;
+
 /* private data */
+/* a push connection left behind by a transfer whose target is gone */
+typedef struct
+{
+  FileteaNode *node;
+  gchar *transfer_id;
+  EvdPeer *peer;
+  EvdHttpConnection *conn;
+  gsize consumed;
+  gsize pushed;
+  GCancellable *cancellable;
+  gboolean skipping;
+  gboolean removed;
+  FileteaTimer *timeout;
+} AbortedPush;
+
+/* an idle push connection a seeder keeps open, waiting for a transfer */
+typedef struct
+{
+  FileteaNode *node;
+  gchar *token;
+  EvdPeer *peer;
+  EvdHttpConnection *conn;
+  FileteaTimer *timeout;
+} ParkedPush;
+
+/* a push coming over the seeder's transport instead of a connection */
+typedef struct
+{
+  FileteaNode *node;
+  FileteaTransfer *transfer;
+  EvdPeer *peer;
+  GByteArray *buf;
+  gsize left;
+  gsize consumed;
+  gboolean started;
+} PushChannel;
+
+/* a batch of registered sources being signed off the main loop */
+typedef struct
+{
+  FileteaNode *node;
+  EvdPeer *peer;
+  GAsyncResult *result;
+  GPtrArray *sources;
+  GPtrArray *data;
+  GPtrArray *signatures;
+} SignBatch;
+
 struct _FileteaNodePrivate
 {
   gchar *id;
   gchar *key;
   guint8 source_id_start_depth;
 
+  /* keyed state every signature is copied from */
+  GHmac *hmac;
+  GThreadPool *signing_pool;
+  GMainContext *main_context;
+
   FileteaProtocolVTable protocol_vtable;
   FileteaProtocol *protocol;
 
-  FileteaWebService *web_service;
+  /* one for each listener, all sharing the sources and transfers */
+  GPtrArray *web_services;
 
-  GHashTable *sources_by_id;
-  GHashTable *sources_by_peer;
+  FileteaSourceRegistry *sources;
+  FileteaSearchIndex *search_index;
   GHashTable *transfers_by_id;
   GHashTable *transfers_by_peer;
 
+  gboolean transfer_zero_copy;
+  guint transfer_ring_depth;
+  gsize transfer_min_block_size;
+  gsize transfer_max_block_size;
+  gdouble transfer_max_bw_in;
+  gdouble transfer_max_bw_out;
+  guint transfer_resume_timeout;
+  guint transfer_idle_timeout;
+  gdouble transfer_min_bw;
+  guint transfer_max_segments;
+  gsize transfer_segment_min_size;
+  GHashTable *resuming_transfers_by_source;
+
+  GHashTable *aborted_pushes;
+
+  gsize transfer_channel_max_size;
+  gsize transfer_channel_credit;
+  GHashTable *push_channels;
+
+  guint transfer_parked_pushes;
+  GHashTable *parked_pushes;
+  GHashTable *parked_pushes_by_peer;
+
+  gsize fanout_buffer_size;
+  GHashTable *fanouts_by_source;
+  GHashTable *fanouts_by_transfer;
+
+  FileteaCache *cache;
+
+  FileteaTimerWheel *timer_wheel;
+
+  FileteaBufferPool *buffer_pool;
+
   guint report_transfers_src_id;
 };
 
@@ -61,10 +217,13 @@ static void     filetea_node_init               (FileteaNode *self);
 static void     filetea_node_finalize           (GObject *obj);
 static void     filetea_node_dispose            (GObject *obj);
 
-static gboolean register_source                 (FileteaProtocol  *protocol,
+static void     sign_batch_run                  (gpointer data,
+                                                 gpointer user_data);
+
+static void     register_sources                (FileteaProtocol  *protocol,
                                                  EvdPeer          *peer,
-                                                 FileteaSource    *source,
-                                                 GError          **error,
+                                                 GList            *sources,
+                                                 GAsyncResult     *result,
                                                  gpointer          user_data);
 static gboolean unregister_source               (FileteaProtocol *protocol,
                                                  EvdPeer         *peer,
@@ -77,12 +236,53 @@ static void     content_request                 (FileteaProtocol    *protocol,
                                                  const gchar        *action,
                                                  const gchar        *peer_id,
                                                  gboolean            is_chunked,
-                                                 SoupRange          *byte_range,
+                                                 SoupRange          *byte_ranges,
+                                                 guint               n_ranges,
                                                  gpointer            user_data);
 static void     content_push                    (FileteaProtocol    *protocol,
                                                  FileteaTransfer    *transfer,
                                                  EvdHttpConnection  *conn,
                                                  gpointer            user_data);
+static gboolean pause_transfer                  (FileteaProtocol    *protocol,
+                                                 EvdPeer            *peer,
+                                                 const gchar        *transfer_id,
+                                                 gboolean            pause,
+                                                 gpointer            user_data);
+static void     push_aborted                    (FileteaProtocol    *protocol,
+                                                 EvdPeer            *peer,
+                                                 const gchar        *transfer_id,
+                                                 gsize               pushed,
+                                                 gpointer            user_data);
+
+static gchar *  park_push                       (FileteaProtocol  *protocol,
+                                                 EvdPeer          *peer,
+                                                 GError          **error,
+                                                 gpointer          user_data);
+
+static void     aborted_push_free               (gpointer data);
+static void     aborted_push_skip               (AbortedPush *push);
+
+static void     push_data                       (FileteaProtocol    *protocol,
+                                                 EvdPeer            *peer,
+                                                 const gchar        *transfer_id,
+                                                 const gchar        *buf,
+                                                 gsize               size,
+                                                 gpointer            user_data);
+
+static GList *  search                          (FileteaProtocol *protocol,
+                                                 const gchar     *query,
+                                                 guint            max_results,
+                                                 gpointer         user_data);
+
+static void     push_channel_free               (gpointer data);
+
+static void     parked_push_free                (gpointer data);
+static void     parked_push_remove              (FileteaNode *self,
+                                                 ParkedPush  *parked);
+
+static gboolean content_push_segment            (FileteaNode       *self,
+                                                 const gchar       *content_id,
+                                                 EvdHttpConnection *conn);
 
 static void     on_new_peer                     (EvdTransport *transport,
                                                  EvdPeer      *peer,
@@ -117,29 +317,82 @@ filetea_node_init (FileteaNode *self)
                                          NULL);
 
   /* fill protocol's virtual table */
-  priv->protocol_vtable.register_source = register_source;
+  priv->protocol_vtable.register_sources = register_sources;
   priv->protocol_vtable.unregister_source = unregister_source;
   priv->protocol_vtable.content_request = content_request;
   priv->protocol_vtable.content_push = content_push;
+  priv->protocol_vtable.pause_transfer = pause_transfer;
+  priv->protocol_vtable.push_aborted = push_aborted;
+  priv->protocol_vtable.park_push = park_push;
+  priv->protocol_vtable.push_data = push_data;
+  priv->protocol_vtable.search = search;
+
+  /* sources by id and by peer */
+  self->priv->sources = filetea_source_registry_new ();
+
+  /* sources are signed in threads, and registered back in this context */
+  priv->main_context = g_main_context_ref_thread_default ();
+  priv->signing_pool = g_thread_pool_new (sign_batch_run,
+                                          NULL,
+                                          SIGNING_THREADS,
+                                          FALSE,
+                                          NULL);
+
+  /* public sources by the words in their name and tags */
+  self->priv->search_index = filetea_search_index_new ();
+
+  /* hash tables for indexing file transfers */
+  self->priv->transfers_by_id =
+    g_hash_table_new_full (g_str_hash,
+                           g_str_equal,
+                           g_free,
+                           g_object_unref);
 
-  /* hash tables for indexing sources */
-  self->priv->sources_by_id =
+  /* hash tables for transfers sharing an upstream push, a source can have
+     one for each range being pushed */
+  self->priv->fanouts_by_source =
+    g_hash_table_new_full (g_str_hash,
+                           g_str_equal,
+                           g_free,
+                           (GDestroyNotify) g_ptr_array_unref);
+  self->priv->fanouts_by_transfer =
     g_hash_table_new_full (g_str_hash,
                            g_str_equal,
                            g_free,
                            g_object_unref);
-  self->priv->sources_by_peer =
+
+  /* push connections waiting for their seeder to stop */
+  self->priv->aborted_pushes =
+    g_hash_table_new_full (g_str_hash,
+                           g_str_equal,
+                           NULL,
+                           aborted_push_free);
+
+  /* pushes over the transport of seeders, by transfer id */
+  self->priv->push_channels =
+    g_hash_table_new_full (g_str_hash,
+                           g_str_equal,
+                           NULL,
+                           push_channel_free);
+
+  /* idle push connections of seeders, by token and by seeder */
+  self->priv->parked_pushes =
+    g_hash_table_new_full (g_str_hash,
+                           g_str_equal,
+                           NULL,
+                           parked_push_free);
+  self->priv->parked_pushes_by_peer =
     g_hash_table_new_full (g_direct_hash,
                            g_direct_equal,
                            NULL,
-                           (GDestroyNotify) g_hash_table_unref);
+                           (GDestroyNotify) g_queue_free);
 
-  /* hash tables for indexing file transfers */
-  self->priv->transfers_by_id =
+  /* queues of transfers waiting for their source to push again */
+  self->priv->resuming_transfers_by_source =
     g_hash_table_new_full (g_str_hash,
                            g_str_equal,
                            g_free,
-                           g_object_unref);
+                           (GDestroyNotify) g_queue_free);
 
   /* @TODO: not yet implemented */
   /*
@@ -151,6 +404,12 @@ filetea_node_init (FileteaNode *self)
   */
 
   priv->report_transfers_src_id = 0;
+
+  priv->web_services = g_ptr_array_new ();
+
+  /* deadlines of all transfers */
+  priv->timer_wheel = filetea_timer_wheel_new (TIMER_WHEEL_RESOLUTION,
+                                               TIMER_WHEEL_SLOTS);
 }
 
 static void
@@ -158,16 +417,17 @@ filetea_node_dispose (GObject *obj)
 {
   FileteaNode *self = FILETEA_NODE (obj);
 
-  if (self->priv->sources_by_id != NULL)
+  /* before the sources, it doesn't keep them alive */
+  if (self->priv->search_index != NULL)
     {
-      g_hash_table_unref (self->priv->sources_by_id);
-      self->priv->sources_by_id = NULL;
+      g_object_unref (self->priv->search_index);
+      self->priv->search_index = NULL;
     }
 
-  if (self->priv->sources_by_peer != NULL)
+  if (self->priv->sources != NULL)
     {
-      g_hash_table_unref (self->priv->sources_by_peer);
-      self->priv->sources_by_peer = NULL;
+      g_object_unref (self->priv->sources);
+      self->priv->sources = NULL;
     }
 
   if (self->priv->transfers_by_id != NULL)
@@ -176,6 +436,67 @@ filetea_node_dispose (GObject *obj)
       self->priv->transfers_by_id = NULL;
     }
 
+  if (self->priv->resuming_transfers_by_source != NULL)
+    {
+      g_hash_table_unref (self->priv->resuming_transfers_by_source);
+      self->priv->resuming_transfers_by_source = NULL;
+    }
+
+  /* before the timer wheel, their timeouts are in it */
+  if (self->priv->aborted_pushes != NULL)
+    {
+      g_hash_table_unref (self->priv->aborted_pushes);
+      self->priv->aborted_pushes = NULL;
+    }
+
+  if (self->priv->push_channels != NULL)
+    {
+      g_hash_table_unref (self->priv->push_channels);
+      self->priv->push_channels = NULL;
+    }
+
+  if (self->priv->parked_pushes_by_peer != NULL)
+    {
+      g_hash_table_unref (self->priv->parked_pushes_by_peer);
+      self->priv->parked_pushes_by_peer = NULL;
+    }
+
+  if (self->priv->parked_pushes != NULL)
+    {
+      g_hash_table_unref (self->priv->parked_pushes);
+      self->priv->parked_pushes = NULL;
+    }
+
+  if (self->priv->fanouts_by_transfer != NULL)
+    {
+      g_hash_table_unref (self->priv->fanouts_by_transfer);
+      self->priv->fanouts_by_transfer = NULL;
+    }
+
+  if (self->priv->fanouts_by_source != NULL)
+    {
+      g_hash_table_unref (self->priv->fanouts_by_source);
+      self->priv->fanouts_by_source = NULL;
+    }
+
+  if (self->priv->cache != NULL)
+    {
+      g_object_unref (self->priv->cache);
+      self->priv->cache = NULL;
+    }
+
+  if (self->priv->buffer_pool != NULL)
+    {
+      g_object_unref (self->priv->buffer_pool);
+      self->priv->buffer_pool = NULL;
+    }
+
+  if (self->priv->timer_wheel != NULL)
+    {
+      g_object_unref (self->priv->timer_wheel);
+      self->priv->timer_wheel = NULL;
+    }
+
   if (self->priv->transfers_by_peer != NULL)
     {
       g_hash_table_unref (self->priv->transfers_by_peer);
@@ -189,39 +510,97 @@ static void
 filetea_node_finalize (GObject *obj)
 {
   FileteaNode *self = FILETEA_NODE (obj);
-  EvdTransport *transport;
-  EvdTransport *ws_transport;
+  guint i;
+
+  /* batches keep the node alive, none is left by now */
+  g_thread_pool_free (self->priv->signing_pool, FALSE, TRUE);
+  g_main_context_unref (self->priv->main_context);
 
   g_free (self->priv->id);
   g_free (self->priv->key);
+  if (self->priv->hmac != NULL)
+    g_hmac_unref (self->priv->hmac);
 
   g_object_unref (self->priv->protocol);
 
-  transport = filetea_web_service_get_transport (self->priv->web_service);
-  g_signal_handlers_disconnect_by_func (transport,
-                                        on_new_peer,
-                                        self);
-  g_signal_handlers_disconnect_by_func (transport,
-                                        on_peer_closed,
-                                        self);
+  for (i = 0; i < self->priv->web_services->len; i++)
+    {
+      FileteaWebService *web_service;
+      EvdTransport *transport;
+      EvdTransport *ws_transport;
+
+      web_service = g_ptr_array_index (self->priv->web_services, i);
+
+      transport = filetea_web_service_get_transport (web_service);
+      g_signal_handlers_disconnect_by_func (transport,
+                                            on_new_peer,
+                                            self);
+      g_signal_handlers_disconnect_by_func (transport,
+                                            on_peer_closed,
+                                            self);
+
+      g_object_get (transport, "websocket-service", &ws_transport, NULL);
+      g_signal_handlers_disconnect_by_func (ws_transport,
+                                            on_new_peer,
+                                            self);
+      g_signal_handlers_disconnect_by_func (ws_transport,
+                                            on_peer_closed,
+                                            self);
+      g_object_unref (ws_transport);
+
+      g_object_unref (web_service);
+    }
+  g_ptr_array_free (self->priv->web_services, TRUE);
 
-  g_object_get (transport, "websocket-service", &ws_transport, NULL);
-  g_signal_handlers_disconnect_by_func (ws_transport,
-                                        on_new_peer,
-                                        self);
-  g_signal_handlers_disconnect_by_func (ws_transport,
-                                        on_peer_closed,
-                                        self);
-  g_object_unref (ws_transport);
+  G_OBJECT_CLASS (filetea_node_parent_class)->finalize (obj);
+}
+
+/* reads integer @key of the 'transfer' group into @value, capped at @max,
+   leaving @value as is if the key is not set */
+static gboolean
+load_transfer_config_int (GKeyFile     *config,
+                          const gchar  *key,
+                          gint64        min,
+                          gint64        max,
+                          gint64       *value,
+                          GError      **error)
+{
+  GError *parse_error = NULL;
+  gint64 v;
 
-  g_object_unref (self->priv->web_service);
+  if (! g_key_file_has_key (config, "transfer", key, NULL))
+    return TRUE;
 
-  G_OBJECT_CLASS (filetea_node_parent_class)->finalize (obj);
+  v = g_key_file_get_int64 (config, "transfer", key, &parse_error);
+  if (parse_error != NULL)
+    {
+      g_propagate_error (error, parse_error);
+      return FALSE;
+    }
+
+  if (v < min)
+    {
+      g_set_error (error,
+                   G_KEY_FILE_ERROR,
+                   G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "Transfer '%s' must be at least %" G_GINT64_FORMAT,
+                   key,
+                   min);
+      return FALSE;
+    }
+
+  *value = MIN (v, max);
+
+  return TRUE;
 }
 
 static gboolean
 load_config (FileteaNode *self, GKeyFile *config, GError **error)
 {
+  gchar *cache_dir;
+  guint64 pool_size;
+  gint64 value;
+
   /* node id */
   self->priv->id = g_key_file_get_string (config, "node", "id", error);
   if (self->priv->id == NULL)
@@ -235,6 +614,11 @@ load_config (FileteaNode *self, GKeyFile *config, GError **error)
       self->priv->key = evd_uuid_new ();
     }
 
+  /* the key is digested once, signatures start from a copy of it */
+  self->priv->hmac = g_hmac_new (G_CHECKSUM_SHA256,
+                                 (const guchar *) self->priv->key,
+                                 strlen (self->priv->key));
+
   /* source id start depth */
   self->priv->source_id_start_depth =
     g_key_file_get_integer (config,
@@ -247,6 +631,193 @@ load_config (FileteaNode *self, GKeyFile *config, GError **error)
     self->priv->source_id_start_depth =
       MIN (self->priv->source_id_start_depth, 16 + strlen (self->priv->id));
 
+  /* zero-copy relay of transfers */
+  if (g_key_file_has_key (config, "transfer", "zero-copy", NULL))
+    self->priv->transfer_zero_copy =
+      g_key_file_get_boolean (config, "transfer", "zero-copy", NULL);
+  else
+    self->priv->transfer_zero_copy = TRUE;
+
+  /* number of blocks a transfer can read ahead from its source */
+  value = DEFAULT_TRANSFER_RING_DEPTH;
+  if (! load_transfer_config_int (config,
+                                  "ring-depth",
+                                  1,
+                                  MAX_TRANSFER_RING_DEPTH,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_ring_depth = value;
+
+  /* per-transfer bandwidth limits */
+  self->priv->transfer_max_bw_in =
+    MAX (g_key_file_get_double (config, "transfer", "max-bandwidth-in", NULL),
+         0.0);
+  self->priv->transfer_max_bw_out =
+    MAX (g_key_file_get_double (config, "transfer", "max-bandwidth-out", NULL),
+         0.0);
+
+  /* limits of the adaptive transfer block size */
+  value = DEFAULT_TRANSFER_MIN_BLOCK_SIZE;
+  if (! load_transfer_config_int (config,
+                                  "min-block-size",
+                                  1,
+                                  MAX_TRANSFER_BLOCK_SIZE,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_min_block_size = value;
+
+  value = DEFAULT_TRANSFER_MAX_BLOCK_SIZE;
+  if (! load_transfer_config_int (config,
+                                  "max-block-size",
+                                  1,
+                                  MAX_TRANSFER_BLOCK_SIZE,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_max_block_size = value;
+
+  if (self->priv->transfer_min_block_size > self->priv->transfer_max_block_size)
+    {
+      g_set_error (error,
+                   G_KEY_FILE_ERROR,
+                   G_KEY_FILE_ERROR_INVALID_VALUE,
+                   "Transfer 'min-block-size' can't be larger than "
+                   "'max-block-size'");
+      return FALSE;
+    }
+
+  /* how long transfers wait for a dropped seeder to come back, 0 disables
+     resuming */
+  value = DEFAULT_TRANSFER_RESUME_TIMEOUT;
+  if (! load_transfer_config_int (config,
+                                  "resume-timeout",
+                                  0,
+                                  MAX_TRANSFER_TIMEOUT,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_resume_timeout = value;
+
+  /* when a downloader that doesn't take content is dropped, 0 disables
+     each limit */
+  value = DEFAULT_TRANSFER_IDLE_TIMEOUT;
+  if (! load_transfer_config_int (config,
+                                  "idle-timeout",
+                                  0,
+                                  MAX_TRANSFER_TIMEOUT,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_idle_timeout = value;
+
+  self->priv->transfer_min_bw =
+    MAX (g_key_file_get_double (config, "transfer", "min-bandwidth", NULL),
+         0.0);
+
+  /* large downloads can be pushed over several connections in parallel */
+  value = DEFAULT_TRANSFER_MAX_SEGMENTS;
+  if (! load_transfer_config_int (config,
+                                  "max-segments",
+                                  1,
+                                  MAX_TRANSFER_SEGMENTS,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_max_segments = value;
+
+  self->priv->transfer_segment_min_size =
+    g_key_file_get_uint64 (config, "transfer", "segment-min-size", NULL);
+  if (self->priv->transfer_segment_min_size == 0)
+    self->priv->transfer_segment_min_size = DEFAULT_TRANSFER_SEGMENT_MIN_SIZE;
+
+  /* content small enough is pushed over the seeder's transport, 0 disables
+     it */
+  if (g_key_file_has_key (config, "transfer", "channel-max-size", NULL))
+    self->priv->transfer_channel_max_size =
+      g_key_file_get_uint64 (config, "transfer", "channel-max-size", NULL);
+  else
+    self->priv->transfer_channel_max_size = DEFAULT_TRANSFER_CHANNEL_MAX_SIZE;
+
+  self->priv->transfer_channel_credit =
+    g_key_file_get_uint64 (config, "transfer", "channel-credit", NULL);
+  if (self->priv->transfer_channel_credit == 0)
+    self->priv->transfer_channel_credit = DEFAULT_TRANSFER_CHANNEL_CREDIT;
+
+  /* idle push connections each seeder can keep open, 0 disables them */
+  value = DEFAULT_TRANSFER_PARKED_PUSHES;
+  if (! load_transfer_config_int (config,
+                                  "parked-pushes",
+                                  0,
+                                  MAX_TRANSFER_PARKED_PUSHES,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->transfer_parked_pushes = value;
+
+  /* content buffered for downloaders sharing an upstream push, 0 disables
+     sharing */
+  value = DEFAULT_FANOUT_BUFFER_SIZE;
+  if (! load_transfer_config_int (config,
+                                  "fanout-buffer-size",
+                                  0,
+                                  MAX_FANOUT_BUFFER_SIZE,
+                                  &value,
+                                  error))
+    {
+      return FALSE;
+    }
+  self->priv->fanout_buffer_size = value;
+
+  if (self->priv->fanout_buffer_size > 0)
+    self->priv->fanout_buffer_size = MAX (self->priv->fanout_buffer_size,
+                                          self->priv->transfer_max_block_size);
+
+  /* memory shared by the buffers of all transfers, 0 means no limit */
+  if (g_key_file_has_key (config, "transfer", "buffer-pool-size", NULL))
+    pool_size = g_key_file_get_uint64 (config,
+                                       "transfer",
+                                       "buffer-pool-size",
+                                       NULL);
+  else
+    pool_size = DEFAULT_BUFFER_POOL_SIZE;
+
+  self->priv->buffer_pool = filetea_buffer_pool_new (pool_size);
+
+  /* on-disk cache of public sources */
+  cache_dir = g_key_file_get_string (config, "cache", "directory", NULL);
+  if (cache_dir != NULL && cache_dir[0] != '\0')
+    {
+      guint64 max_size;
+
+      max_size = g_key_file_get_uint64 (config, "cache", "max-size", NULL);
+      if (max_size == 0)
+        max_size = DEFAULT_CACHE_MAX_SIZE;
+
+      self->priv->cache = filetea_cache_new (cache_dir, max_size, error);
+      if (self->priv->cache == NULL)
+        {
+          g_free (cache_dir);
+          return FALSE;
+        }
+    }
+  g_free (cache_dir);
+
   return TRUE;
 }
 
@@ -288,7 +859,7 @@ generate_source_id (FileteaNode *self, const gchar *instance_id)
 
   id = generate_random_source_id (instance_id, _depth);
 
-  while (g_hash_table_lookup (self->priv->sources_by_id, id) != NULL)
+  while (filetea_source_registry_lookup (self->priv->sources, id) != NULL)
     {
       g_free (id);
 
@@ -307,215 +878,973 @@ generate_source_id (FileteaNode *self, const gchar *instance_id)
 }
 
 static gchar *
-source_get_signature (FileteaNode *self, FileteaSource *source)
+source_get_signed_data (FileteaSource *source)
 {
-  GHmac *hmac;
-  gchar *signature = NULL;
-  gchar *data;
-
-  hmac = g_hmac_new (G_CHECKSUM_SHA256,
-                     (const guchar *) self->priv->key,
-                     strlen (self->priv->key));
-
   /* data to be signed is: <id>:<content-type>:<flags> */
-  data = g_strdup_printf ("%s:%s:%u",
+  return g_strdup_printf ("%s:%s:%u",
                           filetea_source_get_id (source),
                           filetea_source_get_content_type (source),
                           filetea_source_get_flags (source));
+}
 
-  g_hmac_update (hmac, (const guchar *) data, -1);
-
-  signature = g_strdup (g_hmac_get_string (hmac));
+/* the listener a request came through, which should also respond it */
+static EvdWebService *
+connection_get_web_service (FileteaNode *self, EvdHttpConnection *conn)
+{
+  FileteaWebService *web_service;
 
-  g_free (data);
-  g_hmac_unref (hmac);
+  web_service = g_object_get_data (G_OBJECT (conn),
+                                   FILETEA_TRANSFER_WEB_SERVICE_KEY);
+  if (web_service == NULL)
+    web_service = g_ptr_array_index (self->priv->web_services, 0);
 
-  return signature;
+  return EVD_WEB_SERVICE (web_service);
 }
 
-static gboolean
-source_check_signature (FileteaNode   *self,
-                        FileteaSource *source,
-                        const gchar   *signature)
+static EvdPeer *
+lookup_peer (FileteaNode *self, const gchar *peer_id)
 {
-  gboolean result;
-  gchar *actual_signature;
+  guint i;
+
+  for (i = 0; i < self->priv->web_services->len; i++)
+    {
+      FileteaWebService *web_service;
+      EvdPeer *peer;
+
+      web_service = g_ptr_array_index (self->priv->web_services, i);
+      peer =
+        evd_transport_lookup_peer (filetea_web_service_get_transport (web_service),
+                                   peer_id);
+      if (peer != NULL)
+        return peer;
+    }
 
-  actual_signature = source_get_signature (self, source);
-  result = g_strcmp0 (signature, actual_signature) == 0;
+  return NULL;
+}
 
-  g_free (actual_signature);
+static void
+parked_push_on_close (EvdConnection *conn, gpointer user_data)
+{
+  ParkedPush *parked = user_data;
 
-  return result;
+  parked_push_remove (parked->node, parked);
 }
 
-static gboolean
-register_source (FileteaProtocol  *protocol,
-                 EvdPeer          *peer,
-                 FileteaSource    *source,
-                 GError          **error,
-                 gpointer          user_data)
+static void
+parked_push_free (gpointer data)
 {
-  FileteaNode *self = FILETEA_NODE (user_data);
-  GHashTable *sources_of_peer;
+  ParkedPush *parked = data;
 
-  /* check if an existing id is being claimed */
-  if (filetea_source_get_id (source) != NULL)
+  if (parked->timeout != NULL)
+    filetea_timer_wheel_cancel (parked->node->priv->timer_wheel,
+                                parked->timeout);
+
+  if (parked->conn != NULL)
     {
-      const gchar *source_id;
-      const gchar *source_sig;
+      g_signal_handlers_disconnect_by_func (parked->conn,
+                                            parked_push_on_close,
+                                            parked);
+      g_io_stream_close (G_IO_STREAM (parked->conn), NULL, NULL);
+      g_object_unref (parked->conn);
+    }
 
-      source_id = filetea_source_get_id (source);
-      source_sig = filetea_source_get_signature (source);
+  g_object_unref (parked->peer);
+  g_free (parked->token);
 
-      /* validate the signature */
-      if (source_check_signature (self, source, source_sig))
-        {
-          FileteaSource *current_source;
+  g_slice_free (ParkedPush, parked);
+}
 
-          /* registration seems authentic */
+static void
+parked_push_remove (FileteaNode *self, ParkedPush *parked)
+{
+  GQueue *queue;
 
-          /* check if the source is already registered */
-          current_source = g_hash_table_lookup (self->priv->sources_by_id,
-                                                source_id);
-          if (current_source != NULL)
-            {
-              sources_of_peer =
-                g_hash_table_lookup (self->priv->sources_by_peer,
-                                     filetea_source_get_peer (current_source));
-              g_assert (sources_of_peer != NULL);
-              g_hash_table_remove (sources_of_peer, source_id);
-
-              /* already registered, just update the fields and return success */
-              filetea_source_set_peer (current_source, peer);
-
-              /* fill 'sources_by_peer' table */
-              sources_of_peer = g_hash_table_lookup (self->priv->sources_by_peer, peer);
-              if (sources_of_peer == NULL)
-                {
-                  sources_of_peer =
-                    g_hash_table_new_full (g_str_hash,
-                                           g_str_equal,
-                                           g_free,
-                                           g_object_unref);
-                  g_hash_table_insert (self->priv->sources_by_peer, peer, sources_of_peer);
-                }
-              g_hash_table_insert (sources_of_peer,
-                                   g_strdup (filetea_source_get_id (source)),
-                                   g_object_ref (current_source));
-
-              /* @TODO: update the rest of the fields */
-
-              return TRUE;
-            }
-        }
-      else
-        {
-          /* invalid signature, return error */
-          g_set_error (error,
-                       G_IO_ERROR,
-                       G_IO_ERROR_INVALID_ARGUMENT,
-                       "Invalid source signature");
-          return FALSE;
-        }
-    }
-  else
+  queue = g_hash_table_lookup (self->priv->parked_pushes_by_peer,
+                               parked->peer);
+  if (queue != NULL)
     {
-      gchar *source_id;
-      gchar *source_sig;
+      g_queue_remove (queue, parked);
+      if (g_queue_is_empty (queue))
+        g_hash_table_remove (self->priv->parked_pushes_by_peer, parked->peer);
+    }
 
-      /* create a fresh source id */
-      source_id = generate_source_id (self, self->priv->id);
+  g_hash_table_remove (self->priv->parked_pushes, parked->token);
+}
 
-      /* store id in source object */
-      filetea_source_set_id (source, source_id);
+/* the seeder parks a new connection if it still wants to */
+static gboolean
+parked_push_on_timeout (gpointer user_data)
+{
+  ParkedPush *parked = user_data;
 
-      /* create a signature for this source */
-      /* @TODO: do this asynchonously to avoid blocking */
-      source_sig = source_get_signature (self, source);
-      filetea_source_set_signature (source, source_sig);
+  parked->timeout = NULL;
+  parked_push_remove (parked->node, parked);
 
-      g_free (source_id);
-      g_free (source_sig);
-    }
+  return FALSE;
+}
+
+static gchar *
+park_push (FileteaProtocol  *protocol,
+           EvdPeer          *peer,
+           GError          **error,
+           gpointer          user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  GQueue *queue;
+  ParkedPush *parked;
 
-  /* fill 'sources_by_id' table */
-  g_hash_table_insert (self->priv->sources_by_id,
-                       g_strdup (filetea_source_get_id (source)),
-                       g_object_ref (source));
+  /* only seeders have pushes to park */
+  if (self->priv->transfer_parked_pushes == 0 ||
+      filetea_source_registry_peek_peer (self->priv->sources, peer) == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_PERMISSION_DENIED,
+                   "Parking pushes is not allowed");
+      return NULL;
+    }
 
-  /* fill 'sources_by_peer' table */
-  sources_of_peer = g_hash_table_lookup (self->priv->sources_by_peer, peer);
-  if (sources_of_peer == NULL)
+  queue = g_hash_table_lookup (self->priv->parked_pushes_by_peer, peer);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (self->priv->parked_pushes_by_peer, peer, queue);
+    }
+  else if (g_queue_get_length (queue) >= self->priv->transfer_parked_pushes)
     {
-      sources_of_peer =
-        g_hash_table_new_full (g_str_hash,
-                               g_str_equal,
-                               g_free,
-                               g_object_unref);
-      g_hash_table_insert (self->priv->sources_by_peer, peer, sources_of_peer);
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_FAILED,
+                   "Too many parked pushes");
+      return NULL;
     }
-  g_hash_table_insert (sources_of_peer,
-                       g_strdup (filetea_source_get_id (source)),
-                       g_object_ref (source));
 
-  /* @TODO: if source is public, index it */
+  parked = g_slice_new0 (ParkedPush);
+  parked->node = self;
+  parked->token = evd_uuid_new ();
+  parked->peer = g_object_ref (peer);
+  parked->timeout = filetea_timer_wheel_add (self->priv->timer_wheel,
+                                             PARKED_PUSH_TIMEOUT,
+                                             parked_push_on_timeout,
+                                             parked);
 
-  /* @TODO: write corresponding entry in filetea log file */
+  g_queue_push_tail (queue, parked);
+  g_hash_table_insert (self->priv->parked_pushes, parked->token, parked);
 
-  return TRUE;
+  return g_strdup (parked->token);
 }
 
-static void
-remove_source (FileteaNode *self, FileteaSource *source, gboolean graceful)
+/* the headers of a push to a parked token arrived, the connection waits
+   there until a transfer is bound to it */
+static gboolean
+parked_push_connect (FileteaNode       *self,
+                     const gchar       *token,
+                     EvdHttpConnection *conn)
 {
-  /* @TODO: if source was public, un-index it */
+  ParkedPush *parked;
 
-  /* @TODO: if removal is not 'graceful', abort related transfers */
+  parked = g_hash_table_lookup (self->priv->parked_pushes, token);
+  if (parked == NULL || parked->conn != NULL)
+    return FALSE;
 
-  /* @TODO: notify subscribers that source is gone */
+  parked->conn = g_object_ref (conn);
+  g_signal_connect (conn,
+                    "close",
+                    G_CALLBACK (parked_push_on_close),
+                    parked);
 
-  /* @TODO: write corresponding entry in filetea log file */
+  filetea_timer_wheel_cancel (self->priv->timer_wheel, parked->timeout);
+  parked->timeout = filetea_timer_wheel_add (self->priv->timer_wheel,
+                                             PARKED_PUSH_TIMEOUT,
+                                             parked_push_on_timeout,
+                                             parked);
 
-  /* finally, remove source */
-  g_hash_table_remove (self->priv->sources_by_id,
-                       filetea_source_get_id (source));
+  return TRUE;
 }
 
-static gboolean
-unregister_source (FileteaProtocol *protocol,
-                   EvdPeer         *peer,
-                   const gchar     *id,
-                   gboolean         gracefully,
-                   gpointer         user_data)
+/* returns a parked connection of @peer and its token, or %NULL */
+static EvdHttpConnection *
+parked_push_take (FileteaNode  *self,
+                  EvdPeer      *peer,
+                  gchar       **token)
 {
-  FileteaNode *self = FILETEA_NODE (user_data);
-  FileteaSource *source;
-  GHashTable *sources_of_peer;
+  GQueue *queue;
+  GList *node;
+  ParkedPush *parked = NULL;
+  EvdHttpConnection *conn;
 
-  /* find source to unregister */
-  source = g_hash_table_lookup (self->priv->sources_by_id, id);
-  if (source == NULL)
-    return FALSE;
+  queue = g_hash_table_lookup (self->priv->parked_pushes_by_peer, peer);
+  if (queue == NULL)
+    return NULL;
 
-  /* check that the peer unregistering is the owner of the source */
-  if (peer != filetea_source_get_peer (source))
+  for (node = queue->head; node != NULL; node = node->next)
     {
-      /* @TODO: buggy client or possible attack, log acordingly */
-      return FALSE;
+      parked = node->data;
+      if (parked->conn != NULL &&
+          ! g_io_stream_is_closed (G_IO_STREAM (parked->conn)))
+        break;
     }
+  if (node == NULL)
+    return NULL;
 
-  /* remove source from peer's own table */
-  sources_of_peer = g_hash_table_lookup (self->priv->sources_by_peer, peer);
-  g_assert (sources_of_peer != NULL);
-  g_hash_table_remove (sources_of_peer, id);
+  conn = parked->conn;
+  parked->conn = NULL;
+  g_signal_handlers_disconnect_by_func (conn, parked_push_on_close, parked);
 
-  /* remove source from main table */
+  *token = g_strdup (parked->token);
+  parked_push_remove (self, parked);
+
+  return conn;
+}
+
+/* the seeder acknowledges a push request as soon as it knows whether it
+   can serve it, so the download doesn't wait for a push that won't come */
+static void
+transfer_on_push_request_reply (GObject      *obj,
+                                GAsyncResult *res,
+                                gpointer      user_data)
+{
+  FileteaTransfer *transfer = FILETEA_TRANSFER (user_data);
+  FileteaSource *source;
+  gint64 size = -1;
+  GError *error = NULL;
+
+  source = filetea_transfer_get_source (transfer);
+
+  if (! filetea_protocol_request_content_finish (FILETEA_PROTOCOL (obj),
+                                                 res,
+                                                 &size,
+                                                 &error))
+    {
+      g_printerr ("Push request for transfer '%s' failed: %s\n",
+                  filetea_transfer_get_id (transfer),
+                  error->message);
+
+      filetea_transfer_fail (transfer,
+                             g_error_matches (error,
+                                              G_IO_ERROR,
+                                              G_IO_ERROR_NOT_FOUND) ?
+                             SOUP_STATUS_NOT_FOUND :
+                             SOUP_STATUS_SERVICE_UNAVAILABLE,
+                             error);
+      g_error_free (error);
+    }
+  else if (size >= 0 &&
+           size != filetea_source_get_size (source) &&
+           (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_LIVE) == 0)
+    {
+      /* the file changed after it was registered, this download was set
+         up for the old size but the next one will get it right */
+      filetea_source_set_size (source, size);
+
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Size of source changed to %" G_GINT64_FORMAT,
+                           size);
+      filetea_transfer_fail (transfer, SOUP_STATUS_SERVICE_UNAVAILABLE, error);
+      g_error_free (error);
+    }
+
+  g_object_unref (transfer);
+}
+
+static void
+transfer_request_content (FileteaNode     *self,
+                          FileteaSource   *source,
+                          FileteaTransfer *transfer,
+                          const gchar     *transfer_id,
+                          gboolean         is_chunked,
+                          SoupRange       *byte_ranges,
+                          guint            n_ranges)
+{
+  EvdPeer *peer;
+  EvdHttpConnection *conn;
+  gchar *push_token = NULL;
+
+  /* a parked connection saves the seeder connecting for this push */
+  peer = filetea_source_get_peer (source);
+  conn = parked_push_take (self, peer, &push_token);
+
+  filetea_protocol_request_content (self->priv->protocol,
+                                    peer,
+                                    filetea_source_get_id (source),
+                                    transfer_id,
+                                    push_token,
+                                    0,
+                                    is_chunked,
+                                    byte_ranges,
+                                    n_ranges,
+                                    NULL,
+                                    transfer_on_push_request_reply,
+                                    g_object_ref (transfer));
+
+  if (conn != NULL)
+    {
+      /* same as if the push had just arrived at 'transfer_id' */
+      if (g_strcmp0 (transfer_id, filetea_transfer_get_id (transfer)) == 0)
+        content_push (self->priv->protocol, transfer, conn, self);
+      else if (! content_push_segment (self, transfer_id, conn))
+        g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+
+      g_object_unref (conn);
+      g_free (push_token);
+    }
+}
+
+/* asks the seeder of @source to push the content @transfer is missing */
+static gboolean
+transfer_request_resume (FileteaNode     *self,
+                         FileteaSource   *source,
+                         FileteaTransfer *transfer)
+{
+  SoupRange *ranges;
+  guint n_ranges;
+
+  if (filetea_source_get_peer (source) == NULL)
+    return FALSE;
+
+  ranges = filetea_transfer_get_remaining_ranges (transfer, &n_ranges);
+
+  transfer_request_content (self,
+                            source,
+                            transfer,
+                            filetea_transfer_get_id (transfer),
+                            TRUE,
+                            ranges,
+                            n_ranges);
+
+  g_free (ranges);
+
+  return TRUE;
+}
+
+static void
+transfer_stop_resuming (FileteaNode *self, FileteaTransfer *transfer)
+{
+  const gchar *source_id;
+  GQueue *queue;
+
+  source_id = filetea_source_get_id (filetea_transfer_get_source (transfer));
+
+  queue = g_hash_table_lookup (self->priv->resuming_transfers_by_source,
+                               source_id);
+  if (queue == NULL)
+    return;
+
+  g_queue_remove (queue, transfer);
+  if (g_queue_is_empty (queue))
+    g_hash_table_remove (self->priv->resuming_transfers_by_source, source_id);
+}
+
+static gboolean
+transfer_on_source_dropped (FileteaTransfer *transfer,
+                            gsize            offset,
+                            gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  FileteaSource *source;
+  const gchar *source_id;
+  GQueue *queue;
+
+  source = filetea_transfer_get_source (transfer);
+  source_id = filetea_source_get_id (source);
+
+  /* the transfer waits until a push arrives or the seeder claims the
+     source again */
+  queue = g_hash_table_lookup (self->priv->resuming_transfers_by_source,
+                               source_id);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (self->priv->resuming_transfers_by_source,
+                           g_strdup (source_id),
+                           queue);
+    }
+  g_queue_push_tail (queue, transfer);
+
+  /* the seeder could still be around, with just the data connection gone */
+  source = filetea_source_registry_lookup (self->priv->sources, source_id);
+  if (source != NULL && ! transfer_request_resume (self, source, transfer))
+    {
+      transfer_stop_resuming (self, transfer);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+resume_transfers_of_source (FileteaNode *self, FileteaSource *source)
+{
+  GQueue *queue;
+  GList *transfers;
+  GList *node;
+
+  queue = g_hash_table_lookup (self->priv->resuming_transfers_by_source,
+                               filetea_source_get_id (source));
+  if (queue == NULL)
+    return;
+
+  /* cancelling a transfer removes it from the queue */
+  transfers = g_list_copy (queue->head);
+  g_list_foreach (transfers, (GFunc) g_object_ref, NULL);
+
+  for (node = transfers; node != NULL; node = node->next)
+    {
+      FileteaTransfer *transfer = FILETEA_TRANSFER (node->data);
+
+      if (! transfer_request_resume (self, source, transfer))
+        filetea_transfer_cancel (transfer);
+    }
+
+  g_list_free_full (transfers, g_object_unref);
+}
+
+static void
+register_source (FileteaNode *self, EvdPeer *peer, FileteaSource *source)
+{
+  FileteaSource *current_source;
+
+  /* a source claimed back may still be registered */
+  current_source =
+    filetea_source_registry_lookup (self->priv->sources,
+                                    filetea_source_get_id (source));
+  if (current_source != NULL)
+    {
+      /* already registered, just update the fields */
+      filetea_source_registry_set_peer (self->priv->sources,
+                                        current_source,
+                                        peer);
+
+      /* @TODO: update the rest of the fields */
+
+      resume_transfers_of_source (self, current_source);
+
+      return;
+    }
+
+  /* index source by id and by peer */
+  filetea_source_registry_add (self->priv->sources, source);
+
+  /* transfers interrupted by a previous disconnection of the seeder */
+  resume_transfers_of_source (self, source);
+
+  if (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_PUBLIC)
+    filetea_search_index_add (self->priv->search_index, source);
+
+  /* @TODO: write corresponding entry in filetea log file */
+}
+
+static void
+sign_batch_free (SignBatch *batch)
+{
+  g_object_unref (batch->node);
+  g_object_unref (batch->peer);
+  g_object_unref (batch->result);
+  g_ptr_array_unref (batch->sources);
+  g_ptr_array_unref (batch->data);
+  g_ptr_array_unref (batch->signatures);
+
+  g_slice_free (SignBatch, batch);
+}
+
+static gboolean
+sign_batch_on_done (gpointer user_data)
+{
+  SignBatch *batch = user_data;
+  FileteaNode *self = batch->node;
+  guint i;
+
+  for (i=0; i<batch->sources->len; i++)
+    {
+      FileteaSource *source;
+      const gchar *signature;
+      GError *error = NULL;
+
+      source = g_ptr_array_index (batch->sources, i);
+      signature = g_ptr_array_index (batch->signatures, i);
+
+      if (filetea_source_get_signature (source) == NULL)
+        {
+          /* a fresh id, which another batch may have taken meanwhile */
+          if (filetea_source_registry_lookup (self->priv->sources,
+                                       filetea_source_get_id (source)) != NULL)
+            error = g_error_new (G_IO_ERROR,
+                                 G_IO_ERROR_EXISTS,
+                                 "Source id already registered");
+          else
+            filetea_source_set_signature (source, signature);
+        }
+      else if (g_strcmp0 (filetea_source_get_signature (source),
+                          signature) != 0)
+        {
+          error = g_error_new (G_IO_ERROR,
+                               G_IO_ERROR_INVALID_ARGUMENT,
+                               "Invalid source signature");
+        }
+
+      /* the seeder is gone while its sources were being signed */
+      if (error == NULL && evd_peer_is_closed (batch->peer))
+        error = g_error_new (G_IO_ERROR,
+                             G_IO_ERROR_CLOSED,
+                             "Peer is closed");
+
+      if (error == NULL)
+        register_source (self, batch->peer, source);
+      else
+        filetea_source_take_error (source, error);
+    }
+
+  filetea_protocol_respond_register (self->priv->protocol, batch->result);
+
+  sign_batch_free (batch);
+
+  return FALSE;
+}
+
+/* runs in a thread of the signing pool, touching only the batch's data */
+static void
+sign_batch_run (gpointer data, gpointer user_data)
+{
+  SignBatch *batch = data;
+  FileteaNode *self = batch->node;
+  guint i;
+
+  for (i=0; i<batch->data->len; i++)
+    {
+      GHmac *hmac;
+
+      hmac = g_hmac_copy (self->priv->hmac);
+      g_hmac_update (hmac,
+                     (const guchar *) g_ptr_array_index (batch->data, i),
+                     -1);
+      g_ptr_array_add (batch->signatures, g_strdup (g_hmac_get_string (hmac)));
+      g_hmac_unref (hmac);
+    }
+
+  g_main_context_invoke (self->priv->main_context, sign_batch_on_done, batch);
+}
+
+static void
+register_sources (FileteaProtocol *protocol,
+                  EvdPeer         *peer,
+                  GList           *sources,
+                  GAsyncResult    *result,
+                  gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  SignBatch *batch;
+  GList *node;
+
+  batch = g_slice_new (SignBatch);
+  batch->node = g_object_ref (self);
+  batch->peer = g_object_ref (peer);
+  batch->result = g_object_ref (result);
+  batch->sources = g_ptr_array_new_with_free_func (g_object_unref);
+  batch->data = g_ptr_array_new_with_free_func (g_free);
+  batch->signatures = g_ptr_array_new_with_free_func (g_free);
+
+  for (node = sources; node != NULL; node = node->next)
+    {
+      FileteaSource *source = FILETEA_SOURCE (node->data);
+
+      /* sources not claiming a previous id get a fresh one, the signature
+         comes with it once the batch is signed */
+      if (filetea_source_get_id (source) == NULL)
+        {
+          gchar *source_id;
+
+          source_id = generate_source_id (self, self->priv->id);
+          filetea_source_set_id (source, source_id);
+          g_free (source_id);
+        }
+
+      g_ptr_array_add (batch->sources, g_object_ref (source));
+      g_ptr_array_add (batch->data, source_get_signed_data (source));
+    }
+
+  /* the whole batch is signed and verified in one go */
+  g_thread_pool_push (self->priv->signing_pool, batch, NULL);
+}
+
+static void
+remove_source (FileteaNode *self, FileteaSource *source, gboolean graceful)
+{
+  if (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_PUBLIC)
+    filetea_search_index_remove (self->priv->search_index, source);
+
+  /* @TODO: if removal is not 'graceful', abort related transfers */
+
+  /* @TODO: notify subscribers that source is gone */
+
+  /* @TODO: write corresponding entry in filetea log file */
+
+  g_hash_table_remove (self->priv->fanouts_by_source,
+                       filetea_source_get_id (source));
+
+  if (self->priv->cache != NULL)
+    filetea_cache_invalidate (self->priv->cache, source);
+
+  /* finally, remove source */
+  filetea_source_registry_remove (self->priv->sources, source);
+}
+
+static gboolean
+unregister_source (FileteaProtocol *protocol,
+                   EvdPeer         *peer,
+                   const gchar     *id,
+                   gboolean         gracefully,
+                   gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  FileteaSource *source;
+
+  /* find source to unregister */
+  source = filetea_source_registry_lookup (self->priv->sources, id);
+  if (source == NULL)
+    return FALSE;
+
+  /* check that the peer unregistering is the owner of the source */
+  if (peer != filetea_source_get_peer (source))
+    {
+      /* @TODO: buggy client or possible attack, log acordingly */
+      return FALSE;
+    }
+
+  /* remove source from registry */
   remove_source (self, source, gracefully);
 
   return TRUE;
 }
 
+static void
+pull_history_free (gpointer data)
+{
+  g_slice_free (PullHistory, data);
+}
+
+/* how many pushes a download from @peer is split in, trying one more than
+   what did best so far while that keeps paying off */
+static guint
+pull_history_get_segments (FileteaNode *self, EvdPeer *peer)
+{
+  PullHistory *history;
+
+  history = g_object_get_data (G_OBJECT (peer), PULL_HISTORY_KEY);
+  if (history == NULL)
+    return 1;
+
+  if (history->probing)
+    return MIN (history->segments + 1, self->priv->transfer_max_segments);
+
+  return history->segments;
+}
+
+static void
+pull_history_update (EvdPeer *peer, guint segments, gdouble bandwidth)
+{
+  PullHistory *history;
+
+  history = g_object_get_data (G_OBJECT (peer), PULL_HISTORY_KEY);
+  if (history == NULL)
+    {
+      history = g_slice_new (PullHistory);
+      history->segments = segments;
+      history->bandwidth = bandwidth;
+      history->probing = TRUE;
+
+      g_object_set_data_full (G_OBJECT (peer),
+                              PULL_HISTORY_KEY,
+                              history,
+                              pull_history_free);
+      return;
+    }
+
+  if (segments > history->segments)
+    {
+      /* keep the extra segment only if it paid off */
+      if (bandwidth > history->bandwidth * (1.0 + PULL_SEGMENTS_GAIN))
+        {
+          history->segments = segments;
+          history->bandwidth = bandwidth;
+        }
+      else
+        {
+          history->probing = FALSE;
+        }
+    }
+  else if (segments == history->segments)
+    {
+      /* conditions changed, look for the best number again */
+      if (bandwidth < history->bandwidth * (1.0 - PULL_SEGMENTS_GAIN) &&
+          history->segments > 1)
+        {
+          history->segments--;
+          history->probing = TRUE;
+        }
+      else if (bandwidth > history->bandwidth * (1.0 + PULL_SEGMENTS_GAIN))
+        {
+          history->probing = TRUE;
+        }
+
+      history->bandwidth = (history->bandwidth + bandwidth) / 2.0;
+    }
+}
+
+static void
+transfer_update_pull_history (FileteaNode *self, FileteaTransfer *transfer)
+{
+  FileteaSource *source;
+  EvdPeer *peer;
+  guint segments;
+  gdouble bandwidth;
+
+  /* only transfers that could have been split tell something */
+  if (g_object_get_data (G_OBJECT (transfer), PULL_MEASURED_KEY) == NULL)
+    return;
+
+  source = filetea_transfer_get_source (transfer);
+  peer = filetea_source_get_peer (source);
+  if (peer == NULL)
+    return;
+
+  filetea_transfer_get_pull_stats (transfer, &segments, &bandwidth);
+  if (bandwidth > 0.0)
+    pull_history_update (peer, segments, bandwidth);
+}
+
+static void
+aborted_push_free (gpointer data)
+{
+  AbortedPush *push = data;
+
+  if (push->timeout != NULL)
+    {
+      filetea_timer_wheel_cancel (push->node->priv->timer_wheel,
+                                  push->timeout);
+      push->timeout = NULL;
+    }
+
+  if (push->conn != NULL &&
+      ! g_io_stream_is_closed (G_IO_STREAM (push->conn)))
+    {
+      g_io_stream_close (G_IO_STREAM (push->conn), NULL, NULL);
+    }
+
+  /* a skip in flight frees the push when it returns */
+  if (push->skipping)
+    {
+      push->removed = TRUE;
+      g_cancellable_cancel (push->cancellable);
+      return;
+    }
+
+  if (push->conn != NULL)
+    g_object_unref (push->conn);
+  g_object_unref (push->peer);
+  g_object_unref (push->cancellable);
+  g_free (push->transfer_id);
+
+  g_slice_free (AbortedPush, push);
+}
+
+static gboolean
+aborted_push_on_timeout (gpointer user_data)
+{
+  AbortedPush *push = user_data;
+
+  push->timeout = NULL;
+  g_hash_table_remove (push->node->priv->aborted_pushes, push->transfer_id);
+
+  return FALSE;
+}
+
+static void
+aborted_push_on_skipped (GObject      *obj,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+  AbortedPush *push = user_data;
+  gssize size;
+
+  push->skipping = FALSE;
+
+  size = g_input_stream_skip_finish (G_INPUT_STREAM (obj), res, NULL);
+
+  if (push->removed)
+    {
+      aborted_push_free (push);
+      return;
+    }
+
+  if (size <= 0)
+    {
+      g_hash_table_remove (push->node->priv->aborted_pushes,
+                           push->transfer_id);
+      return;
+    }
+
+  push->consumed += size;
+  aborted_push_skip (push);
+}
+
+/* skips what is left of the push body, then answers it so that the seeder
+   can send the next push over the same connection */
+static void
+aborted_push_skip (AbortedPush *push)
+{
+  FileteaNode *self = push->node;
+  GInputStream *stream;
+  GError *error = NULL;
+
+  if (push->consumed > push->pushed)
+    {
+      g_hash_table_remove (self->priv->aborted_pushes, push->transfer_id);
+      return;
+    }
+
+  if (push->consumed < push->pushed)
+    {
+      stream = g_io_stream_get_input_stream (G_IO_STREAM (push->conn));
+
+      push->skipping = TRUE;
+      g_input_stream_skip_async (stream,
+                                 push->pushed - push->consumed,
+                                 G_PRIORITY_DEFAULT,
+                                 push->cancellable,
+                                 aborted_push_on_skipped,
+                                 push);
+      return;
+    }
+
+  if (! evd_web_service_respond (connection_get_web_service (self, push->conn),
+                                 push->conn,
+                                 SOUP_STATUS_OK,
+                                 NULL,
+                                 NULL,
+                                 0,
+                                 &error))
+    {
+      g_printerr ("Error sending response to aborted push: %s\n",
+                  error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      g_object_unref (push->conn);
+      push->conn = NULL;
+    }
+
+  g_hash_table_remove (self->priv->aborted_pushes, push->transfer_id);
+}
+
+static void
+transfer_on_target_gone (FileteaTransfer   *transfer,
+                         EvdHttpConnection *source_conn,
+                         gsize              consumed,
+                         gpointer           user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  FileteaSource *source;
+  EvdPeer *peer;
+  AbortedPush *push;
+
+  source = filetea_transfer_get_source (transfer);
+  peer = filetea_source_get_peer (source);
+
+  /* without a seeder to ask, the connection can't be reused */
+  if (peer == NULL || evd_peer_is_closed (peer))
+    {
+      g_io_stream_close (G_IO_STREAM (source_conn), NULL, NULL);
+      return;
+    }
+
+  push = g_slice_new0 (AbortedPush);
+  push->node = self;
+  push->transfer_id = g_strdup (filetea_transfer_get_id (transfer));
+  push->peer = g_object_ref (peer);
+  push->conn = g_object_ref (source_conn);
+  push->consumed = consumed;
+  push->pushed = G_MAXSIZE;
+  push->cancellable = g_cancellable_new ();
+  push->timeout = filetea_timer_wheel_add (self->priv->timer_wheel,
+                                           ABORTED_PUSH_TIMEOUT,
+                                           aborted_push_on_timeout,
+                                           push);
+
+  g_hash_table_replace (self->priv->aborted_pushes, push->transfer_id, push);
+}
+
+static void
+push_aborted (FileteaProtocol *protocol,
+              EvdPeer         *peer,
+              const gchar     *transfer_id,
+              gsize            pushed,
+              gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  AbortedPush *push;
+
+  push = g_hash_table_lookup (self->priv->aborted_pushes, transfer_id);
+  if (push == NULL || push->peer != peer || push->skipping)
+    return;
+
+  push->pushed = pushed;
+  aborted_push_skip (push);
+}
+
+/* tells the seeder to stop pushing content nobody downloads anymore */
+static void
+transfer_abort_push (FileteaNode *self, FileteaTransfer *transfer)
+{
+  FileteaSource *source;
+  EvdPeer *peer;
+  GError *error = NULL;
+
+  source = filetea_transfer_get_source (transfer);
+  peer = filetea_source_get_peer (source);
+  if (peer == NULL || evd_peer_is_closed (peer))
+    return;
+
+  if (! filetea_protocol_abort_push (self->priv->protocol,
+                                     peer,
+                                     filetea_transfer_get_id (transfer),
+                                     &error))
+    {
+      g_printerr ("Failed to abort push: %s\n", error->message);
+      g_error_free (error);
+    }
+}
+
+/* readers of a fanout @transfer was feeding fall back to pushes of their
+   own */
+static void
+transfer_leave_fanout (FileteaNode *self, FileteaTransfer *transfer)
+{
+  FileteaFanout *fanout;
+  GPtrArray *fanouts;
+  const gchar *source_id;
+
+  fanout = g_hash_table_lookup (self->priv->fanouts_by_transfer,
+                                filetea_transfer_get_id (transfer));
+  if (fanout == NULL)
+    return;
+
+  filetea_fanout_remove (fanout, transfer);
+
+  source_id = filetea_source_get_id (filetea_transfer_get_source (transfer));
+  fanouts = g_hash_table_lookup (self->priv->fanouts_by_source, source_id);
+  if (fanouts != NULL && filetea_fanout_is_idle (fanout))
+    {
+      g_ptr_array_remove (fanouts, fanout);
+      if (fanouts->len == 0)
+        g_hash_table_remove (self->priv->fanouts_by_source, source_id);
+    }
+
+  g_hash_table_remove (self->priv->fanouts_by_transfer,
+                       filetea_transfer_get_id (transfer));
+}
+
 static void
 transfer_on_completed (GObject      *obj,
                        GAsyncResult *result,
@@ -524,20 +1853,375 @@ transfer_on_completed (GObject      *obj,
   FileteaTransfer *transfer = FILETEA_TRANSFER (obj);
   FileteaNode *self = FILETEA_NODE (user_data);
   GError *error = NULL;
+  guint status;
+
+  if (! filetea_transfer_finish (transfer, result, &error))
+    {
+      g_printerr ("Transfer failed: %s\n", error->message);
+      g_error_free (error);
+
+      filetea_transfer_get_status (transfer, &status, NULL, NULL);
+      if (status == FILETEA_TRANSFER_STATUS_TARGET_ABORTED ||
+          status == FILETEA_TRANSFER_STATUS_STALLED)
+        {
+          transfer_abort_push (self, transfer);
+        }
+    }
+  else
+    {
+      /* @TODO: log transfer completed */
+
+      transfer_update_pull_history (self, transfer);
+    }
+
+  transfer_stop_resuming (self, transfer);
+
+  g_hash_table_remove (self->priv->push_channels,
+                       filetea_transfer_get_id (transfer));
+
+  transfer_leave_fanout (self, transfer);
+
+  /* remove transfer */
+  g_hash_table_remove (self->priv->transfers_by_id,
+                       filetea_transfer_get_id (transfer));
+}
+
+static void
+fanout_on_fallback (FileteaFanout   *fanout,
+                    FileteaTransfer *transfer,
+                    gsize            offset,
+                    gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  FileteaSource *source;
+
+  g_hash_table_remove (self->priv->fanouts_by_transfer,
+                       filetea_transfer_get_id (transfer));
+
+  /* ask the seeder for the rest of the content */
+  source = filetea_transfer_get_source (transfer);
+  if (! transfer_request_resume (self, source, transfer))
+    filetea_transfer_cancel (transfer);
+}
+
+/* returns TRUE if @transfer was attached to an ongoing upstream push of the
+   source covering @offset, otherwise @transfer will lead a new one */
+static gboolean
+content_request_join_fanout (FileteaNode     *self,
+                             FileteaSource   *source,
+                             FileteaTransfer *transfer,
+                             gsize            offset,
+                             gsize            length)
+{
+  FileteaFanout *fanout;
+  GPtrArray *fanouts;
+  guint i;
+
+  if (self->priv->fanout_buffer_size == 0)
+    return FALSE;
+
+  /* readers that fall behind need a ranged push to continue */
+  if ((filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_CHUNKABLE) == 0)
+    return FALSE;
+
+  fanouts = g_hash_table_lookup (self->priv->fanouts_by_source,
+                                 filetea_source_get_id (source));
+  if (fanouts == NULL)
+    {
+      fanouts = g_ptr_array_new_with_free_func (g_object_unref);
+      g_hash_table_insert (self->priv->fanouts_by_source,
+                           g_strdup (filetea_source_get_id (source)),
+                           fanouts);
+    }
+
+  /* overlapping requests are served from a push already in flight */
+  for (i = 0; i < fanouts->len; i++)
+    {
+      fanout = g_ptr_array_index (fanouts, i);
+
+      if (filetea_fanout_attach (fanout, transfer, offset, length))
+        {
+          g_hash_table_insert (self->priv->fanouts_by_transfer,
+                               g_strdup (filetea_transfer_get_id (transfer)),
+                               g_object_ref (fanout));
+          return TRUE;
+        }
+    }
+
+  fanout = filetea_fanout_new (transfer,
+                               offset,
+                               length,
+                               self->priv->fanout_buffer_size,
+                               fanout_on_fallback,
+                               self);
+
+  g_ptr_array_add (fanouts, fanout);
+  g_hash_table_insert (self->priv->fanouts_by_transfer,
+                       g_strdup (filetea_transfer_get_id (transfer)),
+                       g_object_ref (fanout));
+
+  return FALSE;
+}
+
+static void
+push_channel_free (gpointer data)
+{
+  PushChannel *channel = data;
+
+  g_object_unref (channel->transfer);
+  g_object_unref (channel->peer);
+  g_byte_array_unref (channel->buf);
+
+  g_slice_free (PushChannel, channel);
+}
+
+/* writes what the target can take, and lets the seeder push as much more
+   once half of its credit is consumed */
+static void
+push_channel_feed (PushChannel *channel)
+{
+  FileteaNode *self = channel->node;
+  gssize size;
+  GError *error = NULL;
+
+  while (channel->buf->len > 0)
+    {
+      size = filetea_transfer_feed (channel->transfer,
+                                    (const gchar *) channel->buf->data,
+                                    channel->buf->len);
+      if (size <= 0)
+        break;
+
+      g_byte_array_remove_range (channel->buf, 0, size);
+      channel->consumed += size;
+    }
+
+  if (channel->left == 0 ||
+      channel->consumed < self->priv->transfer_channel_credit / 2)
+    {
+      return;
+    }
+
+  if (! filetea_protocol_grant_push_credit (self->priv->protocol,
+                                  channel->peer,
+                                  filetea_transfer_get_id (channel->transfer),
+                                  channel->consumed,
+                                  &error))
+    {
+      g_printerr ("Error granting push credit: %s\n", error->message);
+      g_error_free (error);
+    }
+
+  channel->consumed = 0;
+}
+
+static void
+push_channel_on_pull (FileteaTransfer *transfer, gpointer user_data)
+{
+  push_channel_feed (user_data);
+}
+
+static void
+push_data (FileteaProtocol *protocol,
+           EvdPeer         *peer,
+           const gchar     *transfer_id,
+           const gchar     *buf,
+           gsize            size,
+           gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  PushChannel *channel;
+  guint status;
+  GError *error;
+
+  /* content of a transfer that is over is dropped */
+  channel = g_hash_table_lookup (self->priv->push_channels, transfer_id);
+  if (channel == NULL || channel->peer != peer)
+    return;
+
+  filetea_transfer_get_status (channel->transfer, &status, NULL, NULL);
+  if (status != FILETEA_TRANSFER_STATUS_NOT_STARTED &&
+      status != FILETEA_TRANSFER_STATUS_ACTIVE &&
+      status != FILETEA_TRANSFER_STATUS_PAUSED)
+    {
+      return;
+    }
+
+  if (buf == NULL)
+    {
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_CONNECTION_CLOSED,
+                           "Seeder stopped pushing");
+    }
+  else if (size > channel->left ||
+           channel->buf->len + size > self->priv->transfer_channel_credit)
+    {
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_INVALID_DATA,
+                           "Seeder pushed more than it was allowed to");
+    }
+  else
+    {
+      /* headers wait for the first content, so the download can still
+         fail with a proper status */
+      if (! channel->started)
+        {
+          channel->started = TRUE;
+          filetea_transfer_start_fed (channel->transfer,
+                                      push_channel_on_pull,
+                                      channel);
+        }
+
+      g_byte_array_append (channel->buf, (const guint8 *) buf, size);
+      channel->left -= size;
+
+      push_channel_feed (channel);
+      return;
+    }
+
+  filetea_transfer_fail (channel->transfer,
+                         SOUP_STATUS_SERVICE_UNAVAILABLE,
+                         error);
+  g_error_free (error);
+}
+
+/* asks the seeder to push small content over its transport, saving the
+   connection of a regular push. Returns TRUE if the seeder was asked */
+static gboolean
+content_request_channel (FileteaNode     *self,
+                         FileteaSource   *source,
+                         FileteaTransfer *transfer,
+                         gboolean         is_chunked,
+                         SoupRange       *byte_ranges,
+                         guint            n_ranges)
+{
+  EvdPeer *peer;
+  guint flags;
+  goffset size;
+  gsize length;
+  PushChannel *channel;
+
+  flags = filetea_source_get_flags (source);
+  peer = filetea_source_get_peer (source);
+
+  /* fed transfers write a single part */
+  if (self->priv->transfer_channel_max_size == 0 ||
+      peer == NULL ||
+      (flags & FILETEA_SOURCE_FLAGS_CHANNEL) == 0 ||
+      (flags & (FILETEA_SOURCE_FLAGS_LIVE | FILETEA_SOURCE_FLAGS_REAL_TIME)) != 0 ||
+      (is_chunked && n_ranges != 1))
+    {
+      return FALSE;
+    }
+
+  size = filetea_source_get_size (source);
+  length = size;
+  if (is_chunked)
+    {
+      goffset end;
+
+      end = byte_ranges[0].end;
+      if (end < 0 || end >= size)
+        end = size - 1;
+
+      length = end - byte_ranges[0].start + 1;
+    }
+
+  if (length == 0 || length > self->priv->transfer_channel_max_size)
+    return FALSE;
+
+  channel = g_slice_new0 (PushChannel);
+  channel->node = self;
+  channel->transfer = g_object_ref (transfer);
+  channel->peer = g_object_ref (peer);
+  channel->buf = g_byte_array_new ();
+  channel->left = length;
+
+  g_hash_table_insert (self->priv->push_channels,
+                       (gpointer) filetea_transfer_get_id (transfer),
+                       channel);
+
+  filetea_protocol_request_content (self->priv->protocol,
+                                    peer,
+                                    filetea_source_get_id (source),
+                                    filetea_transfer_get_id (transfer),
+                                    NULL,
+                                    self->priv->transfer_channel_credit,
+                                    is_chunked,
+                                    byte_ranges,
+                                    n_ranges,
+                                    NULL,
+                                    transfer_on_push_request_reply,
+                                    g_object_ref (transfer));
 
-  if (! filetea_transfer_finish (transfer, result, &error))
+  return TRUE;
+}
+
+/* pushes large downloads over several connections from the seeder.
+   Returns TRUE if the seeder was already asked for the content */
+static gboolean
+content_request_split (FileteaNode     *self,
+                       FileteaSource   *source,
+                       FileteaTransfer *transfer)
+{
+  EvdPeer *peer;
+  guint flags;
+  guint n_segments;
+  guint i;
+
+  flags = filetea_source_get_flags (source);
+  peer = filetea_source_get_peer (source);
+
+  if (self->priv->transfer_max_segments < 2 ||
+      peer == NULL ||
+      (flags & FILETEA_SOURCE_FLAGS_CHUNKABLE) == 0 ||
+      (flags & (FILETEA_SOURCE_FLAGS_LIVE | FILETEA_SOURCE_FLAGS_REAL_TIME)) != 0 ||
+      (gsize) filetea_source_get_size (source) <
+      2 * self->priv->transfer_segment_min_size)
     {
-      g_printerr ("Transfer failed: %s\n", error->message);
-      g_error_free (error);
+      return FALSE;
     }
-  else
+
+  /* its bandwidth tells how many segments to try next time */
+  g_object_set_data (G_OBJECT (transfer),
+                     PULL_MEASURED_KEY,
+                     GINT_TO_POINTER (TRUE));
+
+  n_segments = pull_history_get_segments (self, peer);
+  n_segments = MIN (n_segments,
+                    filetea_source_get_size (source) /
+                    self->priv->transfer_segment_min_size);
+
+  if (! filetea_transfer_split (transfer, n_segments))
+    return FALSE;
+
+  for (i = 0; i < n_segments; i++)
     {
-      /* @TODO: log transfer completed */
+      SoupRange range;
+      gchar *transfer_id;
+
+      filetea_transfer_get_segment_range (transfer, i, &range);
+
+      /* the first segment is pushed to the transfer itself, the others
+         to '<transfer-id>.<segment>' */
+      if (i == 0)
+        transfer_id = g_strdup (filetea_transfer_get_id (transfer));
+      else
+        transfer_id = g_strdup_printf ("%s.%u",
+                                       filetea_transfer_get_id (transfer),
+                                       i);
+
+      transfer_request_content (self,
+                                source,
+                                transfer,
+                                transfer_id,
+                                TRUE,
+                                &range,
+                                1);
+      g_free (transfer_id);
     }
 
-  /* remove transfer */
-  g_hash_table_remove (self->priv->transfers_by_id,
-                       filetea_transfer_get_id (transfer));
+  return TRUE;
 }
 
 static void
@@ -547,21 +2231,26 @@ content_request (FileteaProtocol    *protocol,
                  const gchar        *action,
                  const gchar        *peer_id,
                  gboolean            is_chunked,
-                 SoupRange          *byte_range,
+                 SoupRange          *byte_ranges,
+                 guint               n_ranges,
                  gpointer            user_data)
 {
   FileteaNode *self = FILETEA_NODE (user_data);
   FileteaTransfer *transfer;
-  GError *error = NULL;
+  gint cached_fd = -1;
 
-  if (is_chunked)
+  if (self->priv->cache != NULL)
+    cached_fd = filetea_cache_open (self->priv->cache, source);
+
+  /* cached content can always be served in ranges */
+  if (is_chunked && cached_fd == -1)
     {
       guint flags;
 
       flags = filetea_source_get_flags (source);
       if ((flags & FILETEA_SOURCE_FLAGS_CHUNKABLE) == 0)
         {
-          evd_web_service_respond (EVD_WEB_SERVICE (self->priv->web_service),
+          evd_web_service_respond (connection_get_web_service (self, conn),
                                    conn,
                                    SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE,
                                    NULL,
@@ -572,17 +2261,67 @@ content_request (FileteaProtocol    *protocol,
         }
     }
 
+  /* refuse new transfers while relay memory is exhausted */
+  if (cached_fd == -1 &&
+      ! filetea_buffer_pool_has_room (self->priv->buffer_pool,
+                                      self->priv->transfer_min_block_size))
+    {
+      SoupMessageHeaders *headers;
+      gchar *retry_after;
+
+      headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+      retry_after = g_strdup_printf ("%d", BUFFER_POOL_RETRY_AFTER);
+      soup_message_headers_replace (headers, "Retry-After", retry_after);
+      g_free (retry_after);
+
+      evd_web_service_respond (connection_get_web_service (self, conn),
+                               conn,
+                               SOUP_STATUS_SERVICE_UNAVAILABLE,
+                               headers,
+                               NULL,
+                               0,
+                               NULL);
+      soup_message_headers_free (headers);
+      return;
+    }
+
   /* create new transfer */
   transfer = filetea_transfer_new (source,
-                                   EVD_WEB_SERVICE (self->priv->web_service),
+                                   connection_get_web_service (self, conn),
+                                   self->priv->timer_wheel,
                                    conn,
                                    action,
                                    is_chunked,
-                                   byte_range,
+                                   byte_ranges,
+                                   n_ranges,
                                    filetea_source_get_cancellable (source),
                                    transfer_on_completed,
                                    self);
 
+  filetea_transfer_set_buffer_pool (transfer, self->priv->buffer_pool);
+  filetea_transfer_set_zero_copy (transfer, self->priv->transfer_zero_copy);
+  filetea_transfer_set_ring_depth (transfer, self->priv->transfer_ring_depth);
+  filetea_transfer_set_block_size_limits (transfer,
+                                          self->priv->transfer_min_block_size,
+                                          self->priv->transfer_max_block_size);
+  filetea_transfer_set_max_bandwidth (transfer,
+                                      self->priv->transfer_max_bw_in,
+                                      self->priv->transfer_max_bw_out);
+  filetea_transfer_set_stall_limits (transfer,
+                                     self->priv->transfer_idle_timeout * 1000,
+                                     self->priv->transfer_min_bw);
+  filetea_transfer_set_abort_func (transfer, transfer_on_target_gone, self);
+
+  /* resuming asks the seeder for the remaining ranges */
+  if (self->priv->transfer_resume_timeout > 0 &&
+      (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_CHUNKABLE) != 0)
+    {
+      filetea_transfer_set_resume_func (transfer,
+                                  transfer_on_source_dropped,
+                                  self->priv->transfer_resume_timeout * 1000,
+                                  self);
+    }
+
   /* fill 'transfers-by-id' table */
   g_hash_table_insert (self->priv->transfers_by_id,
                        g_strdup (filetea_transfer_get_id (transfer)),
@@ -591,35 +2330,76 @@ content_request (FileteaProtocol    *protocol,
   /* associate target peer with transfer */
   if (peer_id != NULL)
     {
-      EvdTransport *transport;
-      EvdPeer *peer = NULL;
-
-      transport = filetea_web_service_get_transport (self->priv->web_service);
-      peer = evd_transport_lookup_peer (transport, peer_id);
+      EvdPeer *peer;
 
+      /* the peer may be connected through any of the listeners */
+      peer = lookup_peer (self, peer_id);
       if (peer != NULL)
         filetea_transfer_set_target_peer (transfer, peer);
     }
 
-  /* notify source peer */
-  filetea_protocol_request_content (self->priv->protocol,
-                                    filetea_source_get_peer (source),
-                                    filetea_source_get_id (source),
-                                    filetea_transfer_get_id (transfer),
-                                    is_chunked,
-                                    byte_range,
-                                    &error);
-
-  if (error != NULL)
+  /* serve from disk if the content is cached */
+  if (cached_fd != -1)
     {
-      g_printerr ("Failed to notify source peer of new transfer: %s\n", error->message);
-      g_error_free (error);
+      filetea_transfer_start_from_file (transfer, cached_fd);
+      return;
+    }
 
-      /* @TODO: abort transfer */
+  /* small content comes over the seeder's transport. Fed transfers have
+     nothing to share or cache */
+  if (content_request_channel (self,
+                               source,
+                               transfer,
+                               is_chunked,
+                               byte_ranges,
+                               n_ranges))
+    {
       return;
     }
 
-  /* @TODO: set transfer bandwidth limits */
+  /* downloads of a whole source, or of one range of it, can share the
+     seeder's upload with others overlapping it */
+  if (! is_chunked || n_ranges == 1)
+    {
+      goffset size;
+      gsize offset = 0;
+      gsize length;
+
+      size = filetea_source_get_size (source);
+      length = size;
+      if (is_chunked)
+        {
+          goffset end;
+
+          end = byte_ranges[0].end;
+          if (end < 0 || end >= size)
+            end = size - 1;
+
+          offset = byte_ranges[0].start;
+          length = end - byte_ranges[0].start + 1;
+        }
+
+      if (content_request_join_fanout (self, source, transfer, offset, length))
+        return;
+    }
+
+  /* live content has no known size to be cached with */
+  if (! is_chunked &&
+      self->priv->cache != NULL &&
+      (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_LIVE) == 0)
+    filetea_cache_fill (self->priv->cache, source, transfer);
+
+  if (! is_chunked && content_request_split (self, source, transfer))
+    return;
+
+  /* ask the seeder to push the content */
+  transfer_request_content (self,
+                            source,
+                            transfer,
+                            filetea_transfer_get_id (transfer),
+                            is_chunked,
+                            byte_ranges,
+                            n_ranges);
 }
 
 static void
@@ -628,6 +2408,11 @@ content_push (FileteaProtocol    *protocol,
               EvdHttpConnection  *conn,
               gpointer            user_data)
 {
+  FileteaNode *self = FILETEA_NODE (user_data);
+
+  /* a transfer interrupted before is no longer waiting */
+  transfer_stop_resuming (self, transfer);
+
   /* set source connection of transfer */
   filetea_transfer_set_source_conn (transfer, conn);
 
@@ -635,19 +2420,69 @@ content_push (FileteaProtocol    *protocol,
   filetea_transfer_start (transfer);
 }
 
-static gboolean
-remove_source_foreach (gpointer key,
-                       gpointer value,
-                       gpointer user_data)
+static GList *
+search (FileteaProtocol *protocol,
+        const gchar     *query,
+        guint            max_results,
+        gpointer         user_data)
 {
   FileteaNode *self = FILETEA_NODE (user_data);
-  FileteaSource *source = FILETEA_SOURCE (value);
 
-  remove_source (self, source, FALSE);
+  if (max_results == 0)
+    max_results = DEFAULT_SEARCH_RESULTS;
+
+  return filetea_search_index_query (self->priv->search_index,
+                                     query,
+                                     MIN (max_results, MAX_SEARCH_RESULTS));
+}
+
+static gboolean
+node_pause_transfer (FileteaNode *self, FileteaTransfer *transfer)
+{
+  FileteaFanout *fanout;
+
+  if (! filetea_transfer_pause (transfer))
+    return FALSE;
+
+  /* others sharing its push can't wait for it, they get pushes of their
+     own */
+  fanout = g_hash_table_lookup (self->priv->fanouts_by_transfer,
+                                filetea_transfer_get_id (transfer));
+  if (fanout != NULL && filetea_fanout_get_upstream (fanout) == transfer)
+    transfer_leave_fanout (self, transfer);
 
   return TRUE;
 }
 
+static gboolean
+pause_transfer (FileteaProtocol *protocol,
+                EvdPeer         *peer,
+                const gchar     *transfer_id,
+                gboolean         pause,
+                gpointer         user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+  FileteaTransfer *transfer;
+  FileteaSource *source;
+
+  transfer = g_hash_table_lookup (self->priv->transfers_by_id, transfer_id);
+  if (transfer == NULL)
+    return FALSE;
+
+  /* only the peers at either end of the transfer can pause it */
+  source = filetea_transfer_get_source (transfer);
+  if (peer != filetea_transfer_get_target_peer (transfer) &&
+      peer != filetea_source_get_peer (source))
+    {
+      return FALSE;
+    }
+
+  if (pause)
+    return node_pause_transfer (self, transfer);
+  else
+    return filetea_transfer_resume (transfer);
+}
+
 static void
 on_new_peer (EvdTransport *transport,
              EvdPeer      *peer,
@@ -663,21 +2498,70 @@ on_peer_closed (EvdTransport *transport,
                 gpointer      user_data)
 {
   FileteaNode *self = FILETEA_NODE (user_data);
-  GHashTable *sources_of_peer;
-
-  sources_of_peer = g_hash_table_lookup (self->priv->sources_by_peer, peer);
-  if (sources_of_peer != NULL)
+  FileteaSource *source;
+  GQueue *parked_pushes;
+  GHashTableIter iter;
+  PushChannel *channel;
+  GList *dropped = NULL;
+  GList *node;
+
+  /* pushes over the transport of the peer can't go on */
+  g_hash_table_iter_init (&iter, self->priv->push_channels);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &channel))
+    if (channel->peer == peer)
+      dropped = g_list_prepend (dropped, g_object_ref (channel->transfer));
+
+  for (node = dropped; node != NULL; node = node->next)
     {
-      g_hash_table_foreach_remove (sources_of_peer,
-                                   remove_source_foreach,
-                                   self);
+      GError *error;
 
-      g_hash_table_remove (self->priv->sources_by_peer, peer);
+      error = g_error_new (G_IO_ERROR,
+                           G_IO_ERROR_CONNECTION_CLOSED,
+                           "Seeder is gone");
+      filetea_transfer_fail (node->data, SOUP_STATUS_SERVICE_UNAVAILABLE, error);
+      g_error_free (error);
     }
+  g_list_free_full (dropped, g_object_unref);
+
+  /* the token of a parked push is only good while its seeder is around */
+  while ((parked_pushes =
+          g_hash_table_lookup (self->priv->parked_pushes_by_peer, peer)) != NULL)
+    parked_push_remove (self, g_queue_peek_head (parked_pushes));
+
+  while ((source =
+          filetea_source_registry_peek_peer (self->priv->sources, peer)) != NULL)
+    remove_source (self, source, FALSE);
 
   /* @TODO: log closed peers */
 }
 
+static gboolean
+content_push_segment (FileteaNode       *self,
+                      const gchar       *content_id,
+                      EvdHttpConnection *conn)
+{
+  FileteaTransfer *transfer;
+  const gchar *dot;
+  gchar *transfer_id;
+  gchar *end = NULL;
+  guint64 index;
+
+  dot = strrchr (content_id, '.');
+  if (dot == NULL)
+    return FALSE;
+
+  index = g_ascii_strtoull (dot + 1, &end, 10);
+  if (end == dot + 1 || *end != '\0' || index > G_MAXUINT)
+    return FALSE;
+
+  transfer_id = g_strndup (content_id, dot - content_id);
+  transfer = g_hash_table_lookup (self->priv->transfers_by_id, transfer_id);
+  g_free (transfer_id);
+
+  return transfer != NULL &&
+    filetea_transfer_set_segment_conn (transfer, index, conn);
+}
+
 static void
 web_service_on_content_request (FileteaWebService *web_service,
                                 const gchar       *content_id,
@@ -688,6 +2572,10 @@ web_service_on_content_request (FileteaWebService *web_service,
   FileteaNode *self = FILETEA_NODE (user_data);
   GError *error = NULL;
 
+  g_object_set_data (G_OBJECT (conn),
+                     FILETEA_TRANSFER_WEB_SERVICE_KEY,
+                     web_service);
+
   /* validate content id */
   if (content_id == NULL || content_id[0] == '\0')
     {
@@ -708,14 +2596,14 @@ web_service_on_content_request (FileteaWebService *web_service,
       FileteaSource *source;
 
       /* lookup corresponding source */
-      source = g_hash_table_lookup (self->priv->sources_by_id, content_id);
+      source = filetea_source_registry_lookup (self->priv->sources, content_id);
       if (source == NULL)
         goto not_found;
 
       /* let protocol handle the HTTP request */
       if (! filetea_protocol_handle_content_request (self->priv->protocol,
                                       source,
-                                      EVD_WEB_SERVICE (self->priv->web_service),
+                                      EVD_WEB_SERVICE (web_service),
                                       conn,
                                       request,
                                       &error))
@@ -731,12 +2619,20 @@ web_service_on_content_request (FileteaWebService *web_service,
       /* lookup corresponding transfer */
       transfer = g_hash_table_lookup (self->priv->transfers_by_id, content_id);
       if (transfer == NULL)
-        goto not_found;
+        {
+          /* pushes of the segments of a split transfer go to
+             '<transfer-id>.<segment>', and idle ones to a parked token */
+          if (! content_push_segment (self, content_id, conn) &&
+              ! parked_push_connect (self, content_id, conn))
+            goto not_found;
+
+          return;
+        }
 
       /* let protocol handle the HTTP push */
       if (! filetea_protocol_handle_content_push (self->priv->protocol,
                                       transfer,
-                                      EVD_WEB_SERVICE (self->priv->web_service),
+                                      EVD_WEB_SERVICE (web_service),
                                       conn,
                                       request,
                                       &error))
@@ -758,15 +2654,316 @@ web_service_on_content_request (FileteaWebService *web_service,
                            NULL);
 }
 
+static void
+respond_json (FileteaNode       *self,
+              EvdHttpConnection *conn,
+              JsonNode          *root)
+{
+  JsonGenerator *generator;
+  SoupMessageHeaders *headers;
+  gchar *content;
+  gsize content_len;
+
+  generator = json_generator_new ();
+  json_generator_set_root (generator, root);
+  content = json_generator_to_data (generator, &content_len);
+
+  headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+  soup_message_headers_set_content_type (headers, "application/json", NULL);
+
+  evd_web_service_respond (connection_get_web_service (self, conn),
+                           conn,
+                           SOUP_STATUS_OK,
+                           headers,
+                           content,
+                           content_len,
+                           NULL);
+
+  soup_message_headers_free (headers);
+  g_free (content);
+  g_object_unref (generator);
+}
+
+static void
+management_respond_json (FileteaNode       *self,
+                         EvdHttpConnection *conn,
+                         JsonBuilder       *builder)
+{
+  JsonNode *root;
+
+  root = json_builder_get_root (builder);
+  respond_json (self, conn, root);
+  json_node_free (root);
+}
+
+static void
+management_stats (FileteaNode       *self,
+                  EvdHttpConnection *conn)
+{
+  JsonBuilder *builder;
+  gsize budget;
+  gsize in_use;
+  gsize cached;
+  guint64 failures;
+  GHashTableIter iter;
+  gpointer value;
+
+  filetea_buffer_pool_get_stats (self->priv->buffer_pool,
+                                 &budget,
+                                 &in_use,
+                                 &cached,
+                                 &failures);
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+
+  json_builder_set_member_name (builder, "sources");
+  json_builder_add_int_value (builder,
+                              filetea_source_registry_get_size (self->priv->sources));
+  json_builder_set_member_name (builder, "public-sources");
+  json_builder_add_int_value (builder,
+                              filetea_search_index_get_size (self->priv->search_index));
+  json_builder_set_member_name (builder, "transfers");
+  json_builder_add_int_value (builder,
+                              g_hash_table_size (self->priv->transfers_by_id));
+
+  json_builder_set_member_name (builder, "buffer-pool");
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "budget");
+  json_builder_add_int_value (builder, budget);
+  json_builder_set_member_name (builder, "in-use");
+  json_builder_add_int_value (builder, in_use);
+  json_builder_set_member_name (builder, "cached");
+  json_builder_add_int_value (builder, cached);
+  json_builder_set_member_name (builder, "failures");
+  json_builder_add_int_value (builder, failures);
+  json_builder_end_object (builder);
+
+  /* how long real-time content waits in the relay */
+  json_builder_set_member_name (builder, "real-time");
+  json_builder_begin_array (builder);
+  g_hash_table_iter_init (&iter, self->priv->transfers_by_id);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    {
+      FileteaTransfer *transfer = FILETEA_TRANSFER (value);
+      FileteaSource *source;
+      gdouble average;
+      gint64 max;
+      gsize dropped;
+
+      source = filetea_transfer_get_source (transfer);
+      if ((filetea_source_get_flags (source) &
+           FILETEA_SOURCE_FLAGS_REAL_TIME) == 0)
+        {
+          continue;
+        }
+
+      filetea_transfer_get_latency (transfer, &average, &max, &dropped);
+
+      json_builder_begin_object (builder);
+      json_builder_set_member_name (builder, "id");
+      json_builder_add_string_value (builder,
+                                     filetea_transfer_get_id (transfer));
+      json_builder_set_member_name (builder, "latency-average");
+      json_builder_add_int_value (builder, (gint64) average);
+      json_builder_set_member_name (builder, "latency-max");
+      json_builder_add_int_value (builder, max);
+      json_builder_set_member_name (builder, "dropped");
+      json_builder_add_int_value (builder, dropped);
+      json_builder_end_object (builder);
+    }
+  json_builder_end_array (builder);
+
+  json_builder_end_object (builder);
+
+  management_respond_json (self, conn, builder);
+  g_object_unref (builder);
+}
+
+/* pauses or resumes the transfer given by the 'id' query argument, or all
+   transfers if there is none */
+static void
+management_pause_transfers (FileteaNode       *self,
+                            EvdHttpConnection *conn,
+                            EvdHttpRequest    *request,
+                            gboolean           pause)
+{
+  JsonBuilder *builder;
+  SoupURI *uri;
+  const gchar *query;
+  GHashTable *query_items = NULL;
+  const gchar *transfer_id = NULL;
+  guint count = 0;
+
+  uri = evd_http_request_get_uri (request);
+  if ( (query = soup_uri_get_query (uri)) != NULL)
+    {
+      query_items = soup_form_decode (query);
+      transfer_id = g_hash_table_lookup (query_items, "id");
+    }
+
+  if (transfer_id != NULL)
+    {
+      FileteaTransfer *transfer;
+
+      transfer = g_hash_table_lookup (self->priv->transfers_by_id,
+                                      transfer_id);
+      if (transfer != NULL &&
+          (pause ?
+           node_pause_transfer (self, transfer) :
+           filetea_transfer_resume (transfer)))
+        {
+          count++;
+        }
+    }
+  else
+    {
+      GList *transfers;
+      GList *node;
+
+      /* readers falling back from a paused upstream may complete, and
+         leave the table while it is walked */
+      transfers = g_hash_table_get_values (self->priv->transfers_by_id);
+      g_list_foreach (transfers, (GFunc) g_object_ref, NULL);
+
+      for (node = transfers; node != NULL; node = node->next)
+        {
+          FileteaTransfer *transfer = FILETEA_TRANSFER (node->data);
+
+          if (pause ?
+              node_pause_transfer (self, transfer) :
+              filetea_transfer_resume (transfer))
+            {
+              count++;
+            }
+        }
+
+      g_list_free_full (transfers, g_object_unref);
+    }
+
+  if (query_items != NULL)
+    g_hash_table_unref (query_items);
+
+  builder = json_builder_new ();
+  json_builder_begin_object (builder);
+  json_builder_set_member_name (builder, "transfers");
+  json_builder_add_int_value (builder, count);
+  json_builder_end_object (builder);
+
+  management_respond_json (self, conn, builder);
+  g_object_unref (builder);
+}
+
+static void
+web_service_on_management_request (FileteaWebService *web_service,
+                                   const gchar       *path,
+                                   EvdHttpConnection *conn,
+                                   EvdHttpRequest    *request,
+                                   gpointer           user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+
+  g_object_set_data (G_OBJECT (conn),
+                     FILETEA_TRANSFER_WEB_SERVICE_KEY,
+                     web_service);
+
+  if (g_strcmp0 (path, "stats") == 0)
+    {
+      management_stats (self, conn);
+    }
+  else if (g_strcmp0 (path, "pause") == 0)
+    {
+      management_pause_transfers (self, conn, request, TRUE);
+    }
+  else if (g_strcmp0 (path, "resume") == 0)
+    {
+      management_pause_transfers (self, conn, request, FALSE);
+    }
+  else
+    {
+      evd_web_service_respond (EVD_WEB_SERVICE (web_service),
+                               conn,
+                               SOUP_STATUS_NOT_FOUND,
+                               NULL,
+                               NULL,
+                               0,
+                               NULL);
+    }
+}
+
+/* searches public sources by the 'q' query argument, returning at most
+   'max' of them */
+static void
+api_search (FileteaNode       *self,
+            EvdHttpConnection *conn,
+            EvdHttpRequest    *request)
+{
+  SoupURI *uri;
+  const gchar *query;
+  GHashTable *query_items = NULL;
+  const gchar *q = NULL;
+  const gchar *max = NULL;
+  GList *sources = NULL;
+  JsonNode *root;
+
+  uri = evd_http_request_get_uri (request);
+  if ( (query = soup_uri_get_query (uri)) != NULL)
+    {
+      query_items = soup_form_decode (query);
+      q = g_hash_table_lookup (query_items, "q");
+      max = g_hash_table_lookup (query_items, "max");
+    }
+
+  if (q != NULL)
+    sources = search (self->priv->protocol,
+                      q,
+                      max != NULL ? (guint) g_ascii_strtoull (max, NULL, 10) : 0,
+                      self);
+
+  root = filetea_protocol_search_results_to_json (sources);
+  respond_json (self, conn, root);
+
+  json_node_free (root);
+  g_list_free (sources);
+  if (query_items != NULL)
+    g_hash_table_unref (query_items);
+}
+
+static void
+web_service_on_api_request (FileteaWebService *web_service,
+                            const gchar       *path,
+                            EvdHttpConnection *conn,
+                            EvdHttpRequest    *request,
+                            gpointer           user_data)
+{
+  FileteaNode *self = FILETEA_NODE (user_data);
+
+  g_object_set_data (G_OBJECT (conn),
+                     FILETEA_TRANSFER_WEB_SERVICE_KEY,
+                     web_service);
+
+  if (g_strcmp0 (path, "search") == 0)
+    {
+      api_search (self, conn, request);
+    }
+  else
+    {
+      evd_web_service_respond (EVD_WEB_SERVICE (web_service),
+                               conn,
+                               SOUP_STATUS_NOT_FOUND,
+                               NULL,
+                               NULL,
+                               0,
+                               NULL);
+    }
+}
+
 /* public methods */
 
 FileteaNode *
 filetea_node_new (GKeyFile *config, GError **error)
 {
   FileteaNode *self;
-  EvdTransport *transport;
-  EvdTransport *ws_transport;
-  EvdJsonrpc *rpc;
 
   g_return_val_if_fail (config != NULL, NULL);
 
@@ -776,19 +2973,58 @@ filetea_node_new (GKeyFile *config, GError **error)
   if (! load_config (self, config, error))
     goto err;
 
-  /* create web service */
-  self->priv->web_service =
-    filetea_web_service_new (config,
-                             web_service_on_content_request,
-                             self,
-                             error);
-  if (self->priv->web_service == NULL)
+  /* create the first web service */
+  if (filetea_node_add_web_service (self, config, error) == NULL)
     goto err;
 
+  return self;
+
+ err:
+  g_object_unref (self);
+  return NULL;
+}
+
+/**
+ * filetea_node_add_web_service:
+ * @config: configuration of the web service
+ *
+ * Creates a new web service serving the sources and transfers of the node,
+ * so that one node can be shared by several listeners (e.g. HTTP and HTTPS).
+ * The caller is responsible for making it listen.
+ *
+ * Returns: (transfer none): the new web service, or %NULL on error.
+ **/
+FileteaWebService *
+filetea_node_add_web_service (FileteaNode  *self,
+                              GKeyFile     *config,
+                              GError      **error)
+{
+  FileteaWebService *web_service;
+  EvdTransport *transport;
+  EvdTransport *ws_transport;
+  EvdJsonrpc *rpc;
+
+  g_return_val_if_fail (FILETEA_IS_NODE (self), NULL);
+  g_return_val_if_fail (config != NULL, NULL);
+
+  web_service = filetea_web_service_new (config,
+                                         web_service_on_content_request,
+                                         self,
+                                         error);
+  if (web_service == NULL)
+    return NULL;
+
+  filetea_web_service_set_management_handler (web_service,
+                                              web_service_on_management_request,
+                                              self);
+  filetea_web_service_set_api_handler (web_service,
+                                       web_service_on_api_request,
+                                       self);
+
   /* associate web service transport with protocol's RPC object */
   rpc = filetea_protocol_get_rpc (self->priv->protocol);
 
-  transport = filetea_web_service_get_transport (self->priv->web_service);
+  transport = filetea_web_service_get_transport (web_service);
   evd_ipc_mechanism_use_transport (EVD_IPC_MECHANISM (rpc), transport);
 
   g_object_get (transport, "websocket-service", &ws_transport, NULL);
@@ -814,11 +3050,9 @@ filetea_node_new (GKeyFile *config, GError **error)
                     self);
   g_object_unref (ws_transport);
 
-  return self;
+  g_ptr_array_add (self->priv->web_services, web_service);
 
- err:
-  g_object_unref (self);
-  return NULL;
+  return web_service;
 }
 
 const gchar *
@@ -834,7 +3068,41 @@ filetea_node_get_web_service (FileteaNode *self)
 {
   g_return_val_if_fail (FILETEA_IS_NODE (self), NULL);
 
-  return self->priv->web_service;
+  if (self->priv->web_services->len == 0)
+    return NULL;
+
+  return g_ptr_array_index (self->priv->web_services, 0);
+}
+
+/**
+ * filetea_node_set_transfer_bandwidth:
+ * @transfer_id: id of an ongoing transfer
+ * @max_bw_in: maximum bandwidth from the seeder, in kilobytes per second
+ * @max_bw_out: maximum bandwidth to the downloader, in kilobytes per second
+ *
+ * Overrides the bandwidth limits configured in the [transfer] group for
+ * a single transfer. A value of 0 means unlimited.
+ *
+ * Returns: %TRUE if the transfer was found, %FALSE otherwise.
+ **/
+gboolean
+filetea_node_set_transfer_bandwidth (FileteaNode *self,
+                                     const gchar *transfer_id,
+                                     gdouble      max_bw_in,
+                                     gdouble      max_bw_out)
+{
+  FileteaTransfer *transfer;
+
+  g_return_val_if_fail (FILETEA_IS_NODE (self), FALSE);
+  g_return_val_if_fail (transfer_id != NULL, FALSE);
+
+  transfer = g_hash_table_lookup (self->priv->transfers_by_id, transfer_id);
+  if (transfer == NULL)
+    return FALSE;
+
+  filetea_transfer_set_max_bandwidth (transfer, max_bw_in, max_bw_out);
+
+  return TRUE;
 }
 
 #ifdef ENABLE_TESTS
@@ -852,7 +3120,7 @@ filetea_node_get_all_sources (FileteaNode *self)
 {
   g_return_val_if_fail (FILETEA_IS_NODE (self), NULL);
 
-  return g_hash_table_get_values (self->priv->sources_by_id);
+  return filetea_source_registry_get_all (self->priv->sources);
 }
 
 #endif /* ENABLE_TESTS */
@@ -62,6 +62,14 @@ FileteaNode *       filetea_node_new                   (GKeyFile  *config,
 const gchar *       filetea_node_get_id                (FileteaNode  *self);
 
 FileteaWebService * filetea_node_get_web_service       (FileteaNode *self);
+FileteaWebService * filetea_node_add_web_service       (FileteaNode  *self,
+                                                        GKeyFile     *config,
+                                                        GError      **error);
+
+gboolean            filetea_node_set_transfer_bandwidth (FileteaNode *self,
+                                                         const gchar *transfer_id,
+                                                         gdouble      max_bw_in,
+                                                         gdouble      max_bw_out);
 
 #ifdef ENABLE_TESTS
 
@@ -20,6 +20,7 @@
  * for more details.
  */
 
+#include <stdlib.h>
 #include <libsoup/soup.h>
 
 #include "filetea-protocol.h"
@@ -33,12 +34,40 @@ G_DEFINE_TYPE (FileteaProtocol, filetea_protocol, G_TYPE_OBJECT)
 #define OP_REGISTER            "register"
 #define OP_UNREGISTER          "unregister"
 #define OP_SEEDER_PUSH_REQUEST "push-request"
+#define OP_SEEDER_PUSH_ABORT   "push-abort"
+#define OP_PUSH_ABORTED        "push-aborted"
+#define OP_PUSH_PARK           "push-park"
+#define OP_PUSH_BIND           "push-bind"
+#define OP_PUSH_CHANNEL        "push-channel"
+#define OP_PUSH_DATA           "push-data"
+#define OP_PUSH_CREDIT         "push-credit"
+#define OP_PAUSE               "pause"
+#define OP_RESUME              "resume"
+#define OP_SEARCH              "search"
 
 #define DEFAULT_ACTION "download"
 
 #define URI_QUERY_ACTION_KEY "action"
 #define URI_QUERY_PEER_KEY   "peer"
 
+/* a push request waiting for the seeder to accept or refuse it */
+typedef struct
+{
+  guint invocation_id;
+  EvdPeer *peer;
+} PushInvocation;
+
+/* a batch of sources given to the 'register_sources' virtual method, each
+   with the object it is answered with */
+typedef struct
+{
+  guint invocation_id;
+  EvdPeer *peer;
+  JsonArray *result_arr;
+  GList *sources;
+  GList *objs;
+} RegisterInvocation;
+
 /* private data */
 struct _FileteaProtocolPrivate
 {
@@ -68,6 +97,20 @@ static void     rpc_on_notification                 (EvdJsonrpc  *jsonrpc,
                                                      gpointer     context,
                                                      gpointer     user_data);
 
+static void     op_seeder_push_request              (FileteaProtocol *self,
+                                                     JsonNode        *params,
+                                                     guint            invocation_id,
+                                                     gpointer         context,
+                                                     const gchar     *op);
+static void     op_push_park                        (FileteaProtocol *self,
+                                                     JsonNode        *params,
+                                                     guint            invocation_id,
+                                                     gpointer         context);
+static void     op_search                           (FileteaProtocol *self,
+                                                     JsonNode        *params,
+                                                     guint            invocation_id,
+                                                     gpointer         context);
+
 static void
 filetea_protocol_class_init (FileteaProtocolClass *class)
 {
@@ -141,6 +184,20 @@ typedef struct
   guint op_index;
 } FileteaProtocolOperation;
 
+static void
+register_invocation_free (gpointer data)
+{
+  RegisterInvocation *invocation = data;
+
+  g_object_unref (invocation->peer);
+  if (invocation->result_arr != NULL)
+    json_array_unref (invocation->result_arr);
+  g_list_free_full (invocation->sources, g_object_unref);
+  g_list_free (invocation->objs);
+
+  g_slice_free (RegisterInvocation, invocation);
+}
+
 static void
 op_register_content (FileteaProtocol *self,
                      JsonNode        *params,
@@ -152,8 +209,10 @@ op_register_content (FileteaProtocol *self,
   GError *error = NULL;
 
   JsonArray *result_arr = NULL;
+  RegisterInvocation *invocation = NULL;
 
-  if (self->priv->vtable->register_source == NULL)
+  if (self->priv->vtable->register_source == NULL &&
+      self->priv->vtable->register_sources == NULL)
     {
       g_set_error (&error,
                    G_IO_ERROR,
@@ -164,6 +223,15 @@ op_register_content (FileteaProtocol *self,
 
   result_arr = json_array_new ();
 
+  /* the whole batch goes to the 'register_sources' virtual method at once,
+     which answers through filetea_protocol_respond_register() */
+  if (self->priv->vtable->register_sources != NULL)
+    {
+      invocation = g_slice_new0 (RegisterInvocation);
+      invocation->invocation_id = invocation_id;
+      invocation->peer = g_object_ref (context);
+    }
+
   a = json_node_get_array (params);
   for (i=0; i<json_array_get_length (a); i++)
     {
@@ -349,6 +417,14 @@ op_register_content (FileteaProtocol *self,
             }
         }
 
+      if (invocation != NULL)
+        {
+          invocation->sources = g_list_prepend (invocation->sources,
+                                                g_object_ref (source));
+          invocation->objs = g_list_prepend (invocation->objs, reg_node_obj);
+          goto done;
+        }
+
       /* call 'register_source' virtual method */
       if (! self->priv->vtable->register_source (self,
                                                  EVD_PEER (context),
@@ -382,6 +458,39 @@ op_register_content (FileteaProtocol *self,
       json_array_add_object_element (result_arr, reg_node_obj);
     }
 
+  if (invocation != NULL)
+    {
+      if (invocation->sources != NULL)
+        {
+          GSimpleAsyncResult *async_result;
+
+          invocation->sources = g_list_reverse (invocation->sources);
+          invocation->objs = g_list_reverse (invocation->objs);
+          invocation->result_arr = result_arr;
+
+          async_result =
+            g_simple_async_result_new (G_OBJECT (self),
+                                       NULL,
+                                       NULL,
+                                       filetea_protocol_respond_register);
+          g_simple_async_result_set_op_res_gpointer (async_result,
+                                                     invocation,
+                                                     register_invocation_free);
+
+          self->priv->vtable->register_sources (self,
+                                                EVD_PEER (context),
+                                                invocation->sources,
+                                                G_ASYNC_RESULT (async_result),
+                                                self->priv->user_data);
+
+          g_object_unref (async_result);
+          return;
+        }
+
+      /* no valid source in the batch, respond right away */
+      register_invocation_free (invocation);
+    }
+
  out:
   if (error != NULL)
     {
@@ -551,6 +660,87 @@ op_unregister_content (FileteaProtocol *self,
     }
 }
 
+static void
+op_pause_transfers (FileteaProtocol *self,
+                    JsonNode        *params,
+                    guint            invocation_id,
+                    gpointer         context,
+                    gboolean         pause)
+{
+  JsonArray *items;
+  guint i;
+  GError *error = NULL;
+
+  JsonArray *result_arr;
+  JsonNode *result;
+
+  if (self->priv->vtable->pause_transfer == NULL)
+    {
+      g_set_error (&error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "'%s' operation not implemented",
+                   pause ? OP_PAUSE : OP_RESUME);
+      goto out;
+    }
+
+  if (! JSON_NODE_HOLDS_ARRAY (params))
+    {
+      g_set_error (&error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   "Method %s expects an array of transfer id strings",
+                   pause ? OP_PAUSE : OP_RESUME);
+      goto out;
+    }
+
+  result_arr = json_array_new ();
+
+  items = json_node_get_array (params);
+  for (i=0; i<json_array_get_length (items); i++)
+    {
+      JsonNode *node;
+      const gchar *transfer_id = NULL;
+      gboolean done = FALSE;
+
+      node = json_array_get_element (items, i);
+      if (JSON_NODE_HOLDS_VALUE (node))
+        transfer_id = json_node_get_string (node);
+
+      /* call 'pause_transfer' virtual method */
+      if (transfer_id != NULL)
+        done = self->priv->vtable->pause_transfer (self,
+                                                   EVD_PEER (context),
+                                                   transfer_id,
+                                                   pause,
+                                                   self->priv->user_data);
+
+      json_array_add_boolean_element (result_arr, done);
+    }
+
+  result = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (result, result_arr);
+
+  evd_jsonrpc_respond (self->priv->rpc,
+                       invocation_id,
+                       result,
+                       context,
+                       NULL);
+
+  json_node_free (result);
+
+ out:
+  if (error != NULL)
+    {
+      evd_jsonrpc_respond_from_error (self->priv->rpc,
+                                      invocation_id,
+                                      error,
+                                      context,
+                                      NULL);
+      g_error_free (error);
+    }
+}
+
 static void
 rpc_on_method_called (EvdJsonrpc  *jsonrpc,
                       const gchar *method_name,
@@ -569,24 +759,76 @@ rpc_on_method_called (EvdJsonrpc  *jsonrpc,
     {
       op_unregister_content (self, params, invocation_id, context);
     }
+  else if (g_strcmp0 (method_name, OP_PAUSE) == 0)
+    {
+      op_pause_transfers (self, params, invocation_id, context, TRUE);
+    }
+  else if (g_strcmp0 (method_name, OP_RESUME) == 0)
+    {
+      op_pause_transfers (self, params, invocation_id, context, FALSE);
+    }
+  else if (g_strcmp0 (method_name, OP_SEEDER_PUSH_REQUEST) == 0)
+    {
+      op_seeder_push_request (self,
+                              params,
+                              invocation_id,
+                              context,
+                              OP_SEEDER_PUSH_REQUEST);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_BIND) == 0)
+    {
+      op_seeder_push_request (self, params, invocation_id, context, OP_PUSH_BIND);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_CHANNEL) == 0)
+    {
+      op_seeder_push_request (self,
+                              params,
+                              invocation_id,
+                              context,
+                              OP_PUSH_CHANNEL);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_PARK) == 0)
+    {
+      op_push_park (self, params, invocation_id, context);
+    }
+  else if (g_strcmp0 (method_name, OP_SEARCH) == 0)
+    {
+      op_search (self, params, invocation_id, context);
+    }
+}
+
+static void
+push_invocation_free (gpointer data)
+{
+  PushInvocation *invocation = data;
+
+  if (invocation->peer != NULL)
+    g_object_unref (invocation->peer);
+
+  g_slice_free (PushInvocation, invocation);
 }
 
 static void
 op_seeder_push_request (FileteaProtocol *self,
                         JsonNode        *params,
                         guint            invocation_id,
-                        gpointer         context)
+                        gpointer         context,
+                        const gchar     *op)
 {
   GError *error = NULL;
 
   GSimpleAsyncResult *async_result = NULL;
+  const gchar *push_token = NULL;
+  gint64 channel_credit = 0;
   const gchar *source_id;
   const gchar *transfer_id;
   gboolean is_chunked = FALSE;
-  SoupRange byte_range;
+  SoupRange *byte_ranges = NULL;
+  guint n_ranges = 0;
 
   JsonArray *args;
   guint args_len;
+  guint first = 0;
 
 #define SET_ERROR_AND_OUT(err_code,err_msg) g_set_error (&error,      \
                                                          G_IO_ERROR,  \
@@ -612,6 +854,35 @@ op_seeder_push_request (FileteaProtocol *self,
   args = json_node_get_array (params);
   args_len = json_array_get_length (args);
 
+  /* a push bound to a parked connection starts with its token */
+  if (g_strcmp0 (op, OP_PUSH_BIND) == 0)
+    {
+      if (args_len < 1 ||
+          (push_token = json_array_get_string_element (args, 0)) == NULL)
+        {
+          SET_ERROR_AND_OUT (G_IO_ERROR_INVALID_ARGUMENT,
+                             "First argument of Push Bind operation must be a push token string");
+          goto out;
+        }
+
+      first = 1;
+      args_len--;
+    }
+  /* and one over the transport with the credit it can start with */
+  else if (g_strcmp0 (op, OP_PUSH_CHANNEL) == 0)
+    {
+      if (args_len < 1 ||
+          (channel_credit = json_array_get_int_element (args, 0)) <= 0)
+        {
+          SET_ERROR_AND_OUT (G_IO_ERROR_INVALID_ARGUMENT,
+                             "First argument of Push Channel operation must be a positive credit");
+          goto out;
+        }
+
+      first = 1;
+      args_len--;
+    }
+
   if (args_len < 2)
     {
       SET_ERROR_AND_OUT (G_IO_ERROR_INVALID_ARGUMENT,
@@ -620,7 +891,7 @@ op_seeder_push_request (FileteaProtocol *self,
     }
 
   /* source id */
-  source_id = json_array_get_string_element (args, 0);
+  source_id = json_array_get_string_element (args, first);
   if (source_id == NULL)
     {
       SET_ERROR_AND_OUT (G_IO_ERROR_INVALID_ARGUMENT,
@@ -629,7 +900,7 @@ op_seeder_push_request (FileteaProtocol *self,
     }
 
   /* transfer id */
-  transfer_id = json_array_get_string_element (args, 1);
+  transfer_id = json_array_get_string_element (args, first + 1);
   if (transfer_id == NULL)
     {
       SET_ERROR_AND_OUT (G_IO_ERROR_INVALID_ARGUMENT,
@@ -637,30 +908,67 @@ op_seeder_push_request (FileteaProtocol *self,
       goto out;
     }
 
-  /* byte range */
+  /* byte ranges, as pairs of start and end offsets. A missing end in the
+     last pair means up to the end of the content */
   if (args_len > 2)
     {
+      guint i;
+
       is_chunked = TRUE;
 
-      byte_range.start = json_array_get_int_element (args, 2);
-      if (args_len > 3)
-        byte_range.end = json_array_get_int_element (args, 3);
-      else
-        byte_range.end = -1;
+      n_ranges = (args_len - 1) / 2;
+      byte_ranges = g_new (SoupRange, n_ranges);
+
+      for (i = 0; i < n_ranges; i++)
+        {
+          byte_ranges[i].start =
+            json_array_get_int_element (args, first + 2 + i * 2);
+          if (args_len > 3 + i * 2)
+            byte_ranges[i].end =
+              json_array_get_int_element (args, first + 3 + i * 2);
+          else
+            byte_ranges[i].end = -1;
+        }
     }
 
-  /* @TODO: create an async result and attach it the invocation id */
+  /* the seeder answers through filetea_protocol_respond_push_request() */
+  if (invocation_id != 0)
+    {
+      PushInvocation *invocation;
+
+      invocation = g_slice_new (PushInvocation);
+      invocation->invocation_id = invocation_id;
+      invocation->peer = NULL;
+      if (EVD_IS_PEER (context))
+        invocation->peer = g_object_ref (context);
+
+      async_result =
+        g_simple_async_result_new (G_OBJECT (self),
+                                   NULL,
+                                   NULL,
+                                   filetea_protocol_respond_push_request);
+      g_simple_async_result_set_op_res_gpointer (async_result,
+                                                 invocation,
+                                                 push_invocation_free);
+    }
 
   /* call virtual method */
   self->priv->vtable->seeder_push_request (self,
                                            G_ASYNC_RESULT (async_result),
+                                           push_token,
+                                           (gsize) channel_credit,
                                            source_id,
                                            transfer_id,
                                            is_chunked,
-                                           &byte_range,
+                                           byte_ranges,
+                                           n_ranges,
                                            self->priv->user_data);
 
  out:
+  g_free (byte_ranges);
+  if (async_result != NULL)
+    g_object_unref (async_result);
+
   if (error != NULL)
     {
       g_print ("Push request error: %s\n", error->message);
@@ -675,6 +983,268 @@ op_seeder_push_request (FileteaProtocol *self,
 #undef SET_ERROR_AND_OUT
 }
 
+static void
+op_push_park (FileteaProtocol *self,
+              JsonNode        *params,
+              guint            invocation_id,
+              gpointer         context)
+{
+  GError *error = NULL;
+  gchar *token = NULL;
+  JsonNode *result;
+
+  if (self->priv->vtable->park_push == NULL)
+    g_set_error (&error,
+                 G_IO_ERROR,
+                 G_IO_ERROR_NOT_SUPPORTED,
+                 "'%s' operation not implemented",
+                 OP_PUSH_PARK);
+  else
+    token = self->priv->vtable->park_push (self,
+                                           EVD_PEER (context),
+                                           &error,
+                                           self->priv->user_data);
+
+  if (token == NULL)
+    {
+      evd_jsonrpc_respond_from_error (self->priv->rpc,
+                                      invocation_id,
+                                      error,
+                                      context,
+                                      NULL);
+      g_error_free (error);
+      return;
+    }
+
+  result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_string (result, token);
+  g_free (token);
+
+  evd_jsonrpc_respond (self->priv->rpc,
+                       invocation_id,
+                       result,
+                       context,
+                       NULL);
+
+  json_node_free (result);
+}
+
+static void
+op_search (FileteaProtocol *self,
+           JsonNode        *params,
+           guint            invocation_id,
+           gpointer         context)
+{
+  GError *error = NULL;
+  JsonArray *args;
+  const gchar *query = NULL;
+  guint max_results = 0;
+  GList *sources;
+  JsonNode *result;
+
+  if (self->priv->vtable->search == NULL)
+    {
+      g_set_error (&error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "'%s' operation not implemented",
+                   OP_SEARCH);
+      goto out;
+    }
+
+  if (JSON_NODE_HOLDS_ARRAY (params))
+    {
+      args = json_node_get_array (params);
+      if (json_array_get_length (args) > 0 &&
+          JSON_NODE_HOLDS_VALUE (json_array_get_element (args, 0)))
+        {
+          query = json_array_get_string_element (args, 0);
+        }
+
+      if (json_array_get_length (args) > 1 &&
+          JSON_NODE_HOLDS_VALUE (json_array_get_element (args, 1)))
+        {
+          max_results = (guint) MAX (json_array_get_int_element (args, 1), 0);
+        }
+    }
+
+  if (query == NULL)
+    {
+      g_set_error (&error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   "Method %s expects a query string",
+                   OP_SEARCH);
+      goto out;
+    }
+
+  /* call 'search' virtual method */
+  sources = self->priv->vtable->search (self,
+                                        query,
+                                        max_results,
+                                        self->priv->user_data);
+
+  result = filetea_protocol_search_results_to_json (sources);
+  g_list_free (sources);
+
+  evd_jsonrpc_respond (self->priv->rpc,
+                       invocation_id,
+                       result,
+                       context,
+                       NULL);
+
+  json_node_free (result);
+
+ out:
+  if (error != NULL)
+    {
+      evd_jsonrpc_respond_from_error (self->priv->rpc,
+                                      invocation_id,
+                                      error,
+                                      context,
+                                      NULL);
+      g_error_free (error);
+    }
+}
+
+static void
+op_seeder_push_abort (FileteaProtocol *self,
+                      JsonNode        *params,
+                      gpointer         context)
+{
+  JsonArray *args;
+  const gchar *transfer_id;
+
+  if (self->priv->vtable->seeder_push_abort == NULL)
+    return;
+
+  if (! JSON_NODE_HOLDS_ARRAY (params))
+    return;
+
+  args = json_node_get_array (params);
+  if (json_array_get_length (args) < 1)
+    return;
+
+  transfer_id = json_array_get_string_element (args, 0);
+  if (transfer_id == NULL)
+    return;
+
+  self->priv->vtable->seeder_push_abort (self,
+                                         transfer_id,
+                                         self->priv->user_data);
+}
+
+static void
+op_push_aborted (FileteaProtocol *self,
+                 JsonNode        *params,
+                 gpointer         context)
+{
+  JsonArray *args;
+  const gchar *transfer_id;
+  gint64 pushed;
+
+  if (self->priv->vtable->push_aborted == NULL)
+    return;
+
+  if (! JSON_NODE_HOLDS_ARRAY (params))
+    return;
+
+  args = json_node_get_array (params);
+  if (json_array_get_length (args) < 2)
+    return;
+
+  transfer_id = json_array_get_string_element (args, 0);
+  pushed = json_array_get_int_element (args, 1);
+  if (transfer_id == NULL || pushed < 0)
+    return;
+
+  self->priv->vtable->push_aborted (self,
+                                    EVD_PEER (context),
+                                    transfer_id,
+                                    (gsize) pushed,
+                                    self->priv->user_data);
+}
+
+static void
+op_push_data (FileteaProtocol *self,
+              JsonNode        *params,
+              gpointer         context)
+{
+  JsonArray *args;
+  const gchar *transfer_id;
+  JsonNode *data_node;
+  guchar *data = NULL;
+  gsize size = 0;
+
+  if (self->priv->vtable->push_data == NULL)
+    return;
+
+  if (! JSON_NODE_HOLDS_ARRAY (params))
+    return;
+
+  args = json_node_get_array (params);
+  if (json_array_get_length (args) < 2)
+    return;
+
+  transfer_id = json_array_get_string_element (args, 0);
+  if (transfer_id == NULL)
+    return;
+
+  /* null content means the seeder stopped pushing */
+  data_node = json_array_get_element (args, 1);
+  if (! JSON_NODE_HOLDS_NULL (data_node))
+    {
+      if (json_node_get_string (data_node) == NULL)
+        return;
+
+      data = g_base64_decode (json_node_get_string (data_node), &size);
+      if (size == 0)
+        {
+          g_free (data);
+          return;
+        }
+    }
+
+  self->priv->vtable->push_data (self,
+                                 EVD_PEER (context),
+                                 transfer_id,
+                                 (const gchar *) data,
+                                 size,
+                                 self->priv->user_data);
+
+  g_free (data);
+}
+
+static void
+op_push_credit (FileteaProtocol *self,
+                JsonNode        *params,
+                gpointer         context)
+{
+  JsonArray *args;
+  const gchar *transfer_id;
+  gint64 credit;
+
+  if (self->priv->vtable->push_credit == NULL)
+    return;
+
+  if (! JSON_NODE_HOLDS_ARRAY (params))
+    return;
+
+  args = json_node_get_array (params);
+  if (json_array_get_length (args) < 2)
+    return;
+
+  transfer_id = json_array_get_string_element (args, 0);
+  credit = json_array_get_int_element (args, 1);
+  if (transfer_id == NULL || credit <= 0)
+    return;
+
+  self->priv->vtable->push_credit (self,
+                                   transfer_id,
+                                   (gsize) credit,
+                                   self->priv->user_data);
+}
+
 static void
 rpc_on_notification (EvdJsonrpc  *jsonrpc,
                      const gchar *method_name,
@@ -686,7 +1256,23 @@ rpc_on_notification (EvdJsonrpc  *jsonrpc,
 
   if (g_strcmp0 (method_name, OP_SEEDER_PUSH_REQUEST) == 0)
     {
-      op_seeder_push_request (self, params, 0, context);
+      op_seeder_push_request (self, params, 0, context, OP_SEEDER_PUSH_REQUEST);
+    }
+  else if (g_strcmp0 (method_name, OP_SEEDER_PUSH_ABORT) == 0)
+    {
+      op_seeder_push_abort (self, params, context);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_ABORTED) == 0)
+    {
+      op_push_aborted (self, params, context);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_DATA) == 0)
+    {
+      op_push_data (self, params, context);
+    }
+  else if (g_strcmp0 (method_name, OP_PUSH_CREDIT) == 0)
+    {
+      op_push_credit (self, params, context);
     }
 }
 
@@ -735,9 +1321,9 @@ filetea_source_to_json (FileteaSource *source)
 }
 
 static void
-rpc_on_register_sources (GObject      *obj,
-                         GAsyncResult *res,
-                         gpointer      user_data)
+rpc_on_request_content (GObject      *obj,
+                        GAsyncResult *res,
+                        gpointer      user_data)
 {
   GSimpleAsyncResult *result = G_SIMPLE_ASYNC_RESULT (user_data);
   JsonNode *result_json;
@@ -750,17 +1336,134 @@ rpc_on_register_sources (GObject      *obj,
                                         &err_json,
                                         &error))
     {
-      g_print ("Error registering sources: %s\n", error->message);
       g_simple_async_result_take_error (result, error);
     }
   else if (err_json != NULL)
     {
-      /* @TODO */
+      g_simple_async_result_set_error (result,
+                                       G_IO_ERROR,
+                                       G_IO_ERROR_INVALID_ARGUMENT,
+                                       "Seeder failed to handle push request");
       json_node_free (err_json);
     }
   else
     {
-      JsonArray *arr;
+      JsonObject *reply = NULL;
+      gint64 *size;
+
+      if (JSON_NODE_HOLDS_OBJECT (result_json))
+        reply = json_node_get_object (result_json);
+
+      if (reply == NULL ||
+          ! json_object_has_member (reply, "accepted") ||
+          ! json_object_has_member (reply, "size"))
+        {
+          g_simple_async_result_set_error (result,
+                                           G_IO_ERROR,
+                                           G_IO_ERROR_INVALID_DATA,
+                                           "Invalid push request reply");
+        }
+      else
+        {
+          size = g_new (gint64, 1);
+          *size = json_object_get_int_member (reply, "size");
+          g_simple_async_result_set_op_res_gpointer (result, size, g_free);
+
+          if (! json_object_get_boolean_member (reply, "accepted"))
+            {
+              const gchar *reason = NULL;
+
+              if (json_object_has_member (reply, "reason"))
+                reason = json_object_get_string_member (reply, "reason");
+
+              g_simple_async_result_set_error (result,
+                                               G_IO_ERROR,
+                                               G_IO_ERROR_NOT_FOUND,
+                                               "Seeder refused push request: %s",
+                                               reason != NULL ? reason : "unknown reason");
+            }
+        }
+
+      json_node_free (result_json);
+    }
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+static void
+rpc_on_park_push (GObject      *obj,
+                  GAsyncResult *res,
+                  gpointer      user_data)
+{
+  GSimpleAsyncResult *result = G_SIMPLE_ASYNC_RESULT (user_data);
+  JsonNode *result_json;
+  JsonNode *err_json;
+  GError *error = NULL;
+
+  if (! evd_jsonrpc_call_method_finish (EVD_JSONRPC (obj),
+                                        res,
+                                        &result_json,
+                                        &err_json,
+                                        &error))
+    {
+      g_simple_async_result_take_error (result, error);
+    }
+  else if (err_json != NULL)
+    {
+      g_simple_async_result_set_error (result,
+                                       G_IO_ERROR,
+                                       G_IO_ERROR_PERMISSION_DENIED,
+                                       "Service refused to park a push");
+      json_node_free (err_json);
+    }
+  else
+    {
+      if (JSON_NODE_HOLDS_VALUE (result_json) &&
+          json_node_get_string (result_json) != NULL)
+        g_simple_async_result_set_op_res_gpointer (result,
+                                                   json_node_dup_string (result_json),
+                                                   g_free);
+      else
+        g_simple_async_result_set_error (result,
+                                         G_IO_ERROR,
+                                         G_IO_ERROR_INVALID_DATA,
+                                         "Invalid push token");
+
+      json_node_free (result_json);
+    }
+
+  g_simple_async_result_complete (result);
+  g_object_unref (result);
+}
+
+static void
+rpc_on_register_sources (GObject      *obj,
+                         GAsyncResult *res,
+                         gpointer      user_data)
+{
+  GSimpleAsyncResult *result = G_SIMPLE_ASYNC_RESULT (user_data);
+  JsonNode *result_json;
+  JsonNode *err_json;
+  GError *error = NULL;
+
+  if (! evd_jsonrpc_call_method_finish (EVD_JSONRPC (obj),
+                                        res,
+                                        &result_json,
+                                        &err_json,
+                                        &error))
+    {
+      g_print ("Error registering sources: %s\n", error->message);
+      g_simple_async_result_take_error (result, error);
+    }
+  else if (err_json != NULL)
+    {
+      /* @TODO */
+      json_node_free (err_json);
+    }
+  else
+    {
+      JsonArray *arr;
       guint len;
       gint i;
       GList *sources;
@@ -842,6 +1545,46 @@ filetea_protocol_get_rpc (FileteaProtocol *self)
   return self->priv->rpc;
 }
 
+static gint
+compare_ranges (gconstpointer a, gconstpointer b)
+{
+  const SoupRange *range_a = a;
+  const SoupRange *range_b = b;
+
+  if (range_a->start < range_b->start)
+    return -1;
+  else if (range_a->start > range_b->start)
+    return 1;
+  else
+    return 0;
+}
+
+/* sorts @ranges and merges those overlapping or adjacent, returns the
+   resulting number of ranges */
+static gint
+normalize_ranges (SoupRange *ranges, gint ranges_len)
+{
+  gint i;
+  gint j = 0;
+
+  qsort (ranges, ranges_len, sizeof (SoupRange), compare_ranges);
+
+  for (i = 1; i < ranges_len; i++)
+    {
+      if (ranges[i].start <= ranges[j].end + 1)
+        {
+          ranges[j].end = MAX (ranges[j].end, ranges[i].end);
+        }
+      else
+        {
+          j++;
+          ranges[j] = ranges[i];
+        }
+    }
+
+  return MIN (ranges_len, j + 1);
+}
+
 gboolean
 filetea_protocol_handle_content_request (FileteaProtocol    *self,
                                          FileteaSource      *source,
@@ -871,25 +1614,14 @@ filetea_protocol_handle_content_request (FileteaProtocol    *self,
   headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (request));
 
   /* check if it is a chunked request */
-  if (soup_message_headers_get_ranges (headers, 0, &ranges, &ranges_len))
+  if (soup_message_headers_get_ranges (headers,
+                                       filetea_source_get_size (source),
+                                       &ranges,
+                                       &ranges_len))
     {
-      /* currently only one range is supported */
-      if (ranges_len > 1)
-        {
-          evd_web_service_respond (EVD_WEB_SERVICE (web_service),
-                                   conn,
-                                   SOUP_STATUS_INVALID_RANGE,
-                                   NULL,
-                                   NULL,
-                                   0,
-                                   NULL);
-          goto out;
-        }
-      else
-        {
-          /* @TODO: validate range */
-          is_chunked = TRUE;
-        }
+      /* the seeder is asked for each byte only once, in order */
+      ranges_len = normalize_ranges (ranges, ranges_len);
+      is_chunked = TRUE;
     }
 
   /* determine the action and leecher id from query arguments */
@@ -922,14 +1654,15 @@ filetea_protocol_handle_content_request (FileteaProtocol    *self,
                                        action,
                                        peer_id,
                                        is_chunked,
-                                       is_chunked ? &ranges[0] : NULL,
+                                       ranges,
+                                       is_chunked ? ranges_len : 0,
                                        self->priv->user_data);
 
   g_free (action);
   g_free (peer_id);
 
- out:
-  soup_message_headers_free_ranges (headers, ranges);
+  if (ranges != NULL)
+    soup_message_headers_free_ranges (headers, ranges);
 
   return TRUE;
 }
@@ -958,14 +1691,246 @@ filetea_protocol_handle_content_push (FileteaProtocol    *self,
   return TRUE;
 }
 
+/**
+ * filetea_protocol_request_content:
+ *
+ * @push_token: (allow-none): token of a connection the seeder parked
+ * with filetea_protocol_park_push(), already bound to @transfer_id
+ * @channel_credit: if not zero, the content is pushed over the transport
+ * with filetea_protocol_send_push_data(), this many bytes ahead at most
+ *
+ * Asks the seeder to push the content of @source_id for @transfer_id. The
+ * seeder acknowledges the request as soon as it knows whether it can serve
+ * it, see filetea_protocol_request_content_finish().
+ **/
+void
+filetea_protocol_request_content (FileteaProtocol     *self,
+                                  EvdPeer             *peer,
+                                  const gchar         *source_id,
+                                  const gchar         *transfer_id,
+                                  const gchar         *push_token,
+                                  gsize                channel_credit,
+                                  gboolean             is_chunked,
+                                  SoupRange           *byte_ranges,
+                                  guint                n_ranges,
+                                  GCancellable        *cancellable,
+                                  GAsyncReadyCallback  callback,
+                                  gpointer             user_data)
+{
+  GSimpleAsyncResult *result;
+  JsonNode *params;
+  JsonArray *arr;
+  const gchar *op;
+
+  g_return_if_fail (FILETEA_IS_PROTOCOL (self));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  result = g_simple_async_result_new (G_OBJECT (self),
+                                      callback,
+                                      user_data,
+                                      filetea_protocol_request_content);
+
+  params = json_node_new (JSON_NODE_ARRAY);
+  arr = json_array_new ();
+  json_node_take_array (params, arr);
+
+  if (push_token != NULL)
+    json_array_add_string_element (arr, push_token);
+  else if (channel_credit > 0)
+    json_array_add_int_element (arr, channel_credit);
+  json_array_add_string_element (arr, source_id);
+  json_array_add_string_element (arr, transfer_id);
+  if (is_chunked)
+    {
+      guint i;
+
+      for (i = 0; i < n_ranges; i++)
+        {
+          json_array_add_int_element (arr, byte_ranges[i].start);
+          json_array_add_int_element (arr, byte_ranges[i].end);
+        }
+    }
+
+  if (push_token != NULL)
+    op = OP_PUSH_BIND;
+  else if (channel_credit > 0)
+    op = OP_PUSH_CHANNEL;
+  else
+    op = OP_SEEDER_PUSH_REQUEST;
+
+  evd_jsonrpc_call_method (self->priv->rpc,
+                           op,
+                           params,
+                           peer,
+                           cancellable,
+                           rpc_on_request_content,
+                           result);
+
+  json_node_free (params);
+}
+
+/**
+ * filetea_protocol_request_content_finish:
+ * @size: (out) (allow-none): return location for the size of the content
+ * as the seeder sees it now, -1 if unknown
+ *
+ * Returns: %TRUE if the seeder accepted to push the content. If it
+ * refused, @error is %G_IO_ERROR_NOT_FOUND and @size is still set.
+ **/
 gboolean
-filetea_protocol_request_content (FileteaProtocol  *self,
-                                  EvdPeer          *peer,
-                                  const gchar      *source_id,
-                                  const gchar      *transfer_id,
-                                  gboolean          is_chunked,
-                                  SoupRange        *byte_range,
-                                  GError          **error)
+filetea_protocol_request_content_finish (FileteaProtocol  *self,
+                                         GAsyncResult     *result,
+                                         gint64           *size,
+                                         GError          **error)
+{
+  GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (result);
+  gint64 *res_size;
+
+  g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), FALSE);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+                                             G_OBJECT (self),
+                                             filetea_protocol_request_content),
+                        FALSE);
+
+  if (size != NULL)
+    {
+      res_size = g_simple_async_result_get_op_res_gpointer (res);
+      *size = res_size != NULL ? *res_size : -1;
+    }
+
+  return ! g_simple_async_result_propagate_error (res, error);
+}
+
+/**
+ * filetea_protocol_respond_push_request:
+ * @result: the #GAsyncResult given to the 'seeder_push_request' virtual
+ * method
+ * @size: current size of the content, -1 if unknown
+ * @error: (allow-none): why the push can't be done, or %NULL to accept it
+ *
+ * Acknowledges a push request, so the service can fail the download
+ * right away instead of waiting for a push that won't come.
+ **/
+void
+filetea_protocol_respond_push_request (FileteaProtocol *self,
+                                       GAsyncResult    *result,
+                                       gint64           size,
+                                       const GError    *error)
+{
+  PushInvocation *invocation;
+  JsonObject *reply;
+  JsonNode *reply_node;
+
+  g_return_if_fail (FILETEA_IS_PROTOCOL (self));
+
+  /* requested through a notification, nobody waits for an answer */
+  if (result == NULL)
+    return;
+
+  g_return_if_fail (g_simple_async_result_is_valid (result,
+                                       G_OBJECT (self),
+                                       filetea_protocol_respond_push_request));
+
+  invocation =
+    g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (result));
+
+  reply = json_object_new ();
+  json_object_set_boolean_member (reply, "accepted", error == NULL);
+  json_object_set_int_member (reply, "size", size);
+  if (error != NULL)
+    json_object_set_string_member (reply, "reason", error->message);
+
+  reply_node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (reply_node, reply);
+
+  evd_jsonrpc_respond (self->priv->rpc,
+                       invocation->invocation_id,
+                       reply_node,
+                       invocation->peer,
+                       NULL);
+
+  json_node_free (reply_node);
+}
+
+/**
+ * filetea_protocol_respond_register:
+ * @result: the #GAsyncResult given to the 'register_sources' virtual
+ * method
+ *
+ * Answers a batch registration once all its sources are done. Sources
+ * that could not be registered must have an error set with
+ * filetea_source_take_error(); the rest are answered with their id
+ * and signature.
+ **/
+void
+filetea_protocol_respond_register (FileteaProtocol *self,
+                                   GAsyncResult    *result)
+{
+  RegisterInvocation *invocation;
+  GList *source_node;
+  GList *obj_node;
+  JsonNode *result_node;
+
+  g_return_if_fail (FILETEA_IS_PROTOCOL (self));
+  g_return_if_fail (g_simple_async_result_is_valid (result,
+                                       G_OBJECT (self),
+                                       filetea_protocol_respond_register));
+
+  invocation =
+    g_simple_async_result_get_op_res_gpointer (G_SIMPLE_ASYNC_RESULT (result));
+
+  source_node = invocation->sources;
+  obj_node = invocation->objs;
+  while (source_node != NULL)
+    {
+      FileteaSource *source = FILETEA_SOURCE (source_node->data);
+      JsonObject *reg_node_obj = obj_node->data;
+      GError *error;
+
+      error = filetea_source_get_error (source);
+      if (error != NULL)
+        {
+          json_object_set_string_member (reg_node_obj, "error", error->message);
+        }
+      else
+        {
+          json_object_set_null_member (reg_node_obj, "error");
+          json_object_set_string_member (reg_node_obj,
+                                         "id",
+                                         filetea_source_get_id (source));
+          json_object_set_string_member (reg_node_obj,
+                                         "signature",
+                                         filetea_source_get_signature (source));
+        }
+
+      source_node = source_node->next;
+      obj_node = obj_node->next;
+    }
+
+  result_node = json_node_new (JSON_NODE_ARRAY);
+  json_node_set_array (result_node, invocation->result_arr);
+
+  evd_jsonrpc_respond (self->priv->rpc,
+                       invocation->invocation_id,
+                       result_node,
+                       invocation->peer,
+                       NULL);
+
+  json_node_free (result_node);
+}
+
+/**
+ * filetea_protocol_abort_push:
+ *
+ * Tells the seeder to stop pushing the content of @transfer_id, because
+ * nobody is downloading it anymore. The seeder answers with
+ * filetea_protocol_push_aborted() if it had started the push.
+ **/
+gboolean
+filetea_protocol_abort_push (FileteaProtocol  *self,
+                             EvdPeer          *peer,
+                             const gchar      *transfer_id,
+                             GError          **error)
 {
   gboolean result;
   JsonNode *params;
@@ -973,21 +1938,109 @@ filetea_protocol_request_content (FileteaProtocol  *self,
 
   g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), FALSE);
   g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (transfer_id != NULL, FALSE);
 
   params = json_node_new (JSON_NODE_ARRAY);
   arr = json_array_new ();
   json_node_take_array (params, arr);
 
-  json_array_add_string_element (arr, source_id);
   json_array_add_string_element (arr, transfer_id);
-  if (is_chunked)
+
+  result = evd_jsonrpc_send_notification (self->priv->rpc,
+                                          OP_SEEDER_PUSH_ABORT,
+                                          params,
+                                          peer,
+                                          error);
+  json_node_free (params);
+
+  return result;
+}
+
+/**
+ * filetea_protocol_push_aborted:
+ * @pushed: bytes of content written to the push connection
+ *
+ * Tells the service that the push of @transfer_id was stopped after
+ * @pushed bytes, so it can skip them and answer the push, leaving the
+ * connection ready for the next one.
+ **/
+gboolean
+filetea_protocol_push_aborted (FileteaProtocol  *self,
+                               EvdPeer          *peer,
+                               const gchar      *transfer_id,
+                               gsize             pushed,
+                               GError          **error)
+{
+  gboolean result;
+  JsonNode *params;
+  JsonArray *arr;
+
+  g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), FALSE);
+  g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (transfer_id != NULL, FALSE);
+
+  params = json_node_new (JSON_NODE_ARRAY);
+  arr = json_array_new ();
+  json_node_take_array (params, arr);
+
+  json_array_add_string_element (arr, transfer_id);
+  json_array_add_int_element (arr, pushed);
+
+  result = evd_jsonrpc_send_notification (self->priv->rpc,
+                                          OP_PUSH_ABORTED,
+                                          params,
+                                          peer,
+                                          error);
+  json_node_free (params);
+
+  return result;
+}
+
+/**
+ * filetea_protocol_send_push_data:
+ * @buf: (allow-none): content to push, or %NULL if the push is given up
+ * @size: size of @buf
+ *
+ * Pushes content of @transfer_id over the transport, for a push requested
+ * with a channel credit. The seeder never sends more than the credit it
+ * was granted.
+ **/
+gboolean
+filetea_protocol_send_push_data (FileteaProtocol  *self,
+                                 EvdPeer          *peer,
+                                 const gchar      *transfer_id,
+                                 const gchar      *buf,
+                                 gsize             size,
+                                 GError          **error)
+{
+  gboolean result;
+  JsonNode *params;
+  JsonArray *arr;
+
+  g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), FALSE);
+  g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (transfer_id != NULL, FALSE);
+
+  params = json_node_new (JSON_NODE_ARRAY);
+  arr = json_array_new ();
+  json_node_take_array (params, arr);
+
+  json_array_add_string_element (arr, transfer_id);
+  if (buf != NULL)
+    {
+      gchar *data;
+
+      data = g_base64_encode ((const guchar *) buf, size);
+      json_array_add_string_element (arr, data);
+      g_free (data);
+    }
+  else
     {
-      json_array_add_int_element (arr, byte_range->start);
-      json_array_add_int_element (arr, byte_range->end);
+      json_array_add_null_element (arr);
     }
 
   result = evd_jsonrpc_send_notification (self->priv->rpc,
-                                          OP_SEEDER_PUSH_REQUEST,
+                                          OP_PUSH_DATA,
                                           params,
                                           peer,
                                           error);
@@ -996,6 +2049,162 @@ filetea_protocol_request_content (FileteaProtocol  *self,
   return result;
 }
 
+/**
+ * filetea_protocol_grant_push_credit:
+ * @credit: bytes of content the seeder can push on top of what it was
+ * granted before
+ *
+ * Lets the seeder of @transfer_id push more content over the transport.
+ **/
+gboolean
+filetea_protocol_grant_push_credit (FileteaProtocol  *self,
+                                    EvdPeer          *peer,
+                                    const gchar      *transfer_id,
+                                    gsize             credit,
+                                    GError          **error)
+{
+  gboolean result;
+  JsonNode *params;
+  JsonArray *arr;
+
+  g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), FALSE);
+  g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (transfer_id != NULL, FALSE);
+
+  params = json_node_new (JSON_NODE_ARRAY);
+  arr = json_array_new ();
+  json_node_take_array (params, arr);
+
+  json_array_add_string_element (arr, transfer_id);
+  json_array_add_int_element (arr, credit);
+
+  result = evd_jsonrpc_send_notification (self->priv->rpc,
+                                          OP_PUSH_CREDIT,
+                                          params,
+                                          peer,
+                                          error);
+  json_node_free (params);
+
+  return result;
+}
+
+/**
+ * filetea_protocol_park_push:
+ *
+ * Asks the service for a token to park an idle push connection with. The
+ * seeder then sends the headers of a push to the token and waits, until
+ * the service binds a transfer to the connection through the
+ * 'seeder_push_request' virtual method.
+ **/
+void
+filetea_protocol_park_push (FileteaProtocol     *self,
+                            EvdPeer             *peer,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  GSimpleAsyncResult *result;
+  JsonNode *params;
+
+  g_return_if_fail (FILETEA_IS_PROTOCOL (self));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  result = g_simple_async_result_new (G_OBJECT (self),
+                                      callback,
+                                      user_data,
+                                      filetea_protocol_park_push);
+
+  params = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (params, json_array_new ());
+
+  evd_jsonrpc_call_method (self->priv->rpc,
+                           OP_PUSH_PARK,
+                           params,
+                           peer,
+                           cancellable,
+                           rpc_on_park_push,
+                           result);
+
+  json_node_free (params);
+}
+
+/**
+ * filetea_protocol_search_results_to_json:
+ * @sources: (element-type FileteaSource): the result of a search
+ *
+ * Describes the sources found by a search, as the 'search' method and the
+ * web API respond them. Unlike registered sources, they carry no signature.
+ *
+ * Returns: a new JSON array of objects.
+ **/
+JsonNode *
+filetea_protocol_search_results_to_json (GList *sources)
+{
+  JsonNode *node;
+  JsonArray *arr;
+  GList *item;
+
+  arr = json_array_new ();
+
+  for (item = sources; item != NULL; item = item->next)
+    {
+      FileteaSource *source = FILETEA_SOURCE (item->data);
+      JsonObject *obj;
+      const gchar **tags;
+      JsonArray *tags_arr;
+      gint i;
+
+      obj = json_object_new ();
+
+      json_object_set_string_member (obj, "id", filetea_source_get_id (source));
+      json_object_set_string_member (obj,
+                                     "name",
+                                     filetea_source_get_name (source));
+      json_object_set_string_member (obj,
+                                     "type",
+                                     filetea_source_get_content_type (source));
+      json_object_set_int_member (obj, "size", filetea_source_get_size (source));
+
+      tags_arr = json_array_new ();
+      tags = filetea_source_get_tags (source);
+      for (i=0; tags != NULL && tags[i] != NULL; i++)
+        json_array_add_string_element (tags_arr, tags[i]);
+      json_object_set_array_member (obj, "tags", tags_arr);
+
+      json_array_add_object_element (arr, obj);
+    }
+
+  node = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (node, arr);
+
+  return node;
+}
+
+/**
+ * filetea_protocol_park_push_finish:
+ *
+ * Returns: (transfer full): the token to park a push connection with,
+ * or %NULL on error.
+ **/
+gchar *
+filetea_protocol_park_push_finish (FileteaProtocol  *self,
+                                   GAsyncResult     *result,
+                                   GError          **error)
+{
+  GSimpleAsyncResult *res = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (FILETEA_IS_PROTOCOL (self), NULL);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+                                             G_OBJECT (self),
+                                             filetea_protocol_park_push),
+                        NULL);
+
+  if (g_simple_async_result_propagate_error (res, error))
+    return NULL;
+
+  return g_strdup (g_simple_async_result_get_op_res_gpointer (res));
+}
+
 void
 filetea_protocol_register_sources (FileteaProtocol     *self,
                                    EvdPeer             *peer,
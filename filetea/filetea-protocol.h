@@ -41,6 +41,11 @@ typedef struct
                                   FileteaSource    *source,
                                   GError          **error,
                                   gpointer          user_data);
+  void     (* register_sources)  (FileteaProtocol  *self,
+                                  EvdPeer          *peer,
+                                  GList            *sources,
+                                  GAsyncResult     *result,
+                                  gpointer          user_data);
   gboolean (* unregister_source) (FileteaProtocol  *self,
                                   EvdPeer          *peer,
                                   const gchar      *id,
@@ -53,7 +58,8 @@ typedef struct
                                   const gchar        *action,
                                   const gchar        *peer_id,
                                   gboolean            is_chunked,
-                                  SoupRange          *byte_range,
+                                  SoupRange          *byte_ranges,
+                                  guint               n_ranges,
                                   gpointer            user_data);
   void     (* content_push)      (FileteaProtocol    *self,
                                   FileteaTransfer    *transfer,
@@ -62,12 +68,51 @@ typedef struct
 
   void     (* seeder_push_request) (FileteaProtocol *self,
                                     GAsyncResult    *result,
+                                    const gchar     *push_token,
+                                    gsize            channel_credit,
                                     const gchar     *source_id,
                                     const gchar     *transfer_id,
                                     gboolean         is_chunked,
-                                    SoupRange       *byte_range,
+                                    SoupRange       *byte_ranges,
+                                    guint            n_ranges,
                                     gpointer         user_data);
 
+  gboolean (* pause_transfer)    (FileteaProtocol  *self,
+                                  EvdPeer          *peer,
+                                  const gchar      *transfer_id,
+                                  gboolean          pause,
+                                  gpointer          user_data);
+
+  void     (* seeder_push_abort) (FileteaProtocol *self,
+                                  const gchar     *transfer_id,
+                                  gpointer         user_data);
+  void     (* push_aborted)      (FileteaProtocol *self,
+                                  EvdPeer         *peer,
+                                  const gchar     *transfer_id,
+                                  gsize            pushed,
+                                  gpointer         user_data);
+
+  gchar *  (* park_push)         (FileteaProtocol  *self,
+                                  EvdPeer          *peer,
+                                  GError          **error,
+                                  gpointer          user_data);
+
+  void     (* push_data)         (FileteaProtocol *self,
+                                  EvdPeer         *peer,
+                                  const gchar     *transfer_id,
+                                  const gchar     *buf,
+                                  gsize            size,
+                                  gpointer         user_data);
+  void     (* push_credit)       (FileteaProtocol *self,
+                                  const gchar     *transfer_id,
+                                  gsize            credit,
+                                  gpointer         user_data);
+
+  GList *  (* search)            (FileteaProtocol *self,
+                                  const gchar     *query,
+                                  guint            max_results,
+                                  gpointer         user_data);
+
 } FileteaProtocolVTable;
 
 struct _FileteaProtocol
@@ -111,13 +156,60 @@ gboolean          filetea_protocol_handle_content_push     (FileteaProtocol    *
                                                             EvdHttpRequest     *request,
                                                             GError            **error);
 
-gboolean          filetea_protocol_request_content         (FileteaProtocol  *self,
+void              filetea_protocol_request_content         (FileteaProtocol     *self,
+                                                            EvdPeer             *peer,
+                                                            const gchar         *source_id,
+                                                            const gchar         *transfer_id,
+                                                            const gchar         *push_token,
+                                                            gsize                channel_credit,
+                                                            gboolean             is_chunked,
+                                                            SoupRange           *byte_ranges,
+                                                            guint                n_ranges,
+                                                            GCancellable        *cancellable,
+                                                            GAsyncReadyCallback  callback,
+                                                            gpointer             user_data);
+gboolean          filetea_protocol_request_content_finish  (FileteaProtocol  *self,
+                                                            GAsyncResult     *result,
+                                                            gint64           *size,
+                                                            GError          **error);
+void              filetea_protocol_respond_push_request    (FileteaProtocol *self,
+                                                            GAsyncResult    *result,
+                                                            gint64           size,
+                                                            const GError    *error);
+void              filetea_protocol_respond_register        (FileteaProtocol *self,
+                                                            GAsyncResult    *result);
+gboolean          filetea_protocol_abort_push              (FileteaProtocol  *self,
                                                             EvdPeer          *peer,
-                                                            const gchar      *source_id,
                                                             const gchar      *transfer_id,
-                                                            gboolean          is_chunked,
-                                                            SoupRange        *byte_range,
                                                             GError          **error);
+gboolean          filetea_protocol_push_aborted            (FileteaProtocol  *self,
+                                                            EvdPeer          *peer,
+                                                            const gchar      *transfer_id,
+                                                            gsize             pushed,
+                                                            GError          **error);
+
+gboolean          filetea_protocol_send_push_data          (FileteaProtocol  *self,
+                                                            EvdPeer          *peer,
+                                                            const gchar      *transfer_id,
+                                                            const gchar      *buf,
+                                                            gsize             size,
+                                                            GError          **error);
+gboolean          filetea_protocol_grant_push_credit       (FileteaProtocol  *self,
+                                                            EvdPeer          *peer,
+                                                            const gchar      *transfer_id,
+                                                            gsize             credit,
+                                                            GError          **error);
+
+void              filetea_protocol_park_push               (FileteaProtocol     *self,
+                                                            EvdPeer             *peer,
+                                                            GCancellable        *cancellable,
+                                                            GAsyncReadyCallback  callback,
+                                                            gpointer             user_data);
+gchar *           filetea_protocol_park_push_finish        (FileteaProtocol  *self,
+                                                            GAsyncResult     *result,
+                                                            GError          **error);
+
+JsonNode *        filetea_protocol_search_results_to_json  (GList *sources);
 
 void              filetea_protocol_register_sources        (FileteaProtocol     *self,
                                                             EvdPeer             *peer,
@@ -0,0 +1,514 @@
+/*
+ * filetea-search-index.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+
+#include <string.h>
+
+#include "filetea-search-index.h"
+
+G_DEFINE_TYPE (FileteaSearchIndex, filetea_search_index, G_TYPE_OBJECT)
+
+#define FILETEA_SEARCH_INDEX_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                               FILETEA_TYPE_SEARCH_INDEX, \
+                                               FileteaSearchIndexPrivate))
+
+/* longer words are not indexed */
+#define MAX_TERM_LEN 64
+
+/* ends a query term to make it a prefix */
+#define PREFIX_CHAR '*'
+
+typedef struct
+{
+  gchar *str;
+
+  /* sources having the term, sorted by address */
+  GArray *postings;
+
+  GSequenceIter *iter;
+} Term;
+
+typedef struct
+{
+  /* sources having the word, or any word with the prefix, sorted by
+     address */
+  GArray *postings;
+
+  /* merged from more than one word with the prefix */
+  gboolean owned;
+} QueryTerm;
+
+/* private data */
+struct _FileteaSearchIndexPrivate
+{
+  GHashTable *terms;
+
+  /* the same terms in order, for prefix queries */
+  GSequence *sorted_terms;
+
+  guint size;
+};
+
+static void     filetea_search_index_class_init         (FileteaSearchIndexClass *class);
+static void     filetea_search_index_init               (FileteaSearchIndex *self);
+
+static void     filetea_search_index_finalize           (GObject *obj);
+
+static void     term_free                               (gpointer data);
+
+static void
+filetea_search_index_class_init (FileteaSearchIndexClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->finalize = filetea_search_index_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaSearchIndexPrivate));
+}
+
+static void
+filetea_search_index_init (FileteaSearchIndex *self)
+{
+  FileteaSearchIndexPrivate *priv;
+
+  priv = FILETEA_SEARCH_INDEX_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->terms = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       NULL,
+                                       term_free);
+  priv->sorted_terms = g_sequence_new (NULL);
+
+  priv->size = 0;
+}
+
+static void
+filetea_search_index_finalize (GObject *obj)
+{
+  FileteaSearchIndex *self = FILETEA_SEARCH_INDEX (obj);
+
+  g_sequence_free (self->priv->sorted_terms);
+  g_hash_table_unref (self->priv->terms);
+
+  G_OBJECT_CLASS (filetea_search_index_parent_class)->finalize (obj);
+}
+
+static void
+term_free (gpointer data)
+{
+  Term *term = data;
+
+  g_free (term->str);
+  g_array_free (term->postings, TRUE);
+
+  g_slice_free (Term, term);
+}
+
+static gint
+term_cmp (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return strcmp (((const Term *) a)->str, ((const Term *) b)->str);
+}
+
+static gboolean
+postings_find (GArray *postings, gpointer source, guint *pos)
+{
+  guint low = 0;
+  guint high = postings->len;
+
+  while (low < high)
+    {
+      guint mid = low + (high - low) / 2;
+      gpointer item = g_array_index (postings, gpointer, mid);
+
+      if (item == source)
+        {
+          *pos = mid;
+          return TRUE;
+        }
+
+      if ((guintptr) item < (guintptr) source)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  *pos = low;
+  return FALSE;
+}
+
+/* splits @text in lowercase words of letters and digits; in a query, a word
+   keeps the prefix char that ends it */
+static void
+tokenize (const gchar *text, gboolean query, GPtrArray *tokens)
+{
+  gchar *lower;
+  const gchar *p;
+  const gchar *start = NULL;
+
+  if (text == NULL || ! g_utf8_validate (text, -1, NULL))
+    return;
+
+  lower = g_utf8_strdown (text, -1);
+
+  for (p = lower; ; p = g_utf8_next_char (p))
+    {
+      gunichar c = g_utf8_get_char (p);
+
+      if (c != 0 && g_unichar_isalnum (c))
+        {
+          if (start == NULL)
+            start = p;
+          continue;
+        }
+
+      if (start != NULL)
+        {
+          const gchar *end = p;
+
+          if (query && c == PREFIX_CHAR)
+            end++;
+
+          if (end - start <= MAX_TERM_LEN)
+            g_ptr_array_add (tokens, g_strndup (start, end - start));
+
+          start = NULL;
+        }
+
+      if (c == 0)
+        break;
+    }
+
+  g_free (lower);
+}
+
+static GPtrArray *
+source_get_terms (FileteaSource *source)
+{
+  GPtrArray *terms;
+  const gchar **tags;
+  guint i;
+
+  terms = g_ptr_array_new_with_free_func (g_free);
+
+  tokenize (filetea_source_get_name (source), FALSE, terms);
+
+  tags = filetea_source_get_tags (source);
+  for (i=0; tags != NULL && tags[i] != NULL; i++)
+    tokenize (tags[i], FALSE, terms);
+
+  return terms;
+}
+
+static gint
+posting_cmp (gconstpointer a, gconstpointer b)
+{
+  guintptr pa = (guintptr) *(gpointer *) a;
+  guintptr pb = (guintptr) *(gpointer *) b;
+
+  return pa < pb ? -1 : pa > pb;
+}
+
+/* sources having any word that starts with @prefix, sorted by address. The
+   postings of the only word with the prefix are returned as they are,
+   those of several words are merged into a new array */
+static GArray *
+prefix_get_postings (FileteaSearchIndex *self,
+                     const gchar        *prefix,
+                     gboolean           *owned)
+{
+  Term key;
+  GSequenceIter *iter;
+  GArray *first = NULL;
+  GArray *postings = NULL;
+  guint i;
+  guint n;
+
+  *owned = FALSE;
+
+  /* first word starting with the prefix */
+  key.str = (gchar *) prefix;
+  iter = g_sequence_lookup (self->priv->sorted_terms, &key, term_cmp, NULL);
+  if (iter == NULL)
+    iter = g_sequence_search (self->priv->sorted_terms, &key, term_cmp, NULL);
+
+  while (! g_sequence_iter_is_end (iter))
+    {
+      Term *term = g_sequence_get (iter);
+
+      if (! g_str_has_prefix (term->str, prefix))
+        break;
+
+      if (first == NULL)
+        {
+          first = term->postings;
+        }
+      else
+        {
+          if (postings == NULL)
+            {
+              postings = g_array_sized_new (FALSE,
+                                            FALSE,
+                                            sizeof (gpointer),
+                                            first->len + term->postings->len);
+              g_array_append_vals (postings, first->data, first->len);
+            }
+
+          g_array_append_vals (postings,
+                               term->postings->data,
+                               term->postings->len);
+        }
+
+      iter = g_sequence_iter_next (iter);
+    }
+
+  if (postings == NULL)
+    return first;
+
+  /* a source can have more than one word with the prefix */
+  g_array_sort (postings, posting_cmp);
+  for (i=1, n=1; i<postings->len; i++)
+    if (g_array_index (postings, gpointer, i) !=
+        g_array_index (postings, gpointer, n - 1))
+      {
+        g_array_index (postings, gpointer, n++) =
+          g_array_index (postings, gpointer, i);
+      }
+  g_array_set_size (postings, n);
+
+  *owned = TRUE;
+
+  return postings;
+}
+
+/* public methods */
+
+FileteaSearchIndex *
+filetea_search_index_new (void)
+{
+  return g_object_new (FILETEA_TYPE_SEARCH_INDEX, NULL);
+}
+
+/**
+ * filetea_search_index_add:
+ * @source: a source that is not in the index
+ *
+ * Indexes @source by the words of its name and tags. The index doesn't
+ * take a reference to @source, it has to be removed before it is gone.
+ **/
+void
+filetea_search_index_add (FileteaSearchIndex *self, FileteaSource *source)
+{
+  GPtrArray *terms;
+  gboolean added = FALSE;
+  guint i;
+
+  g_return_if_fail (FILETEA_IS_SEARCH_INDEX (self));
+  g_return_if_fail (FILETEA_IS_SOURCE (source));
+
+  terms = source_get_terms (source);
+
+  for (i=0; i<terms->len; i++)
+    {
+      const gchar *str = g_ptr_array_index (terms, i);
+      Term *term;
+      guint pos;
+
+      term = g_hash_table_lookup (self->priv->terms, str);
+      if (term == NULL)
+        {
+          term = g_slice_new (Term);
+          term->str = g_strdup (str);
+          term->postings = g_array_new (FALSE, FALSE, sizeof (gpointer));
+          term->iter = g_sequence_insert_sorted (self->priv->sorted_terms,
+                                                 term,
+                                                 term_cmp,
+                                                 NULL);
+
+          g_hash_table_insert (self->priv->terms, term->str, term);
+        }
+
+      /* a word can appear more than once in a source */
+      if (! postings_find (term->postings, source, &pos))
+        {
+          g_array_insert_val (term->postings, pos, source);
+          added = TRUE;
+        }
+    }
+
+  g_ptr_array_unref (terms);
+
+  /* sources without words are not indexed */
+  if (added)
+    self->priv->size++;
+}
+
+void
+filetea_search_index_remove (FileteaSearchIndex *self, FileteaSource *source)
+{
+  GPtrArray *terms;
+  gboolean removed = FALSE;
+  guint i;
+
+  g_return_if_fail (FILETEA_IS_SEARCH_INDEX (self));
+  g_return_if_fail (FILETEA_IS_SOURCE (source));
+
+  terms = source_get_terms (source);
+
+  for (i=0; i<terms->len; i++)
+    {
+      Term *term;
+      guint pos;
+
+      term = g_hash_table_lookup (self->priv->terms,
+                                  g_ptr_array_index (terms, i));
+      if (term == NULL || ! postings_find (term->postings, source, &pos))
+        continue;
+
+      g_array_remove_index (term->postings, pos);
+      removed = TRUE;
+
+      if (term->postings->len == 0)
+        {
+          g_sequence_remove (term->iter);
+          g_hash_table_remove (self->priv->terms, term->str);
+        }
+    }
+
+  g_ptr_array_unref (terms);
+
+  /* the source was not in the index */
+  if (removed)
+    self->priv->size--;
+}
+
+/**
+ * filetea_search_index_query:
+ * @query: words that must all appear in the name or tags of a source,
+ *         those ending with '*' match as a prefix
+ * @max_results: maximum number of sources to return
+ *
+ * Returns: (transfer container) (element-type FileteaSource): the sources
+ *          matching @query.
+ **/
+GList *
+filetea_search_index_query (FileteaSearchIndex *self,
+                            const gchar        *query,
+                            guint               max_results)
+{
+  GPtrArray *tokens;
+  QueryTerm *query_terms;
+  guint n_query_terms = 0;
+  guint driver = 0;
+  guint n_results = 0;
+  GList *results = NULL;
+  GArray *postings;
+  guint i;
+  guint j;
+
+  g_return_val_if_fail (FILETEA_IS_SEARCH_INDEX (self), NULL);
+  g_return_val_if_fail (query != NULL, NULL);
+
+  tokens = g_ptr_array_new_with_free_func (g_free);
+  tokenize (query, TRUE, tokens);
+
+  query_terms = g_new0 (QueryTerm, tokens->len);
+
+  for (i=0; i<tokens->len; i++)
+    {
+      gchar *str = g_ptr_array_index (tokens, i);
+      QueryTerm *query_term = &query_terms[n_query_terms];
+      gsize len = strlen (str);
+
+      if (str[len - 1] == PREFIX_CHAR)
+        {
+          str[len - 1] = '\0';
+          query_term->postings = prefix_get_postings (self,
+                                                      str,
+                                                      &query_term->owned);
+        }
+      else
+        {
+          Term *term;
+
+          term = g_hash_table_lookup (self->priv->terms, str);
+          if (term != NULL)
+            query_term->postings = term->postings;
+        }
+
+      /* a word nothing has, nothing matches */
+      if (query_term->postings == NULL)
+        goto out;
+
+      n_query_terms++;
+    }
+
+  if (n_query_terms == 0 || max_results == 0)
+    goto out;
+
+  /* candidates come from the shortest list, and must be in all the
+     others */
+  for (i=1; i<n_query_terms; i++)
+    if (query_terms[i].postings->len < query_terms[driver].postings->len)
+      driver = i;
+
+  postings = query_terms[driver].postings;
+  for (i=0; i<postings->len && n_results < max_results; i++)
+    {
+      FileteaSource *source = g_array_index (postings, gpointer, i);
+
+      for (j=0; j<n_query_terms; j++)
+        {
+          guint pos;
+
+          if (j != driver &&
+              ! postings_find (query_terms[j].postings, source, &pos))
+            {
+              break;
+            }
+        }
+
+      if (j == n_query_terms)
+        {
+          results = g_list_prepend (results, source);
+          n_results++;
+        }
+    }
+
+ out:
+  for (i=0; i<n_query_terms; i++)
+    if (query_terms[i].owned)
+      g_array_free (query_terms[i].postings, TRUE);
+  g_free (query_terms);
+  g_ptr_array_unref (tokens);
+
+  return g_list_reverse (results);
+}
+
+guint
+filetea_search_index_get_size (FileteaSearchIndex *self)
+{
+  g_return_val_if_fail (FILETEA_IS_SEARCH_INDEX (self), 0);
+
+  return self->priv->size;
+}
@@ -0,0 +1,74 @@
+/*
+ * filetea-search-index.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+
+#ifndef __FILETEA_SEARCH_INDEX_H__
+#define __FILETEA_SEARCH_INDEX_H__
+
+#include <evd.h>
+
+#include "filetea-source.h"
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaSearchIndex FileteaSearchIndex;
+typedef struct _FileteaSearchIndexClass FileteaSearchIndexClass;
+typedef struct _FileteaSearchIndexPrivate FileteaSearchIndexPrivate;
+
+struct _FileteaSearchIndex
+{
+  GObject parent;
+
+  FileteaSearchIndexPrivate *priv;
+};
+
+struct _FileteaSearchIndexClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_SEARCH_INDEX           (filetea_search_index_get_type ())
+#define FILETEA_SEARCH_INDEX(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_SEARCH_INDEX, FileteaSearchIndex))
+#define FILETEA_SEARCH_INDEX_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_SEARCH_INDEX, FileteaSearchIndexClass))
+#define FILETEA_IS_SEARCH_INDEX(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_SEARCH_INDEX))
+#define FILETEA_IS_SEARCH_INDEX_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_SEARCH_INDEX))
+#define FILETEA_SEARCH_INDEX_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_SEARCH_INDEX, FileteaSearchIndexClass))
+
+
+GType                filetea_search_index_get_type     (void) G_GNUC_CONST;
+
+FileteaSearchIndex * filetea_search_index_new          (void);
+
+void                 filetea_search_index_add          (FileteaSearchIndex *self,
+                                                        FileteaSource      *source);
+void                 filetea_search_index_remove       (FileteaSearchIndex *self,
+                                                        FileteaSource      *source);
+
+GList *              filetea_search_index_query        (FileteaSearchIndex *self,
+                                                        const gchar        *query,
+                                                        guint               max_results);
+
+guint                filetea_search_index_get_size     (FileteaSearchIndex *self);
+
+G_END_DECLS
+
+#endif /* __FILETEA_SEARCH_INDEX_H__ */
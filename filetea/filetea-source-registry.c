@@ -0,0 +1,495 @@
+/*
+ * filetea-source-registry.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+
+#include <string.h>
+
+#include "filetea-source-registry.h"
+
+G_DEFINE_TYPE (FileteaSourceRegistry, filetea_source_registry, G_TYPE_OBJECT)
+
+#define FILETEA_SOURCE_REGISTRY_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                                  FILETEA_TYPE_SOURCE_REGISTRY, \
+                                                  FileteaSourceRegistryPrivate))
+
+#define MIN_SLOTS_BITS 6
+#define MIN_ENTRIES    64
+
+/* end of a list of entries */
+#define NO_ENTRY G_MAXUINT32
+
+/* spreads the hash of an id over the high bits, which give the slot */
+#define HASH_MULTIPLIER 0x9E3779B1
+
+/* a slot of the table keeps the hash of the id, so probing only touches the
+   source of the entries whose hash matches */
+typedef struct
+{
+  guint32 hash;
+  guint32 entry; /* index of the entry plus one, 0 if the slot is empty */
+} Slot;
+
+/* entries don't move while they are in use, and link the sources of a peer
+   together by index */
+typedef struct
+{
+  FileteaSource *source;
+  EvdPeer *peer;
+
+  guint32 peer_prev;
+  guint32 peer_next; /* also links free entries */
+} Entry;
+
+/* private data */
+struct _FileteaSourceRegistryPrivate
+{
+  Slot *slots;
+  guint32 mask;
+  guint shift;
+
+  Entry *entries;
+  guint32 n_entries;
+  guint32 entries_size;
+  guint32 free_entry;
+
+  guint size;
+
+  /* index of the first entry of each peer, plus one */
+  GHashTable *heads_by_peer;
+};
+
+static void     filetea_source_registry_class_init         (FileteaSourceRegistryClass *class);
+static void     filetea_source_registry_init               (FileteaSourceRegistry *self);
+
+static void     filetea_source_registry_finalize           (GObject *obj);
+
+static void
+filetea_source_registry_class_init (FileteaSourceRegistryClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->finalize = filetea_source_registry_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaSourceRegistryPrivate));
+}
+
+static void
+filetea_source_registry_init (FileteaSourceRegistry *self)
+{
+  FileteaSourceRegistryPrivate *priv;
+
+  priv = FILETEA_SOURCE_REGISTRY_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->slots = g_new0 (Slot, 1 << MIN_SLOTS_BITS);
+  priv->mask = (1 << MIN_SLOTS_BITS) - 1;
+  priv->shift = 32 - MIN_SLOTS_BITS;
+
+  priv->entries = NULL;
+  priv->n_entries = 0;
+  priv->entries_size = 0;
+  priv->free_entry = NO_ENTRY;
+
+  priv->size = 0;
+
+  priv->heads_by_peer = g_hash_table_new (g_direct_hash, g_direct_equal);
+}
+
+static void
+filetea_source_registry_finalize (GObject *obj)
+{
+  FileteaSourceRegistry *self = FILETEA_SOURCE_REGISTRY (obj);
+  guint32 i;
+
+  for (i=0; i<self->priv->n_entries; i++)
+    if (self->priv->entries[i].source != NULL)
+      g_object_unref (self->priv->entries[i].source);
+
+  g_free (self->priv->entries);
+  g_free (self->priv->slots);
+
+  g_hash_table_unref (self->priv->heads_by_peer);
+
+  G_OBJECT_CLASS (filetea_source_registry_parent_class)->finalize (obj);
+}
+
+static inline guint32
+filetea_source_registry_home (FileteaSourceRegistry *self, guint32 hash)
+{
+  return (guint32) (hash * HASH_MULTIPLIER) >> self->priv->shift;
+}
+
+/* finds the slot of @id, or the empty slot where it would go */
+static gboolean
+filetea_source_registry_find (FileteaSourceRegistry *self,
+                              const gchar           *id,
+                              guint32                hash,
+                              guint32               *slot)
+{
+  guint32 i;
+
+  i = filetea_source_registry_home (self, hash);
+  while (self->priv->slots[i].entry != 0)
+    {
+      Slot *s = &self->priv->slots[i];
+
+      if (s->hash == hash &&
+          strcmp (filetea_source_get_id (self->priv->entries[s->entry - 1].source),
+                  id) == 0)
+        {
+          *slot = i;
+          return TRUE;
+        }
+
+      i = (i + 1) & self->priv->mask;
+    }
+
+  *slot = i;
+  return FALSE;
+}
+
+static void
+filetea_source_registry_grow (FileteaSourceRegistry *self)
+{
+  Slot *old_slots;
+  guint32 old_size;
+  guint32 i;
+
+  old_slots = self->priv->slots;
+  old_size = self->priv->mask + 1;
+
+  self->priv->slots = g_new0 (Slot, old_size * 2);
+  self->priv->mask = old_size * 2 - 1;
+  self->priv->shift--;
+
+  for (i=0; i<old_size; i++)
+    if (old_slots[i].entry != 0)
+      {
+        guint32 j;
+
+        j = filetea_source_registry_home (self, old_slots[i].hash);
+        while (self->priv->slots[j].entry != 0)
+          j = (j + 1) & self->priv->mask;
+
+        self->priv->slots[j] = old_slots[i];
+      }
+
+  g_free (old_slots);
+}
+
+/* empties a slot, moving back the slots that probed past it so that no
+   lookup runs into the hole */
+static void
+filetea_source_registry_clear_slot (FileteaSourceRegistry *self, guint32 i)
+{
+  guint32 j = i;
+
+  while (TRUE)
+    {
+      guint32 home;
+
+      j = (j + 1) & self->priv->mask;
+      if (self->priv->slots[j].entry == 0)
+        break;
+
+      /* the slot can move back only if its home is not in (i, j] */
+      home = filetea_source_registry_home (self, self->priv->slots[j].hash);
+      if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+        {
+          self->priv->slots[i] = self->priv->slots[j];
+          i = j;
+        }
+    }
+
+  self->priv->slots[i].entry = 0;
+}
+
+static guint32
+filetea_source_registry_alloc_entry (FileteaSourceRegistry *self)
+{
+  guint32 index;
+
+  if (self->priv->free_entry != NO_ENTRY)
+    {
+      index = self->priv->free_entry;
+      self->priv->free_entry = self->priv->entries[index].peer_next;
+      return index;
+    }
+
+  if (self->priv->n_entries == self->priv->entries_size)
+    {
+      self->priv->entries_size = MAX (self->priv->entries_size * 2,
+                                      MIN_ENTRIES);
+      self->priv->entries = g_renew (Entry,
+                                     self->priv->entries,
+                                     self->priv->entries_size);
+    }
+
+  return self->priv->n_entries++;
+}
+
+static void
+filetea_source_registry_link (FileteaSourceRegistry *self,
+                              guint32                index,
+                              EvdPeer               *peer)
+{
+  Entry *entry = &self->priv->entries[index];
+  guint32 head;
+
+  entry->peer = peer;
+  entry->peer_prev = NO_ENTRY;
+  entry->peer_next = NO_ENTRY;
+
+  if (peer == NULL)
+    return;
+
+  head = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->heads_by_peer,
+                                                peer));
+  if (head != 0)
+    {
+      entry->peer_next = head - 1;
+      self->priv->entries[head - 1].peer_prev = index;
+    }
+
+  g_hash_table_insert (self->priv->heads_by_peer,
+                       peer,
+                       GUINT_TO_POINTER (index + 1));
+}
+
+static void
+filetea_source_registry_unlink (FileteaSourceRegistry *self, guint32 index)
+{
+  Entry *entry = &self->priv->entries[index];
+
+  if (entry->peer == NULL)
+    return;
+
+  if (entry->peer_prev != NO_ENTRY)
+    self->priv->entries[entry->peer_prev].peer_next = entry->peer_next;
+  else if (entry->peer_next != NO_ENTRY)
+    g_hash_table_insert (self->priv->heads_by_peer,
+                         entry->peer,
+                         GUINT_TO_POINTER (entry->peer_next + 1));
+  else
+    g_hash_table_remove (self->priv->heads_by_peer, entry->peer);
+
+  if (entry->peer_next != NO_ENTRY)
+    self->priv->entries[entry->peer_next].peer_prev = entry->peer_prev;
+
+  entry->peer = NULL;
+}
+
+/* public methods */
+
+FileteaSourceRegistry *
+filetea_source_registry_new (void)
+{
+  return g_object_new (FILETEA_TYPE_SOURCE_REGISTRY, NULL);
+}
+
+/**
+ * filetea_source_registry_add:
+ * @source: a source with an id
+ *
+ * Adds @source to the registry, which takes a reference to it, and lists
+ * it among the sources of its peer.
+ *
+ * Returns: %FALSE if a source with the same id is already registered.
+ **/
+gboolean
+filetea_source_registry_add (FileteaSourceRegistry *self,
+                             FileteaSource         *source)
+{
+  const gchar *id;
+  guint32 hash;
+  guint32 slot;
+  guint32 index;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), FALSE);
+  g_return_val_if_fail (FILETEA_IS_SOURCE (source), FALSE);
+
+  id = filetea_source_get_id (source);
+  g_return_val_if_fail (id != NULL, FALSE);
+
+  hash = g_str_hash (id);
+  if (filetea_source_registry_find (self, id, hash, &slot))
+    return FALSE;
+
+  /* keep the load under 3/4 */
+  if ((self->priv->size + 1) * 4 > (self->priv->mask + 1) * 3)
+    {
+      filetea_source_registry_grow (self);
+      filetea_source_registry_find (self, id, hash, &slot);
+    }
+
+  index = filetea_source_registry_alloc_entry (self);
+  self->priv->entries[index].source = g_object_ref (source);
+  filetea_source_registry_link (self,
+                                index,
+                                filetea_source_get_peer (source));
+
+  self->priv->slots[slot].hash = hash;
+  self->priv->slots[slot].entry = index + 1;
+
+  self->priv->size++;
+
+  return TRUE;
+}
+
+/**
+ * filetea_source_registry_remove:
+ *
+ * Removes @source from the registry, dropping the reference taken by
+ * filetea_source_registry_add().
+ *
+ * Returns: %TRUE if the source was registered.
+ **/
+gboolean
+filetea_source_registry_remove (FileteaSourceRegistry *self,
+                                FileteaSource         *source)
+{
+  const gchar *id;
+  guint32 slot;
+  guint32 index;
+  Entry *entry;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), FALSE);
+  g_return_val_if_fail (FILETEA_IS_SOURCE (source), FALSE);
+
+  id = filetea_source_get_id (source);
+  if (id == NULL ||
+      ! filetea_source_registry_find (self, id, g_str_hash (id), &slot) ||
+      self->priv->entries[self->priv->slots[slot].entry - 1].source != source)
+    {
+      return FALSE;
+    }
+
+  index = self->priv->slots[slot].entry - 1;
+  filetea_source_registry_clear_slot (self, slot);
+  filetea_source_registry_unlink (self, index);
+
+  entry = &self->priv->entries[index];
+  entry->source = NULL;
+  entry->peer_next = self->priv->free_entry;
+  self->priv->free_entry = index;
+
+  self->priv->size--;
+
+  g_object_unref (source);
+
+  return TRUE;
+}
+
+FileteaSource *
+filetea_source_registry_lookup (FileteaSourceRegistry *self,
+                                const gchar           *id)
+{
+  guint32 slot;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), NULL);
+  g_return_val_if_fail (id != NULL, NULL);
+
+  if (! filetea_source_registry_find (self, id, g_str_hash (id), &slot))
+    return NULL;
+
+  return self->priv->entries[self->priv->slots[slot].entry - 1].source;
+}
+
+/**
+ * filetea_source_registry_set_peer:
+ * @source: a registered source
+ * @peer: the new peer of the source
+ *
+ * Moves @source to the sources of @peer, and sets it as its peer.
+ **/
+void
+filetea_source_registry_set_peer (FileteaSourceRegistry *self,
+                                  FileteaSource         *source,
+                                  EvdPeer               *peer)
+{
+  const gchar *id;
+  guint32 slot;
+  guint32 index;
+
+  g_return_if_fail (FILETEA_IS_SOURCE_REGISTRY (self));
+  g_return_if_fail (FILETEA_IS_SOURCE (source));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  id = filetea_source_get_id (source);
+  if (id != NULL &&
+      filetea_source_registry_find (self, id, g_str_hash (id), &slot))
+    {
+      index = self->priv->slots[slot].entry - 1;
+      g_return_if_fail (self->priv->entries[index].source == source);
+
+      filetea_source_registry_unlink (self, index);
+      filetea_source_registry_link (self, index, peer);
+    }
+
+  filetea_source_set_peer (source, peer);
+}
+
+/**
+ * filetea_source_registry_peek_peer:
+ *
+ * Returns: (transfer none): any of the sources of @peer, or %NULL if it has
+ * none. Removing the returned source until there are no more is the way to
+ * remove all the sources of a peer.
+ **/
+FileteaSource *
+filetea_source_registry_peek_peer (FileteaSourceRegistry *self,
+                                   EvdPeer               *peer)
+{
+  guint32 head;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), NULL);
+
+  head = GPOINTER_TO_UINT (g_hash_table_lookup (self->priv->heads_by_peer,
+                                                peer));
+  if (head == 0)
+    return NULL;
+
+  return self->priv->entries[head - 1].source;
+}
+
+guint
+filetea_source_registry_get_size (FileteaSourceRegistry *self)
+{
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), 0);
+
+  return self->priv->size;
+}
+
+GList *
+filetea_source_registry_get_all (FileteaSourceRegistry *self)
+{
+  GList *list = NULL;
+  guint32 i;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE_REGISTRY (self), NULL);
+
+  for (i=0; i<self->priv->n_entries; i++)
+    if (self->priv->entries[i].source != NULL)
+      list = g_list_prepend (list, self->priv->entries[i].source);
+
+  return list;
+}
@@ -0,0 +1,80 @@
+/*
+ * filetea-source-registry.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+
+#ifndef __FILETEA_SOURCE_REGISTRY_H__
+#define __FILETEA_SOURCE_REGISTRY_H__
+
+#include <evd.h>
+
+#include "filetea-source.h"
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaSourceRegistry FileteaSourceRegistry;
+typedef struct _FileteaSourceRegistryClass FileteaSourceRegistryClass;
+typedef struct _FileteaSourceRegistryPrivate FileteaSourceRegistryPrivate;
+
+struct _FileteaSourceRegistry
+{
+  GObject parent;
+
+  FileteaSourceRegistryPrivate *priv;
+};
+
+struct _FileteaSourceRegistryClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_SOURCE_REGISTRY           (filetea_source_registry_get_type ())
+#define FILETEA_SOURCE_REGISTRY(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_SOURCE_REGISTRY, FileteaSourceRegistry))
+#define FILETEA_SOURCE_REGISTRY_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_SOURCE_REGISTRY, FileteaSourceRegistryClass))
+#define FILETEA_IS_SOURCE_REGISTRY(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_SOURCE_REGISTRY))
+#define FILETEA_IS_SOURCE_REGISTRY_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_SOURCE_REGISTRY))
+#define FILETEA_SOURCE_REGISTRY_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_SOURCE_REGISTRY, FileteaSourceRegistryClass))
+
+
+GType                   filetea_source_registry_get_type      (void) G_GNUC_CONST;
+
+FileteaSourceRegistry * filetea_source_registry_new           (void);
+
+gboolean                filetea_source_registry_add           (FileteaSourceRegistry *self,
+                                                               FileteaSource         *source);
+gboolean                filetea_source_registry_remove        (FileteaSourceRegistry *self,
+                                                               FileteaSource         *source);
+
+FileteaSource *         filetea_source_registry_lookup        (FileteaSourceRegistry *self,
+                                                               const gchar           *id);
+
+void                    filetea_source_registry_set_peer      (FileteaSourceRegistry *self,
+                                                               FileteaSource         *source,
+                                                               EvdPeer               *peer);
+FileteaSource *         filetea_source_registry_peek_peer     (FileteaSourceRegistry *self,
+                                                               EvdPeer               *peer);
+
+guint                   filetea_source_registry_get_size      (FileteaSourceRegistry *self);
+GList *                 filetea_source_registry_get_all       (FileteaSourceRegistry *self);
+
+G_END_DECLS
+
+#endif /* __FILETEA_SOURCE_REGISTRY_H__ */
@@ -31,19 +31,35 @@ G_DEFINE_TYPE (FileteaSource, filetea_source, G_TYPE_OBJECT)
 /* private data */
 struct _FileteaSourcePrivate
 {
-  gchar *id;
-  gchar *signature;
   EvdPeer *peer;
   guint flags;
-  gchar *name;
-  gchar *type;
   gsize size;
+
+  /* name, tags, id and signature share a single block, see
+     filetea_source_pack() */
+  gchar *name;
   gchar **tags;
+  gchar *id;
+  gchar *signature;
+
+  /* shared with all the sources of the same content type */
+  const gchar *type;
 
+  /* created on first use, most sources are never transferred */
   GCancellable *cancellable;
   GError *error;
 };
 
+/* a content type shared by all the sources that have it, since a few dozen
+   of them cover almost all the content */
+typedef struct
+{
+  guint ref_count;
+  gchar str[];
+} ContentType;
+
+static GHashTable *content_types = NULL;
+
 static void     filetea_source_class_init         (FileteaSourceClass *class);
 static void     filetea_source_init               (FileteaSource *self);
 
@@ -69,14 +85,137 @@ filetea_source_init (FileteaSource *self)
   priv = FILETEA_SOURCE_GET_PRIVATE (self);
   self->priv = priv;
 
+  priv->name = NULL;
+  priv->tags = NULL;
   priv->id = NULL;
   priv->signature = NULL;
-  priv->tags = NULL;
 
-  priv->cancellable = g_cancellable_new ();
+  priv->cancellable = NULL;
   priv->error = NULL;
 }
 
+static const gchar *
+content_type_ref (const gchar *type)
+{
+  ContentType *content_type;
+
+  if (content_types == NULL)
+    content_types = g_hash_table_new (g_str_hash, g_str_equal);
+
+  content_type = g_hash_table_lookup (content_types, type);
+  if (content_type == NULL)
+    {
+      gsize len = strlen (type);
+
+      content_type = g_malloc (sizeof (ContentType) + len + 1);
+      content_type->ref_count = 0;
+      memcpy (content_type->str, type, len + 1);
+
+      g_hash_table_insert (content_types, content_type->str, content_type);
+    }
+
+  content_type->ref_count++;
+
+  return content_type->str;
+}
+
+static void
+content_type_unref (const gchar *type)
+{
+  ContentType *content_type;
+
+  content_type = g_hash_table_lookup (content_types, type);
+  g_assert (content_type != NULL);
+
+  content_type->ref_count--;
+  if (content_type->ref_count == 0)
+    {
+      g_hash_table_remove (content_types, type);
+      g_free (content_type);
+    }
+}
+
+/* the block starts with the tags, if any, otherwise with the name */
+static void
+filetea_source_free_block (FileteaSource *self)
+{
+  if (self->priv->tags != NULL)
+    g_free (self->priv->tags);
+  else
+    g_free (self->priv->name);
+}
+
+/* copies name, tags, id and signature into a single block: the
+   NULL-terminated array of tags first, if there are tags, then the strings.
+   Arguments can point into the current block, which is freed afterwards */
+static void
+filetea_source_pack (FileteaSource       *self,
+                     const gchar         *name,
+                     const gchar * const *tags,
+                     const gchar         *id,
+                     const gchar         *signature)
+{
+  guint n_tags = 0;
+  gsize len;
+  gchar *block;
+  gchar **new_tags = NULL;
+  gchar *new_name;
+  gchar *new_id = NULL;
+  gchar *new_signature = NULL;
+  gchar *str;
+  guint i;
+
+  len = strlen (name) + 1;
+  if (tags != NULL)
+    {
+      for (n_tags = 0; tags[n_tags] != NULL; n_tags++)
+        len += strlen (tags[n_tags]) + 1;
+      len += sizeof (gchar *) * (n_tags + 1);
+    }
+  if (id != NULL)
+    len += strlen (id) + 1;
+  if (signature != NULL)
+    len += strlen (signature) + 1;
+
+  block = g_malloc (len);
+  str = block;
+
+  if (tags != NULL)
+    {
+      new_tags = (gchar **) block;
+      str = block + sizeof (gchar *) * (n_tags + 1);
+
+      for (i=0; i<n_tags; i++)
+        {
+          new_tags[i] = str;
+          str = g_stpcpy (str, tags[i]) + 1;
+        }
+      new_tags[n_tags] = NULL;
+    }
+
+  new_name = str;
+  str = g_stpcpy (str, name) + 1;
+
+  if (id != NULL)
+    {
+      new_id = str;
+      str = g_stpcpy (str, id) + 1;
+    }
+
+  if (signature != NULL)
+    {
+      new_signature = str;
+      strcpy (str, signature);
+    }
+
+  filetea_source_free_block (self);
+
+  self->priv->name = new_name;
+  self->priv->tags = new_tags;
+  self->priv->id = new_id;
+  self->priv->signature = new_signature;
+}
+
 static void
 filetea_source_dispose (GObject *obj)
 {
@@ -96,13 +235,13 @@ filetea_source_finalize (GObject *obj)
 {
   FileteaSource *self = FILETEA_SOURCE (obj);
 
-  g_free (self->priv->id);
-  g_free (self->priv->signature);
-  g_free (self->priv->name);
-  g_free (self->priv->type);
-  g_strfreev (self->priv->tags);
+  filetea_source_free_block (self);
+
+  if (self->priv->type != NULL)
+    content_type_unref (self->priv->type);
 
-  g_object_unref (self->priv->cancellable);
+  if (self->priv->cancellable != NULL)
+    g_object_unref (self->priv->cancellable);
 
   if (self->priv->error != NULL)
     g_error_free (self->priv->error);
@@ -131,12 +270,11 @@ filetea_source_new (EvdPeer      *peer,
   if (peer != NULL)
     self->priv->peer = g_object_ref (peer);
 
-  self->priv->name = g_strdup (name);
-  self->priv->type = g_strdup (type);
+  self->priv->type = content_type_ref (type);
   self->priv->size = size;
   self->priv->flags = flags;
-  if (tags != NULL)
-    self->priv->tags = g_strdupv ((gchar **) tags);
+
+  filetea_source_pack (self, name, tags, NULL, NULL);
 
   return self;
 }
@@ -214,8 +352,11 @@ filetea_source_set_id (FileteaSource *self, const gchar *id)
   g_return_if_fail (FILETEA_IS_SOURCE (self));
   g_return_if_fail (id != NULL && strlen (id) > 6);
 
-  g_free (self->priv->id);
-  self->priv->id = g_strdup (id);
+  filetea_source_pack (self,
+                       self->priv->name,
+                       (const gchar * const *) self->priv->tags,
+                       id,
+                       self->priv->signature);
 }
 
 const gchar *
@@ -232,8 +373,11 @@ filetea_source_set_signature (FileteaSource *self, const gchar *signature)
   g_return_if_fail (FILETEA_IS_SOURCE (self));
   g_return_if_fail (signature != NULL);
 
-  g_free (self->priv->signature);
-  self->priv->signature = g_strdup (signature);
+  filetea_source_pack (self,
+                       self->priv->name,
+                       (const gchar * const *) self->priv->tags,
+                       self->priv->id,
+                       signature);
 }
 
 const gchar *
@@ -257,6 +401,9 @@ filetea_source_get_cancellable (FileteaSource *self)
 {
   g_return_val_if_fail (FILETEA_IS_SOURCE (self), NULL);
 
+  if (self->priv->cancellable == NULL)
+    self->priv->cancellable = g_cancellable_new ();
+
   return self->priv->cancellable;
 }
 
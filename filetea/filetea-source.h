@@ -37,19 +37,20 @@ typedef enum {
   FILETEA_SOURCE_FLAGS_LIVE          = 1 << 1,
   FILETEA_SOURCE_FLAGS_REAL_TIME     = 1 << 2,
   FILETEA_SOURCE_FLAGS_CHUNKABLE     = 1 << 3,
-  FILETEA_SOURCE_FLAGS_BIDIRECTIONAL = 1 << 4
+  FILETEA_SOURCE_FLAGS_BIDIRECTIONAL = 1 << 4,
+  FILETEA_SOURCE_FLAGS_CHANNEL       = 1 << 5
 } FileteaSourceFlags;
 
 struct _FileteaSource
 {
-  EvdWebService parent;
+  GObject parent;
 
   FileteaSourcePrivate *priv;
 };
 
 struct _FileteaSourceClass
 {
-  EvdWebServiceClass parent_class;
+  GObjectClass parent_class;
 };
 
 #define FILETEA_SOURCE_TYPE           (filetea_source_get_type ())
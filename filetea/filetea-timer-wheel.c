@@ -0,0 +1,344 @@
+/*
+ * filetea-timer-wheel.c
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+#include <evd.h>
+
+#include "filetea-timer-wheel.h"
+
+G_DEFINE_TYPE (FileteaTimerWheel, filetea_timer_wheel, G_TYPE_OBJECT)
+
+#define FILETEA_TIMER_WHEEL_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                              FILETEA_TYPE_TIMER_WHEEL, \
+                                              FileteaTimerWheelPrivate))
+
+/* a timer that is not linked in any list, because it is firing */
+#define NO_SLOT G_MAXUINT
+
+struct _FileteaTimer
+{
+  FileteaTimer *prev;
+  FileteaTimer *next;
+
+  guint slot;
+  guint rounds;
+  guint timeout;
+  gboolean cancelled;
+
+  GSourceFunc func;
+  gpointer user_data;
+};
+
+/* private data */
+struct _FileteaTimerWheelPrivate
+{
+  guint resolution;
+  guint n_slots;
+
+  /* one list of timers per slot, plus the list of expired timers about to
+     fire at the end */
+  FileteaTimer **slots;
+  guint current;
+  gint64 current_time;
+
+  guint size;
+  guint src_id;
+};
+
+static void     filetea_timer_wheel_class_init         (FileteaTimerWheelClass *class);
+static void     filetea_timer_wheel_init               (FileteaTimerWheel *self);
+
+static void     filetea_timer_wheel_finalize           (GObject *obj);
+
+static void     filetea_timer_wheel_link               (FileteaTimerWheel *self,
+                                                        FileteaTimer      *timer);
+
+static void
+filetea_timer_wheel_class_init (FileteaTimerWheelClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->finalize = filetea_timer_wheel_finalize;
+
+  g_type_class_add_private (obj_class, sizeof (FileteaTimerWheelPrivate));
+}
+
+static void
+filetea_timer_wheel_init (FileteaTimerWheel *self)
+{
+  FileteaTimerWheelPrivate *priv;
+
+  priv = FILETEA_TIMER_WHEEL_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->slots = NULL;
+  priv->current = 0;
+  priv->current_time = 0;
+  priv->size = 0;
+  priv->src_id = 0;
+}
+
+static void
+filetea_timer_wheel_finalize (GObject *obj)
+{
+  FileteaTimerWheel *self = FILETEA_TIMER_WHEEL (obj);
+  guint i;
+
+  if (self->priv->src_id != 0)
+    g_source_remove (self->priv->src_id);
+
+  for (i=0; i<=self->priv->n_slots; i++)
+    while (self->priv->slots[i] != NULL)
+      {
+        FileteaTimer *timer = self->priv->slots[i];
+
+        self->priv->slots[i] = timer->next;
+        g_slice_free (FileteaTimer, timer);
+      }
+
+  g_free (self->priv->slots);
+
+  G_OBJECT_CLASS (filetea_timer_wheel_parent_class)->finalize (obj);
+}
+
+static void
+filetea_timer_wheel_unlink (FileteaTimerWheel *self, FileteaTimer *timer)
+{
+  if (timer->prev != NULL)
+    timer->prev->next = timer->next;
+  else
+    self->priv->slots[timer->slot] = timer->next;
+
+  if (timer->next != NULL)
+    timer->next->prev = timer->prev;
+
+  timer->prev = NULL;
+  timer->next = NULL;
+  timer->slot = NO_SLOT;
+
+  self->priv->size--;
+}
+
+static void
+filetea_timer_wheel_push (FileteaTimerWheel *self,
+                          FileteaTimer      *timer,
+                          guint              slot)
+{
+  timer->slot = slot;
+  timer->prev = NULL;
+  timer->next = self->priv->slots[slot];
+  if (timer->next != NULL)
+    timer->next->prev = timer;
+  self->priv->slots[slot] = timer;
+
+  self->priv->size++;
+}
+
+/* runs the timers of the slot the wheel just turned to */
+static void
+filetea_timer_wheel_turn (FileteaTimerWheel *self)
+{
+  FileteaTimer *timer;
+  FileteaTimer *next;
+  guint expired = self->priv->n_slots;
+
+  self->priv->current = (self->priv->current + 1) % self->priv->n_slots;
+
+  /* timers that have gone around enough times are moved to the expired
+     list first, since firing can arm and cancel others */
+  timer = self->priv->slots[self->priv->current];
+  while (timer != NULL)
+    {
+      next = timer->next;
+
+      if (timer->rounds > 0)
+        {
+          timer->rounds--;
+        }
+      else
+        {
+          filetea_timer_wheel_unlink (self, timer);
+          filetea_timer_wheel_push (self, timer, expired);
+        }
+
+      timer = next;
+    }
+
+  while (self->priv->slots[expired] != NULL)
+    {
+      gboolean again;
+
+      timer = self->priv->slots[expired];
+      filetea_timer_wheel_unlink (self, timer);
+
+      again = timer->func (timer->user_data);
+
+      if (again && ! timer->cancelled)
+        filetea_timer_wheel_link (self, timer);
+      else
+        g_slice_free (FileteaTimer, timer);
+    }
+}
+
+static gboolean
+filetea_timer_wheel_on_tick (gpointer user_data)
+{
+  FileteaTimerWheel *self = FILETEA_TIMER_WHEEL (user_data);
+  gint64 now;
+  gint64 resolution;
+  gboolean result = TRUE;
+
+  now = g_get_monotonic_time ();
+  resolution = (gint64) self->priv->resolution * 1000;
+
+  /* catch up with ticks that were late */
+  g_object_ref (self);
+  while (now - self->priv->current_time >= resolution)
+    {
+      self->priv->current_time += resolution;
+      filetea_timer_wheel_turn (self);
+    }
+
+  /* nothing to wait for, don't wake up the main loop */
+  if (self->priv->size == 0)
+    {
+      self->priv->src_id = 0;
+      result = FALSE;
+    }
+  g_object_unref (self);
+
+  return result;
+}
+
+static void
+filetea_timer_wheel_link (FileteaTimerWheel *self, FileteaTimer *timer)
+{
+  gint64 now;
+  gint64 elapsed;
+  guint ticks;
+
+  now = g_get_monotonic_time ();
+
+  if (self->priv->src_id == 0)
+    {
+      self->priv->current_time = now;
+      self->priv->src_id = evd_timeout_add (NULL,
+                                            self->priv->resolution,
+                                            G_PRIORITY_LOW,
+                                            filetea_timer_wheel_on_tick,
+                                            self);
+    }
+
+  /* ticks count from the last turn of the wheel */
+  elapsed = (now - self->priv->current_time) / 1000;
+  ticks = (timer->timeout + elapsed + self->priv->resolution - 1) /
+    self->priv->resolution;
+  ticks = MAX (ticks, 1);
+
+  timer->rounds = (ticks - 1) / self->priv->n_slots;
+  filetea_timer_wheel_push (self,
+                            timer,
+                            (self->priv->current + ticks) % self->priv->n_slots);
+}
+
+/* public methods */
+
+/**
+ * filetea_timer_wheel_new:
+ * @resolution: time between turns of the wheel, in miliseconds
+ * @n_slots: number of slots of the wheel
+ *
+ * Creates a wheel of timers sharing a single main loop source. Arming
+ * and cancelling a timer take constant time. Timers fire on the first turn
+ * after their timeout, so up to @resolution miliseconds late. Timeouts
+ * longer than @resolution times @n_slots take more than one round.
+ **/
+FileteaTimerWheel *
+filetea_timer_wheel_new (guint resolution, guint n_slots)
+{
+  FileteaTimerWheel *self;
+
+  g_return_val_if_fail (resolution > 0, NULL);
+  g_return_val_if_fail (n_slots > 0, NULL);
+
+  self = g_object_new (FILETEA_TYPE_TIMER_WHEEL, NULL);
+
+  self->priv->resolution = resolution;
+  self->priv->n_slots = n_slots;
+  self->priv->slots = g_new0 (FileteaTimer *, n_slots + 1);
+
+  return self;
+}
+
+/**
+ * filetea_timer_wheel_add:
+ * @timeout: miliseconds until @func is called
+ * @func: function to call, it is called again after @timeout if it returns
+ * %TRUE
+ * @user_data: user data for @func
+ *
+ * Returns: the timer, valid until it is cancelled or @func returns %FALSE.
+ **/
+FileteaTimer *
+filetea_timer_wheel_add (FileteaTimerWheel *self,
+                         guint              timeout,
+                         GSourceFunc        func,
+                         gpointer           user_data)
+{
+  FileteaTimer *timer;
+
+  g_return_val_if_fail (FILETEA_IS_TIMER_WHEEL (self), NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  timer = g_slice_new0 (FileteaTimer);
+  timer->timeout = timeout;
+  timer->func = func;
+  timer->user_data = user_data;
+
+  filetea_timer_wheel_link (self, timer);
+
+  return timer;
+}
+
+void
+filetea_timer_wheel_cancel (FileteaTimerWheel *self, FileteaTimer *timer)
+{
+  g_return_if_fail (FILETEA_IS_TIMER_WHEEL (self));
+  g_return_if_fail (timer != NULL);
+
+  /* a firing timer is freed once its function returns */
+  if (timer->slot == NO_SLOT)
+    {
+      timer->cancelled = TRUE;
+      return;
+    }
+
+  filetea_timer_wheel_unlink (self, timer);
+  g_slice_free (FileteaTimer, timer);
+}
+
+guint
+filetea_timer_wheel_get_size (FileteaTimerWheel *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TIMER_WHEEL (self), 0);
+
+  return self->priv->size;
+}
@@ -0,0 +1,73 @@
+/*
+ * filetea-timer-wheel.h
+ *
+ * FileTea, low-friction file sharing <http://filetea.net>
+ *
+ * Copyright (C) 2011-2014, Igalia S.L.
+ *
+ * Authors:
+ *   Eduardo Lima Mitev <elima@igalia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Affero General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Affero General Public License at http://www.gnu.org/licenses/agpl.html
+ * for more details.
+ */
+
+
+#ifndef __FILETEA_TIMER_WHEEL_H__
+#define __FILETEA_TIMER_WHEEL_H__
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _FileteaTimerWheel FileteaTimerWheel;
+typedef struct _FileteaTimerWheelClass FileteaTimerWheelClass;
+typedef struct _FileteaTimerWheelPrivate FileteaTimerWheelPrivate;
+
+typedef struct _FileteaTimer FileteaTimer;
+
+struct _FileteaTimerWheel
+{
+  GObject parent;
+
+  FileteaTimerWheelPrivate *priv;
+};
+
+struct _FileteaTimerWheelClass
+{
+  GObjectClass parent_class;
+};
+
+#define FILETEA_TYPE_TIMER_WHEEL           (filetea_timer_wheel_get_type ())
+#define FILETEA_TIMER_WHEEL(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_TIMER_WHEEL, FileteaTimerWheel))
+#define FILETEA_TIMER_WHEEL_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_TIMER_WHEEL, FileteaTimerWheelClass))
+#define FILETEA_IS_TIMER_WHEEL(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), FILETEA_TYPE_TIMER_WHEEL))
+#define FILETEA_IS_TIMER_WHEEL_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), FILETEA_TYPE_TIMER_WHEEL))
+#define FILETEA_TIMER_WHEEL_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), FILETEA_TYPE_TIMER_WHEEL, FileteaTimerWheelClass))
+
+
+GType               filetea_timer_wheel_get_type     (void) G_GNUC_CONST;
+
+FileteaTimerWheel * filetea_timer_wheel_new          (guint resolution,
+                                                      guint n_slots);
+
+FileteaTimer *      filetea_timer_wheel_add          (FileteaTimerWheel *self,
+                                                      guint              timeout,
+                                                      GSourceFunc        func,
+                                                      gpointer           user_data);
+void                filetea_timer_wheel_cancel       (FileteaTimerWheel *self,
+                                                      FileteaTimer      *timer);
+
+guint               filetea_timer_wheel_get_size     (FileteaTimerWheel *self);
+
+G_END_DECLS
+
+#endif /* __FILETEA_TIMER_WHEEL_H__ */
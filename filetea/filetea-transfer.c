@@ -20,6 +20,25 @@
  * for more details.
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef HAVE_SPLICE
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #include "filetea-transfer.h"
 
 G_DEFINE_TYPE (FileteaTransfer, filetea_transfer, G_TYPE_OBJECT)
@@ -28,10 +47,59 @@ G_DEFINE_TYPE (FileteaTransfer, filetea_transfer, G_TYPE_OBJECT)
                                            FILETEA_TYPE_TRANSFER, \
                                            FileteaTransferPrivate))
 
-#define BLOCK_SIZE 0x4000
+#define DEFAULT_BLOCK_SIZE     0x4000
+#define DEFAULT_MIN_BLOCK_SIZE 0x1000
+#define DEFAULT_MAX_BLOCK_SIZE 0x40000
+
+#define DEFAULT_RING_DEPTH 4
+
+#define SPLICE_BLOCK_SIZE 0x10000
+
+/* content from files is sent with sendfile() where splice() is also used */
+#if defined (HAVE_SPLICE) && defined (HAVE_SENDFILE) && defined (HAVE_SYS_SENDFILE_H)
+#define USE_SENDFILE 1
+#endif
 
 #define START_TIMEOUT 30000 /* in miliseconds */
 
+/* how often the target of an active transfer is checked for stalls, and
+   the period over which its bandwidth is averaged */
+#define STALL_CHECK_INTERVAL 5000  /* in miliseconds */
+#define STALL_WINDOW         30000 /* in miliseconds */
+
+#define MULTIPART_CLOSE_FMT "\r\n--%s--\r\n"
+
+/* content of a segment read ahead of its turn */
+#define SEGMENT_BUFFER_SIZE 0x40000
+
+/* weight of the last sample in the relay latency average */
+#define LATENCY_WEIGHT 0.125
+
+typedef struct
+{
+  gchar *buf;
+  gsize size;
+  gsize len;
+  gint64 time;
+} RingSlot;
+
+typedef struct
+{
+  EvdHttpConnection *conn;
+  gsize start;
+  gsize end;
+  gchar *buf;
+  gsize buf_size;
+  gsize len;
+  gboolean reading;
+} Segment;
+
+typedef struct
+{
+  FileteaTransferTeeFunc func;
+  gpointer user_data;
+} Tee;
+
 /* private data */
 struct _FileteaTransferPrivate
 {
@@ -47,18 +115,92 @@ struct _FileteaTransferPrivate
 
   gchar *action;
   gboolean is_chunked;
-  SoupRange byte_range;
+  SoupRange *byte_ranges;
+  guint n_ranges;
+
+  /* content of unknown size, relayed until the seeder ends its push */
+  gboolean live;
+
+  /* content pushed over several connections in parallel, relayed one
+     segment after the other */
+  Segment *segments;
+  guint n_segments;
+  guint segment;
+  gint64 start_time;
+
+  /* latency matters more than throughput, see filetea_transfer_read() */
+  gboolean real_time;
+  gboolean flushing_block;
+  gboolean flush_pending;
+  gsize dropped;
+  gdouble latency_avg;
+  gint64 latency_max;
+
+  /* multipart/byteranges framing, for more than one range */
+  gchar *boundary;
+  guint part;
+  gsize part_offset;
+
+  FileteaBufferPool *buffer_pool;
+  RingSlot *ring;
+  guint ring_depth;
+  guint ring_head;
+  guint ring_count;
+  gboolean reading;
+  gboolean source_locked;
+
+  gsize block_size;
+  gsize min_block_size;
+  gsize max_block_size;
 
-  gchar *buf;
   gsize transfer_len;
+  gsize received;
   gsize transferred;
   gdouble bandwidth;
 
+  gdouble max_bw_in;
+  gdouble max_bw_out;
+
+  gboolean zero_copy;
+  gboolean splicing;
+  gint pipe_fds[2];
+  gsize pipe_len;
+  GSource *splice_src;
+  gint64 bw_last_time;
+  gsize bw_last_transferred;
+
+  GSList *tees;
+
+  gint file_fd;
+
+  FileteaTransferPullFunc pull_func;
+  gpointer pull_user_data;
+  gboolean headers_sent;
+
+  FileteaTransferResumeFunc resume_func;
+  gpointer resume_user_data;
+  guint resume_timeout;
+
+  /* the push of a transfer dropped by its target is stopped, not closed */
+  FileteaTransferAbortFunc abort_func;
+  gpointer abort_user_data;
+  gsize source_offset;
+
   GSimpleAsyncResult *result;
 
   gboolean download;
 
-  guint timeout_src_id;
+  FileteaTimerWheel *timer_wheel;
+  FileteaTimer *timeout;
+
+  /* a target that doesn't take content is dropped after a while */
+  guint idle_timeout;
+  gdouble min_bandwidth;
+  FileteaTimer *stall_check;
+  gint64 progress_time;
+  gsize progress_transferred;
+  gint64 window_time;
+  gsize window_transferred;
 };
 
 static void     filetea_transfer_class_init         (FileteaTransferClass *class);
@@ -72,10 +214,26 @@ static void     target_connection_on_close          (EvdHttpConnection *conn,
                                                      gpointer           user_data);
 static void     source_connection_on_close          (EvdHttpConnection *conn,
                                                      gpointer           user_data);
+static void     segment_connection_on_close         (EvdHttpConnection *conn,
+                                                     gpointer           user_data);
+static void     filetea_transfer_segment_free_buf   (FileteaTransfer *self,
+                                                     Segment         *seg);
 
 static void     filetea_transfer_read               (FileteaTransfer *self);
+static void     filetea_transfer_ring_free          (FileteaTransfer *self);
 static void     filetea_transfer_flush_target       (FileteaTransfer *self);
 static void     filetea_transfer_complete           (FileteaTransfer *self);
+static gboolean filetea_transfer_drain              (FileteaTransfer *self);
+static void     filetea_transfer_segment_fetch      (FileteaTransfer *self,
+                                                     Segment         *seg);
+
+static gboolean filetea_transfer_can_splice         (FileteaTransfer *self);
+static void     filetea_transfer_splice_stop        (FileteaTransfer *self);
+static void     filetea_transfer_send_file          (FileteaTransfer *self);
+
+static gboolean on_transfer_start_timeout           (gpointer user_data);
+static void     filetea_transfer_clear_timeout      (FileteaTransfer *self);
+static void     filetea_transfer_stall_check_stop   (FileteaTransfer *self);
 
 static void
 filetea_transfer_class_init (FileteaTransferClass *class)
@@ -96,13 +254,61 @@ filetea_transfer_init (FileteaTransfer *self)
   priv = FILETEA_TRANSFER_GET_PRIVATE (self);
   self->priv = priv;
 
-  priv->timeout_src_id = 0;
+  priv->timer_wheel = NULL;
+  priv->timeout = NULL;
+
+  priv->idle_timeout = 0;
+  priv->min_bandwidth = 0.0;
+  priv->stall_check = NULL;
+
+  priv->buffer_pool = NULL;
+  priv->ring = NULL;
+  priv->ring_depth = DEFAULT_RING_DEPTH;
+  priv->ring_head = 0;
+  priv->ring_count = 0;
+  priv->reading = FALSE;
+  priv->source_locked = FALSE;
+
+  priv->max_bw_in = 0.0;
+  priv->max_bw_out = 0.0;
+
+  priv->block_size = DEFAULT_BLOCK_SIZE;
+  priv->min_block_size = DEFAULT_MIN_BLOCK_SIZE;
+  priv->max_block_size = DEFAULT_MAX_BLOCK_SIZE;
+
+  priv->zero_copy = TRUE;
+  priv->splicing = FALSE;
+  priv->pipe_fds[0] = -1;
+  priv->pipe_fds[1] = -1;
+  priv->pipe_len = 0;
+  priv->splice_src = NULL;
+
+  priv->tees = NULL;
+
+  priv->resume_func = NULL;
+  priv->resume_timeout = START_TIMEOUT;
+
+  priv->abort_func = NULL;
+  priv->source_offset = 0;
+
+  priv->byte_ranges = NULL;
+  priv->n_ranges = 0;
+  priv->boundary = NULL;
+  priv->part = 0;
+  priv->part_offset = 0;
+
+  priv->file_fd = -1;
+  priv->pull_func = NULL;
+  priv->headers_sent = FALSE;
 }
 
 static void
 filetea_transfer_dispose (GObject *obj)
 {
   FileteaTransfer *self = FILETEA_TRANSFER (obj);
+  guint i;
+
+  filetea_transfer_splice_stop (self);
 
   if (self->priv->source != NULL)
     {
@@ -134,6 +340,20 @@ filetea_transfer_dispose (GObject *obj)
       self->priv->target_peer = NULL;
     }
 
+  for (i = 0; i < self->priv->n_segments; i++)
+    {
+      Segment *seg = &self->priv->segments[i];
+
+      if (seg->conn == NULL)
+        continue;
+
+      g_signal_handlers_disconnect_by_func (seg->conn,
+                                            segment_connection_on_close,
+                                            self);
+      g_object_unref (seg->conn);
+      seg->conn = NULL;
+    }
+
   G_OBJECT_CLASS (filetea_transfer_parent_class)->dispose (obj);
 }
 
@@ -141,21 +361,47 @@ static void
 filetea_transfer_finalize (GObject *obj)
 {
   FileteaTransfer *self = FILETEA_TRANSFER (obj);
+  guint i;
 
   g_free (self->priv->id);
   g_free (self->priv->action);
+  g_free (self->priv->byte_ranges);
+  g_free (self->priv->boundary);
+
+  filetea_transfer_ring_free (self);
 
-  if (self->priv->buf != NULL)
-    g_slice_free1 (BLOCK_SIZE, self->priv->buf);
+  for (i = 0; i < self->priv->n_segments; i++)
+    filetea_transfer_segment_free_buf (self, &self->priv->segments[i]);
+  g_free (self->priv->segments);
+
+  if (self->priv->buffer_pool != NULL)
+    g_object_unref (self->priv->buffer_pool);
+
+  while (self->priv->tees != NULL)
+    {
+      g_slice_free (Tee, self->priv->tees->data);
+      self->priv->tees = g_slist_delete_link (self->priv->tees,
+                                              self->priv->tees);
+    }
 
   if (self->priv->cancellable != NULL)
     g_object_unref (self->priv->cancellable);
 
-  if (self->priv->timeout_src_id != 0)
+  filetea_transfer_clear_timeout (self);
+  filetea_transfer_stall_check_stop (self);
+  if (self->priv->timer_wheel != NULL)
+    g_object_unref (self->priv->timer_wheel);
+
+  if (self->priv->file_fd != -1)
+    close (self->priv->file_fd);
+
+#ifdef HAVE_SPLICE
+  if (self->priv->pipe_fds[0] != -1)
     {
-      g_source_remove (self->priv->timeout_src_id);
-      self->priv->timeout_src_id = 0;
+      close (self->priv->pipe_fds[0]);
+      close (self->priv->pipe_fds[1]);
     }
+#endif
 
   g_object_unref (self->priv->web_service);
 
@@ -178,241 +424,2369 @@ target_connection_on_close (EvdHttpConnection *conn, gpointer user_data)
 }
 
 static void
-source_connection_on_close (EvdHttpConnection *conn, gpointer user_data)
+filetea_transfer_clear_timeout (FileteaTransfer *self)
 {
-  FileteaTransfer *self = user_data;
+  if (self->priv->timeout == NULL)
+    return;
 
-  g_simple_async_result_set_error (self->priv->result,
-                                   G_IO_ERROR,
-                                   G_IO_ERROR_CLOSED,
-                                   "Source connection dropped");
+  filetea_timer_wheel_cancel (self->priv->timer_wheel, self->priv->timeout);
+  self->priv->timeout = NULL;
+}
 
-  self->priv->status = FILETEA_TRANSFER_STATUS_SOURCE_ABORTED;
+/* deadlines of all transfers share the node's timer wheel */
+static void
+filetea_transfer_set_timeout (FileteaTransfer *self, guint timeout)
+{
+  filetea_transfer_clear_timeout (self);
 
-  filetea_transfer_complete (self);
+  self->priv->timeout = filetea_timer_wheel_add (self->priv->timer_wheel,
+                                                 timeout,
+                                                 on_transfer_start_timeout,
+                                                 self);
 }
 
-static void
-filetea_transfer_on_target_can_write (EvdConnection *target_conn,
-                                      gpointer       user_data)
+/* whether content is held back because the target doesn't take it. Fed
+   transfers are left to their fanout, which drops readers falling behind */
+static gboolean
+filetea_transfer_target_is_behind (FileteaTransfer *self)
 {
-  FileteaTransfer *self = user_data;
+  if (self->priv->pull_func != NULL)
+    return FALSE;
+
+  if (self->priv->file_fd != -1)
+    return TRUE;
 
-  evd_connection_unlock_close (EVD_CONNECTION (self->priv->source_conn));
-  filetea_transfer_read (self);
+#ifdef HAVE_SPLICE
+  if (self->priv->pipe_len > 0)
+    return TRUE;
+#endif
+
+  return self->priv->ring_count > 0 || self->priv->source_locked;
 }
 
 static void
-filetea_transfer_on_read (GObject      *obj,
-                          GAsyncResult *res,
-                          gpointer      user_data)
+filetea_transfer_stall_reset (FileteaTransfer *self, gint64 now)
 {
-  FileteaTransfer *self = user_data;
-  gssize size;
-  GError *error = NULL;
-  EvdStreamThrottle *throttle;
-
-  size = g_input_stream_read_finish (G_INPUT_STREAM (obj), res, &error);
-  if (size < 0)
-    {
-      g_printerr ("ERROR reading from source: %s\n", error->message);
+  self->priv->progress_time = now;
+  self->priv->progress_transferred = self->priv->transferred;
+  self->priv->window_time = now;
+  self->priv->window_transferred = self->priv->transferred;
+}
 
-      g_simple_async_result_take_error (self->priv->result, error);
-      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
-      filetea_transfer_complete (self);
-      goto out;
-    }
+static void
+filetea_transfer_stall (FileteaTransfer *self, const gchar *reason)
+{
+  if (self->priv->result != NULL)
+    g_simple_async_result_set_error (self->priv->result,
+                                     G_IO_ERROR,
+                                     G_IO_ERROR_TIMED_OUT,
+                                     "%s",
+                                     reason);
+
+  /* closing the source connection stops the seeder's push */
+  self->priv->status = FILETEA_TRANSFER_STATUS_STALLED;
+  filetea_transfer_complete (self);
+}
 
-  if (! evd_http_connection_write_content (self->priv->target_conn,
-                                           self->priv->buf,
-                                           size,
-                                           TRUE,
-                                           &error))
-    {
-      g_printerr ("ERROR writing to target: %s\n", error->message);
+static gboolean
+on_transfer_stall_check (gpointer user_data)
+{
+  FileteaTransfer *self = FILETEA_TRANSFER (user_data);
+  gint64 now;
 
-      g_simple_async_result_take_error (self->priv->result, error);
-      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
-      filetea_transfer_complete (self);
+  now = g_get_monotonic_time ();
 
-      goto out;
+  /* only time spent waiting on the target counts */
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE ||
+      ! filetea_transfer_target_is_behind (self))
+    {
+      filetea_transfer_stall_reset (self, now);
+      return TRUE;
     }
 
-  self->priv->transferred += size;
-
-  throttle =
-    evd_io_stream_get_input_throttle (EVD_IO_STREAM (self->priv->target_conn));
-  self->priv->bandwidth = evd_stream_throttle_get_actual_bandwidth (throttle);
+  if (self->priv->transferred != self->priv->progress_transferred)
+    {
+      self->priv->progress_time = now;
+      self->priv->progress_transferred = self->priv->transferred;
+    }
+  else if (self->priv->idle_timeout > 0 &&
+           now - self->priv->progress_time >=
+           (gint64) self->priv->idle_timeout * 1000)
+    {
+      self->priv->stall_check = NULL;
+      filetea_transfer_stall (self, "Target stopped reading");
+      return FALSE;
+    }
 
-  g_assert (self->priv->transferred <= self->priv->transfer_len);
-  if (self->priv->transferred == self->priv->transfer_len)
+  if (self->priv->min_bandwidth > 0.0 &&
+      now - self->priv->window_time >= STALL_WINDOW * 1000)
     {
-      /* finished reading, send HTTP response to source */
-      g_signal_handlers_disconnect_by_func (self->priv->source_conn,
-                                            source_connection_on_close,
-                                            self);
+      gdouble bandwidth;
 
-      if (! evd_web_service_respond (self->priv->web_service,
-                                     self->priv->source_conn,
-                                     SOUP_STATUS_OK,
-                                     NULL,
-                                     NULL,
-                                     0,
-                                     &error))
+      /* in kilobytes per second, like bandwidth limits */
+      bandwidth =
+        (self->priv->transferred - self->priv->window_transferred) / 1024.0 /
+        ((now - self->priv->window_time) / 1000000.0);
+
+      if (bandwidth < self->priv->min_bandwidth)
         {
-          g_printerr ("Error sending response to source: %s\n", error->message);
-          g_error_free (error);
-          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          self->priv->stall_check = NULL;
+          filetea_transfer_stall (self, "Target too slow");
+          return FALSE;
         }
 
-      filetea_transfer_flush_target (self);
+      self->priv->window_time = now;
+      self->priv->window_transferred = self->priv->transferred;
     }
-  else
+
+  return TRUE;
+}
+
+static void
+filetea_transfer_stall_check_start (FileteaTransfer *self)
+{
+  if (self->priv->stall_check != NULL ||
+      (self->priv->idle_timeout == 0 && self->priv->min_bandwidth <= 0.0))
     {
-      filetea_transfer_read (self);
+      return;
     }
 
- out:
-  g_object_unref (self);
+  filetea_transfer_stall_reset (self, g_get_monotonic_time ());
+
+  self->priv->stall_check =
+    filetea_timer_wheel_add (self->priv->timer_wheel,
+                             STALL_CHECK_INTERVAL,
+                             on_transfer_stall_check,
+                             self);
 }
 
 static void
-filetea_transfer_read (FileteaTransfer *self)
+filetea_transfer_stall_check_stop (FileteaTransfer *self)
 {
-  GInputStream *stream;
+  if (self->priv->stall_check == NULL)
+    return;
 
-  stream = g_io_stream_get_input_stream (G_IO_STREAM (self->priv->source_conn));
+  filetea_timer_wheel_cancel (self->priv->timer_wheel,
+                              self->priv->stall_check);
+  self->priv->stall_check = NULL;
+}
 
-  if (g_input_stream_has_pending (stream))
+/* detaches a dropped source connection and asks for the rest of the
+   content to be pushed again. Returns %FALSE if the transfer can't wait
+   for it */
+static gboolean
+filetea_transfer_hold (FileteaTransfer *self)
+{
+  /* the rest of a split transfer is already being pushed */
+  if (self->priv->resume_func == NULL ||
+      self->priv->segments != NULL ||
+      (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE &&
+       self->priv->status != FILETEA_TRANSFER_STATUS_PAUSED))
     {
-      g_warning ("has pending\n");
-      return;
+      return FALSE;
     }
 
-  if (evd_connection_get_max_writable (EVD_CONNECTION (self->priv->target_conn)) > 0)
+  filetea_transfer_splice_stop (self);
+
+#ifdef HAVE_SPLICE
+  /* content in the pipe was never accounted as received, it is pushed
+     again with the rest */
+  if (self->priv->pipe_len > 0)
     {
-      gssize size;
+      close (self->priv->pipe_fds[0]);
+      close (self->priv->pipe_fds[1]);
+      self->priv->pipe_fds[0] = -1;
+      self->priv->pipe_fds[1] = -1;
+      self->priv->pipe_len = 0;
+    }
+#endif
 
-      size = MIN (BLOCK_SIZE,
-                  filetea_source_get_size (self->priv->source) - self->priv->transferred);
-      if (size <= 0)
-        return;
+  g_signal_handlers_disconnect_by_func (self->priv->source_conn,
+                                        source_connection_on_close,
+                                        self);
+  if (self->priv->source_locked)
+    {
+      evd_connection_unlock_close (EVD_CONNECTION (self->priv->source_conn));
+      self->priv->source_locked = FALSE;
+    }
 
-      g_object_ref (self);
-      g_input_stream_read_async (stream,
-                                 self->priv->buf,
-                                 (gsize) size,
-                                 G_PRIORITY_DEFAULT,
-                                 NULL,
-                                 filetea_transfer_on_read,
-                                 self);
+  g_object_unref (self->priv->source_conn);
+  self->priv->source_conn = NULL;
+
+  /* everything was read already, only the target is left */
+  if (self->priv->received == self->priv->transfer_len)
+    return TRUE;
+
+  if (! self->priv->resume_func (self,
+                                 self->priv->received,
+                                 self->priv->resume_user_data))
+    {
+      return FALSE;
     }
-  else
+
+  /* content in the ring keeps flowing to the target meanwhile */
+  filetea_transfer_set_timeout (self, self->priv->resume_timeout);
+
+  return TRUE;
+}
+
+/* the seeder ends the push of a live source by closing it, whatever was
+   received until then is the whole content */
+static void
+filetea_transfer_end_live (FileteaTransfer *self)
+{
+  g_signal_handlers_disconnect_by_func (self->priv->source_conn,
+                                        source_connection_on_close,
+                                        self);
+  if (self->priv->source_locked)
     {
-      evd_connection_lock_close (EVD_CONNECTION (self->priv->source_conn));
+      evd_connection_unlock_close (EVD_CONNECTION (self->priv->source_conn));
+      self->priv->source_locked = FALSE;
     }
+
+  g_object_unref (self->priv->source_conn);
+  self->priv->source_conn = NULL;
+
+  self->priv->transfer_len = self->priv->received - self->priv->dropped;
+
+  filetea_transfer_drain (self);
 }
 
 static void
-filetea_transfer_on_target_flushed (GObject      *obj,
-                                    GAsyncResult *res,
-                                    gpointer      user_data)
+source_connection_on_close (EvdHttpConnection *conn, gpointer user_data)
 {
   FileteaTransfer *self = user_data;
-  GError *error = NULL;
 
-  if (! g_output_stream_flush_finish (G_OUTPUT_STREAM (obj), res, &error))
+  if (self->priv->live &&
+      (self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE ||
+       self->priv->status == FILETEA_TRANSFER_STATUS_PAUSED))
     {
-      /* if the stream was closed during flush it is not exactly an error,
-         since it can be expected depending on how fast the target closed
-         the connection after receiving all the body content */
-      if (error->code != G_IO_ERROR_CLOSED)
-        {
-          g_printerr ("ERROR flushing target: %s\n", error->message);
-          g_error_free (error);
-        }
+      filetea_transfer_end_live (self);
+      return;
     }
 
-  self->priv->status = FILETEA_TRANSFER_STATUS_COMPLETED;
+  /* the transfer can outlive the source connection if the seeder comes
+     back in time */
+  if (filetea_transfer_hold (self))
+    return;
 
-  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
-                                        filetea_transfer_on_target_can_write,
-                                        self);
+  g_simple_async_result_set_error (self->priv->result,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_CLOSED,
+                                   "Source connection dropped");
 
-  filetea_transfer_complete (self);
+  self->priv->status = FILETEA_TRANSFER_STATUS_SOURCE_ABORTED;
 
-  g_object_unref (self);
+  filetea_transfer_complete (self);
 }
 
 static void
-filetea_transfer_flush_target (FileteaTransfer *self)
+filetea_transfer_ring_slot_release (FileteaTransfer *self, RingSlot *slot)
 {
-  GOutputStream *stream;
-
-  stream = g_io_stream_get_output_stream (G_IO_STREAM (self->priv->target_conn));
+  if (slot->buf == NULL)
+    return;
 
-  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
-                                        target_connection_on_close,
-                                        self);
+  if (self->priv->buffer_pool != NULL)
+    filetea_buffer_pool_free (self->priv->buffer_pool, slot->buf, slot->size);
+  else
+    g_slice_free1 (slot->size, slot->buf);
 
-  g_object_ref (self);
-  g_output_stream_flush_async (stream,
-                               G_PRIORITY_DEFAULT,
-                               NULL,
-                               filetea_transfer_on_target_flushed,
-                               self);
+  slot->buf = NULL;
 }
 
-static void
-filetea_transfer_complete (FileteaTransfer *self)
+/* returns the buffer of ring slot @index, with room for @size bytes. If
+   relay memory is short, @size is reduced to what the slot already has,
+   or %NULL is returned if the slot has nothing and other slots are in use */
+static gchar *
+filetea_transfer_ring_get_buf (FileteaTransfer *self,
+                               guint            index,
+                               gsize           *size)
 {
-  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
-                                        target_connection_on_close,
-                                        self);
-  if (self->priv->source_conn != NULL)
-    {
-      g_signal_handlers_disconnect_by_func (self->priv->source_conn,
-                                            source_connection_on_close,
-                                            self);
+  RingSlot *slot;
+  gchar *buf;
+  gsize buf_size;
 
-      if (self->priv->status != FILETEA_TRANSFER_STATUS_COMPLETED &&
-          ! g_io_stream_is_closed (G_IO_STREAM (self->priv->source_conn)))
+  slot = &self->priv->ring[index];
+
+  if (slot->buf != NULL && slot->size >= *size)
+    return slot->buf;
+
+  buf_size = *size;
+  if (self->priv->buffer_pool == NULL)
+    buf = g_slice_alloc (buf_size);
+  else
+    buf = filetea_buffer_pool_alloc (self->priv->buffer_pool, &buf_size, FALSE);
+
+  if (buf == NULL)
+    {
+      if (slot->buf != NULL)
         {
-          g_io_stream_close (G_IO_STREAM (self->priv->source_conn), NULL, NULL);
+          *size = slot->size;
+          return slot->buf;
         }
-    }
 
-  if (self->priv->status != FILETEA_TRANSFER_STATUS_COMPLETED &&
-      ! g_io_stream_is_closed (G_IO_STREAM (self->priv->target_conn)))
-    {
-      g_io_stream_close (G_IO_STREAM (self->priv->target_conn), NULL, NULL);
-    }
+      /* wait for the target to drain other slots */
+      if (self->priv->ring_count > 0)
+        return NULL;
 
-  if (self->priv->result != NULL)
-    {
-      g_simple_async_result_complete_in_idle (self->priv->result);
-      g_object_unref (self->priv->result);
-      self->priv->result = NULL;
+      /* an admitted transfer must always be able to progress */
+      buf_size = MIN (*size, self->priv->min_block_size);
+      buf = filetea_buffer_pool_alloc (self->priv->buffer_pool, &buf_size, TRUE);
+      *size = buf_size;
     }
+
+  filetea_transfer_ring_slot_release (self, slot);
+
+  slot->buf = buf;
+  slot->size = buf_size;
+
+  return slot->buf;
 }
 
-static gboolean
-on_transfer_start_timeout (gpointer user_data)
+/* gives back the buffers of ring slots holding no content */
+static void
+filetea_transfer_ring_release_idle (FileteaTransfer *self)
 {
-  FileteaTransfer *self = FILETEA_TRANSFER (user_data);
+  guint i;
 
-  self->priv->timeout_src_id = 0;
+  if (self->priv->ring == NULL)
+    return;
 
-  if (self->priv->result != NULL)
+  /* the slot after the last one holding content is being read into */
+  i = self->priv->ring_count;
+  if (self->priv->reading)
+    i++;
+
+  for (; i<self->priv->ring_depth; i++)
+    {
+      guint index;
+
+      index = (self->priv->ring_head + i) % self->priv->ring_depth;
+      filetea_transfer_ring_slot_release (self, &self->priv->ring[index]);
+    }
+}
+
+static void
+filetea_transfer_ring_free (FileteaTransfer *self)
+{
+  guint i;
+
+  if (self->priv->ring == NULL)
+    return;
+
+  for (i=0; i<self->priv->ring_depth; i++)
+    filetea_transfer_ring_slot_release (self, &self->priv->ring[i]);
+
+  g_free (self->priv->ring);
+  self->priv->ring = NULL;
+}
+
+/* a push can come through a listener other than the target's, and must be
+   answered on its own */
+static EvdWebService *
+filetea_transfer_get_conn_web_service (FileteaTransfer   *self,
+                                       EvdHttpConnection *conn)
+{
+  EvdWebService *web_service;
+
+  web_service = g_object_get_data (G_OBJECT (conn),
+                                   FILETEA_TRANSFER_WEB_SERVICE_KEY);
+  if (web_service == NULL)
+    web_service = self->priv->web_service;
+
+  return web_service;
+}
+
+static void
+filetea_transfer_body_done (FileteaTransfer *self)
+{
+  GError *error = NULL;
+
+  /* a live stream is closed with the last chunk */
+  if (self->priv->live &&
+      ! evd_http_connection_write_content (self->priv->target_conn,
+                                           NULL,
+                                           0,
+                                           FALSE,
+                                           &error))
+    {
+      g_printerr ("Error ending live transfer: %s\n", error->message);
+      g_clear_error (&error);
+    }
+
+  /* the source could have dropped after sending the last bytes */
+  if (self->priv->source_conn == NULL)
+    {
+      filetea_transfer_flush_target (self);
+      return;
+    }
+
+  /* finished reading, send HTTP response to source */
+  g_signal_handlers_disconnect_by_func (self->priv->source_conn,
+                                        source_connection_on_close,
+                                        self);
+
+  if (! evd_web_service_respond (filetea_transfer_get_conn_web_service (self,
+                                                     self->priv->source_conn),
+                                 self->priv->source_conn,
+                                 SOUP_STATUS_OK,
+                                 NULL,
+                                 NULL,
+                                 0,
+                                 &error))
+    {
+      g_printerr ("Error sending response to source: %s\n", error->message);
+      g_error_free (error);
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+    }
+
+  filetea_transfer_flush_target (self);
+}
+
+static gboolean
+connection_is_throttled (EvdConnection *conn)
+{
+  EvdStreamThrottle *throttles[4] = { NULL, };
+  EvdIoStreamGroup *group;
+  gboolean result = FALSE;
+  gint i;
+
+  throttles[0] = evd_io_stream_get_input_throttle (EVD_IO_STREAM (conn));
+  throttles[1] = evd_io_stream_get_output_throttle (EVD_IO_STREAM (conn));
+
+  group = evd_io_stream_get_group (EVD_IO_STREAM (conn));
+  if (group != NULL)
+    g_object_get (group,
+                  "input-throttle", &throttles[2],
+                  "output-throttle", &throttles[3],
+                  NULL);
+
+  for (i=0; i<4; i++)
+    {
+      gdouble bandwidth = 0.0;
+
+      if (throttles[i] == NULL)
+        continue;
+
+      g_object_get (throttles[i], "bandwidth", &bandwidth, NULL);
+      if (bandwidth > 0.0)
+        result = TRUE;
+    }
+
+  /* group throttles are returned with a new reference */
+  if (throttles[2] != NULL)
+    g_object_unref (throttles[2]);
+  if (throttles[3] != NULL)
+    g_object_unref (throttles[3]);
+
+  return result;
+}
+
+static void
+connection_set_bandwidth (EvdHttpConnection *conn,
+                          gdouble            bandwidth_in,
+                          gdouble            bandwidth_out)
+{
+  EvdStreamThrottle *throttle;
+
+  if (bandwidth_in >= 0.0)
+    {
+      throttle = evd_io_stream_get_input_throttle (EVD_IO_STREAM (conn));
+      g_object_set (throttle, "bandwidth", bandwidth_in, NULL);
+    }
+
+  if (bandwidth_out >= 0.0)
+    {
+      throttle = evd_io_stream_get_output_throttle (EVD_IO_STREAM (conn));
+      g_object_set (throttle, "bandwidth", bandwidth_out, NULL);
+    }
+}
+
+#ifdef HAVE_SPLICE
+
+static void     filetea_transfer_splice             (FileteaTransfer *self);
+
+static void
+filetea_transfer_update_bandwidth (FileteaTransfer *self)
+{
+  gint64 now;
+  gint64 elapsed;
+
+  now = g_get_monotonic_time ();
+  elapsed = now - self->priv->bw_last_time;
+  if (elapsed < G_USEC_PER_SEC)
+    return;
+
+  /* in kilobytes per second, as reported by stream throttles */
+  self->priv->bandwidth =
+    ((self->priv->transferred - self->priv->bw_last_transferred) / 1024.0) /
+    ((gdouble) elapsed / G_USEC_PER_SEC);
+
+  self->priv->bw_last_time = now;
+  self->priv->bw_last_transferred = self->priv->transferred;
+}
+
+static gint
+connection_get_fd (EvdHttpConnection *conn)
+{
+  EvdSocket *socket;
+
+  socket = evd_connection_get_socket (EVD_CONNECTION (conn));
+
+  return g_socket_get_fd (evd_socket_get_socket (socket));
+}
+
+static void
+connection_set_no_delay (EvdHttpConnection *conn)
+{
+  gint flag = 1;
+
+  /* not every connection is TCP, failing here is harmless */
+  setsockopt (connection_get_fd (conn),
+              IPPROTO_TCP,
+              TCP_NODELAY,
+              &flag,
+              sizeof (flag));
+}
+
+static gboolean
+filetea_transfer_splice_on_ready (GSocket      *socket,
+                                  GIOCondition  condition,
+                                  gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+
+  g_source_unref (self->priv->splice_src);
+  self->priv->splice_src = NULL;
+
+  g_object_ref (self);
+  if (self->priv->file_fd != -1)
+    filetea_transfer_send_file (self);
+  else
+    filetea_transfer_splice (self);
+  g_object_unref (self);
+
+  return FALSE;
+}
+
+static void
+filetea_transfer_splice_wait (FileteaTransfer   *self,
+                              EvdHttpConnection *conn,
+                              GIOCondition       condition)
+{
+  EvdSocket *socket;
+
+  socket = evd_connection_get_socket (EVD_CONNECTION (conn));
+
+  self->priv->splice_src =
+    g_socket_create_source (evd_socket_get_socket (socket), condition, NULL);
+  g_source_set_callback (self->priv->splice_src,
+                         (GSourceFunc) filetea_transfer_splice_on_ready,
+                         self,
+                         NULL);
+  g_source_attach (self->priv->splice_src,
+                   g_main_context_get_thread_default ());
+}
+
+static void
+filetea_transfer_splice_error (FileteaTransfer *self, gint err_no)
+{
+  g_printerr ("ERROR relaying transfer: %s\n", g_strerror (err_no));
+
+  filetea_transfer_splice_stop (self);
+
+  if (self->priv->result != NULL)
+    g_simple_async_result_set_error (self->priv->result,
+                                     G_IO_ERROR,
+                                     g_io_error_from_errno (err_no),
+                                     "%s",
+                                     g_strerror (err_no));
+  self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+
+  filetea_transfer_complete (self);
+}
+
+static void
+filetea_transfer_splice (FileteaTransfer *self)
+{
+  gint source_fd;
+  gint target_fd;
+  gssize size;
+  gint err_no;
+
+  source_fd = connection_get_fd (self->priv->source_conn);
+  target_fd = connection_get_fd (self->priv->target_conn);
+
+  while (self->priv->splicing)
+    {
+      /* first, push whatever is in the pipe to the target */
+      if (self->priv->pipe_len > 0)
+        {
+          size = splice (self->priv->pipe_fds[0], NULL,
+                         target_fd, NULL,
+                         self->priv->pipe_len,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+          if (size < 0)
+            {
+              err_no = errno;
+              if (err_no == EINTR)
+                continue;
+
+              if (err_no == EAGAIN)
+                filetea_transfer_splice_wait (self,
+                                              self->priv->target_conn,
+                                              G_IO_OUT);
+              else
+                filetea_transfer_splice_error (self, err_no);
+
+              return;
+            }
+
+          self->priv->pipe_len -= size;
+          self->priv->transferred += size;
+          self->priv->received = self->priv->transferred;
+          filetea_transfer_update_bandwidth (self);
+
+          continue;
+        }
+
+      if (self->priv->transferred == self->priv->transfer_len)
+        {
+          filetea_transfer_splice_stop (self);
+          filetea_transfer_body_done (self);
+          return;
+        }
+
+      /* a throttle could have been set in the meantime */
+      if (! filetea_transfer_can_splice (self))
+        {
+          filetea_transfer_splice_stop (self);
+          filetea_transfer_read (self);
+          return;
+        }
+
+      /* then, fill the pipe from the source */
+      size = splice (source_fd, NULL,
+                     self->priv->pipe_fds[1], NULL,
+                     MIN (SPLICE_BLOCK_SIZE,
+                          self->priv->transfer_len - self->priv->transferred),
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (size < 0)
+        {
+          err_no = errno;
+          if (err_no == EINTR)
+            continue;
+
+          if (err_no == EAGAIN)
+            filetea_transfer_splice_wait (self,
+                                          self->priv->source_conn,
+                                          G_IO_IN);
+          else
+            filetea_transfer_splice_error (self, err_no);
+
+          return;
+        }
+      else if (size == 0)
+        {
+          /* source closed before sending all the content, closing the
+             connection triggers the regular abort path */
+          filetea_transfer_splice_stop (self);
+          g_io_stream_close (G_IO_STREAM (self->priv->source_conn), NULL, NULL);
+          return;
+        }
+      else
+        {
+          self->priv->pipe_len = size;
+        }
+    }
+}
+
+static void
+filetea_transfer_on_splice_target_flushed (GObject      *obj,
+                                           GAsyncResult *res,
+                                           gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+  GError *error = NULL;
+
+  if (! g_output_stream_flush_finish (G_OUTPUT_STREAM (obj), res, &error))
+    {
+      g_printerr ("ERROR flushing target: %s\n", error->message);
+
+      if (self->priv->result != NULL)
+        {
+          g_simple_async_result_take_error (self->priv->result, error);
+          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          filetea_transfer_complete (self);
+        }
+      else
+        {
+          g_error_free (error);
+        }
+    }
+  else if (self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE)
+    {
+      self->priv->splicing = TRUE;
+      self->priv->bw_last_time = g_get_monotonic_time ();
+      self->priv->bw_last_transferred = self->priv->transferred;
+
+      if (self->priv->file_fd != -1)
+        filetea_transfer_send_file (self);
+      else
+        filetea_transfer_splice (self);
+    }
+
+  g_object_unref (self);
+}
+
+#endif /* HAVE_SPLICE */
+
+/* maps a position in the content being transferred to an offset in the
+   source, and tells how much content is contiguous from there */
+static goffset
+filetea_transfer_get_source_offset (FileteaTransfer *self,
+                                    gsize            pos,
+                                    gsize           *len)
+{
+  guint i;
+
+  if (! self->priv->is_chunked)
+    {
+      *len = self->priv->transfer_len - pos;
+      return pos;
+    }
+
+  for (i = 0; i < self->priv->n_ranges; i++)
+    {
+      SoupRange *range = &self->priv->byte_ranges[i];
+      gsize range_len = range->end - range->start + 1;
+
+      if (pos < range_len)
+        {
+          *len = range_len - pos;
+          return range->start + pos;
+        }
+
+      pos -= range_len;
+    }
+
+  *len = 0;
+  return -1;
+}
+
+static gchar *
+filetea_transfer_get_part_headers (FileteaTransfer *self, guint part)
+{
+  SoupRange *range = &self->priv->byte_ranges[part];
+
+  return g_strdup_printf ("\r\n--%s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Range: bytes %" G_GINT64_FORMAT "-%"
+                          G_GINT64_FORMAT "/%" G_GSIZE_FORMAT "\r\n\r\n",
+                          self->priv->boundary,
+                          filetea_source_get_content_type (self->priv->source),
+                          (gint64) range->start,
+                          (gint64) range->end,
+                          filetea_source_get_size (self->priv->source));
+}
+
+/* writes content to the target, framing it in parts when more than one
+   range was requested */
+static gboolean
+filetea_transfer_write_content (FileteaTransfer  *self,
+                                const gchar      *buf,
+                                gsize             size,
+                                GError          **error)
+{
+  EvdHttpConnection *conn = self->priv->target_conn;
+
+  if (self->priv->boundary == NULL)
+    return evd_http_connection_write_content (conn, buf, size, TRUE, error);
+
+  while (size > 0)
+    {
+      SoupRange *range;
+      gsize part_len;
+      gsize len;
+
+      range = &self->priv->byte_ranges[self->priv->part];
+      part_len = range->end - range->start + 1;
+
+      if (self->priv->part_offset == 0)
+        {
+          gchar *part_headers;
+          gboolean result;
+
+          part_headers = filetea_transfer_get_part_headers (self,
+                                                            self->priv->part);
+          result = evd_http_connection_write_content (conn,
+                                                      part_headers,
+                                                      strlen (part_headers),
+                                                      TRUE,
+                                                      error);
+          g_free (part_headers);
+          if (! result)
+            return FALSE;
+        }
+
+      len = MIN (size, part_len - self->priv->part_offset);
+      if (! evd_http_connection_write_content (conn, buf, len, TRUE, error))
+        return FALSE;
+
+      buf += len;
+      size -= len;
+      self->priv->part_offset += len;
+
+      if (self->priv->part_offset < part_len)
+        continue;
+
+      self->priv->part++;
+      self->priv->part_offset = 0;
+
+      if (self->priv->part == self->priv->n_ranges)
+        {
+          gchar *closing;
+          gboolean result;
+
+          closing = g_strdup_printf (MULTIPART_CLOSE_FMT, self->priv->boundary);
+          result = evd_http_connection_write_content (conn,
+                                                      closing,
+                                                      strlen (closing),
+                                                      TRUE,
+                                                      error);
+          g_free (closing);
+
+          return result;
+        }
+    }
+
+  return TRUE;
+}
+
+static gboolean
+filetea_transfer_can_splice (FileteaTransfer *self)
+{
+#ifdef HAVE_SPLICE
+  EvdConnection *source_conn = EVD_CONNECTION (self->priv->source_conn);
+  EvdConnection *target_conn = EVD_CONNECTION (self->priv->target_conn);
+
+  /* tees need to see the data, and parts and chunks are framed in user
+     space */
+  if (self->priv->tees != NULL ||
+      self->priv->boundary != NULL ||
+      self->priv->segments != NULL ||
+      self->priv->live)
+    {
+      return FALSE;
+    }
+
+  /* the kernel can only relay bytes that need no encryption and that
+     don't have to be accounted by a stream throttle */
+  return self->priv->zero_copy &&
+    ! evd_connection_get_tls_active (source_conn) &&
+    ! evd_connection_get_tls_active (target_conn) &&
+    ! connection_is_throttled (source_conn) &&
+    ! connection_is_throttled (target_conn);
+#else
+  return FALSE;
+#endif
+}
+
+static gboolean
+filetea_transfer_splice_start (FileteaTransfer *self)
+{
+#ifdef HAVE_SPLICE
+  GInputStream *stream;
+  GOutputStream *target_stream;
+  gsize block_size;
+  gchar *buf;
+  gssize size;
+  GError *error = NULL;
+
+  if (self->priv->pipe_fds[0] == -1)
+    {
+#ifdef HAVE_PIPE2
+      if (pipe2 (self->priv->pipe_fds, O_NONBLOCK | O_CLOEXEC) != 0)
+#else
+      if (pipe (self->priv->pipe_fds) != 0 ||
+          fcntl (self->priv->pipe_fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+          fcntl (self->priv->pipe_fds[1], F_SETFL, O_NONBLOCK) != 0)
+#endif
+        {
+          g_printerr ("Failed to create relay pipe: %s\n", g_strerror (errno));
+
+          /* don't try again for this transfer */
+          self->priv->zero_copy = FALSE;
+          self->priv->pipe_fds[0] = -1;
+          self->priv->pipe_fds[1] = -1;
+          return FALSE;
+        }
+    }
+
+  /* content already buffered in user space by the source connection (e.g,
+     read together with the request headers) is relayed with a regular copy
+     before the kernel takes over */
+  stream = g_io_stream_get_input_stream (G_IO_STREAM (self->priv->source_conn));
+  do
+    {
+      block_size = MIN (self->priv->block_size,
+                        self->priv->transfer_len - self->priv->transferred);
+      if (block_size == 0)
+        break;
+
+      buf = filetea_transfer_ring_get_buf (self, 0, &block_size);
+      size = g_input_stream_read (stream,
+                                  buf,
+                                  block_size,
+                                  NULL,
+                                  &error);
+      if (size < 0)
+        {
+          if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WOULD_BLOCK))
+            {
+              g_printerr ("ERROR reading from source: %s\n", error->message);
+
+              g_simple_async_result_take_error (self->priv->result, error);
+              self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+              filetea_transfer_complete (self);
+              return TRUE;
+            }
+
+          g_clear_error (&error);
+          break;
+        }
+
+      if (size > 0 &&
+          ! filetea_transfer_write_content (self,
+                                            buf,
+                                            size,
+                                            &error))
+        {
+          g_printerr ("ERROR writing to target: %s\n", error->message);
+
+          g_simple_async_result_take_error (self->priv->result, error);
+          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          filetea_transfer_complete (self);
+          return TRUE;
+        }
+
+      self->priv->received += size;
+      self->priv->transferred += size;
+    }
+  while ((gsize) size == block_size);
+
+  if (self->priv->transferred == self->priv->transfer_len)
+    {
+      filetea_transfer_body_done (self);
+      return TRUE;
+    }
+
+  /* everything written so far must reach the target socket before writing
+     to it directly */
+  target_stream =
+    g_io_stream_get_output_stream (G_IO_STREAM (self->priv->target_conn));
+
+  g_object_ref (self);
+  g_output_stream_flush_async (target_stream,
+                               G_PRIORITY_DEFAULT,
+                               NULL,
+                               filetea_transfer_on_splice_target_flushed,
+                               self);
+
+  return TRUE;
+#else
+  return FALSE;
+#endif /* HAVE_SPLICE */
+}
+
+static void
+filetea_transfer_splice_stop (FileteaTransfer *self)
+{
+  self->priv->splicing = FALSE;
+
+  if (self->priv->splice_src != NULL)
+    {
+      g_source_destroy (self->priv->splice_src);
+      g_source_unref (self->priv->splice_src);
+      self->priv->splice_src = NULL;
+    }
+}
+
+#ifdef USE_SENDFILE
+static gboolean
+filetea_transfer_can_sendfile (FileteaTransfer *self)
+{
+  EvdConnection *target_conn = EVD_CONNECTION (self->priv->target_conn);
+
+  return self->priv->zero_copy &&
+    self->priv->boundary == NULL &&
+    ! evd_connection_get_tls_active (target_conn) &&
+    ! connection_is_throttled (target_conn);
+}
+#endif
+
+static void
+filetea_transfer_send_file (FileteaTransfer *self)
+{
+  GError *error = NULL;
+  gssize size;
+  gint err_no;
+
+  while (self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE &&
+         self->priv->transferred < self->priv->transfer_len)
+    {
+      goffset offset;
+      gsize len;
+      gchar *buf;
+
+      offset = filetea_transfer_get_source_offset (self,
+                                                   self->priv->transferred,
+                                                   &len);
+
+#ifdef USE_SENDFILE
+      /* a throttle could have been set in the meantime */
+      if (self->priv->splicing && ! filetea_transfer_can_sendfile (self))
+        filetea_transfer_splice_stop (self);
+
+      if (self->priv->splicing)
+        {
+          off_t file_pos = offset;
+
+          size = sendfile (connection_get_fd (self->priv->target_conn),
+                           self->priv->file_fd,
+                           &file_pos,
+                           MIN (SPLICE_BLOCK_SIZE, len));
+          if (size <= 0)
+            {
+              err_no = size < 0 ? errno : EIO;
+              if (err_no == EINTR)
+                continue;
+
+              if (err_no == EAGAIN)
+                filetea_transfer_splice_wait (self,
+                                              self->priv->target_conn,
+                                              G_IO_OUT);
+              else
+                filetea_transfer_splice_error (self, err_no);
+
+              return;
+            }
+
+          self->priv->transferred += size;
+          self->priv->received = self->priv->transferred;
+          filetea_transfer_update_bandwidth (self);
+
+          continue;
+        }
+#endif
+
+      len = MIN (len, self->priv->block_size);
+      len = MIN (len,
+           evd_connection_get_max_writable (EVD_CONNECTION (self->priv->target_conn)));
+
+      /* target is full, continue when it can take more */
+      if (len == 0)
+        return;
+
+      buf = filetea_transfer_ring_get_buf (self, 0, &len);
+
+      do
+        size = pread (self->priv->file_fd, buf, len, offset);
+      while (size < 0 && errno == EINTR);
+
+      if (size <= 0)
+        {
+          err_no = size < 0 ? errno : EIO;
+          g_printerr ("ERROR reading content from file: %s\n",
+                      g_strerror (err_no));
+
+          g_simple_async_result_set_error (self->priv->result,
+                                           G_IO_ERROR,
+                                           g_io_error_from_errno (err_no),
+                                           "%s",
+                                           g_strerror (err_no));
+          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          filetea_transfer_complete (self);
+
+          return;
+        }
+
+      if (! filetea_transfer_write_content (self,
+                                            buf,
+                                            size,
+                                            &error))
+        {
+          g_printerr ("ERROR writing to target: %s\n", error->message);
+
+          g_simple_async_result_take_error (self->priv->result, error);
+          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          filetea_transfer_complete (self);
+
+          return;
+        }
+
+      self->priv->transferred += size;
+      self->priv->received = self->priv->transferred;
+    }
+
+  if (self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE)
+    {
+      filetea_transfer_splice_stop (self);
+      filetea_transfer_flush_target (self);
+    }
+}
+
+static void
+filetea_transfer_on_block_flushed (GObject      *obj,
+                                   GAsyncResult *res,
+                                   gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+  GError *error = NULL;
+
+  self->priv->flushing_block = FALSE;
+
+  /* a dropped target aborts the transfer through its close handler */
+  if (! g_output_stream_flush_finish (G_OUTPUT_STREAM (obj), res, &error))
+    g_error_free (error);
+
+  if (self->priv->flush_pending)
+    {
+      self->priv->flush_pending = FALSE;
+      filetea_transfer_flush_target (self);
+    }
+
+  g_object_unref (self);
+}
+
+/* real-time content doesn't wait in buffers for more to come */
+static void
+filetea_transfer_flush_block (FileteaTransfer *self)
+{
+  GOutputStream *stream;
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (self->priv->target_conn));
+
+  if (self->priv->flushing_block || g_output_stream_has_pending (stream))
+    return;
+
+  self->priv->flushing_block = TRUE;
+
+  g_object_ref (self);
+  g_output_stream_flush_async (stream,
+                               G_PRIORITY_DEFAULT,
+                               NULL,
+                               filetea_transfer_on_block_flushed,
+                               self);
+}
+
+static void
+filetea_transfer_update_latency (FileteaTransfer *self, RingSlot *slot)
+{
+  gint64 latency;
+
+  latency = g_get_monotonic_time () - slot->time;
+
+  if (self->priv->latency_avg == 0.0)
+    self->priv->latency_avg = latency;
+  else
+    self->priv->latency_avg = (1.0 - LATENCY_WEIGHT) * self->priv->latency_avg +
+      LATENCY_WEIGHT * latency;
+
+  self->priv->latency_max = MAX (self->priv->latency_max, latency);
+}
+
+static gboolean
+filetea_transfer_drain (FileteaTransfer *self)
+{
+  GError *error = NULL;
+  EvdStreamThrottle *throttle;
+  gboolean written = FALSE;
+
+  while (self->priv->ring_count > 0 &&
+         evd_connection_get_max_writable (EVD_CONNECTION (self->priv->target_conn)) > 0)
+    {
+      RingSlot *slot;
+
+      slot = &self->priv->ring[self->priv->ring_head];
+
+      if (! filetea_transfer_write_content (self,
+                                            slot->buf,
+                                            slot->len,
+                                            &error))
+        {
+          g_printerr ("ERROR writing to target: %s\n", error->message);
+
+          g_simple_async_result_take_error (self->priv->result, error);
+          self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+          filetea_transfer_complete (self);
+
+          return FALSE;
+        }
+
+      self->priv->transferred += slot->len;
+      written = TRUE;
+
+      if (self->priv->real_time)
+        filetea_transfer_update_latency (self, slot);
+
+      self->priv->ring_head = (self->priv->ring_head + 1) % self->priv->ring_depth;
+      self->priv->ring_count--;
+    }
+
+  if (written && self->priv->real_time)
+    filetea_transfer_flush_block (self);
+
+  throttle =
+    evd_io_stream_get_input_throttle (EVD_IO_STREAM (self->priv->target_conn));
+  self->priv->bandwidth = evd_stream_throttle_get_actual_bandwidth (throttle);
+
+  g_assert (self->priv->transferred <= self->priv->transfer_len);
+  if (self->priv->transferred == self->priv->transfer_len)
+    {
+      filetea_transfer_body_done (self);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+filetea_transfer_on_target_can_write (EvdConnection *target_conn,
+                                      gpointer       user_data)
+{
+  FileteaTransfer *self = user_data;
+
+  /* the relay is in the kernel's hands */
+  if (self->priv->splicing)
+    return;
+
+  /* a paused transfer only writes out what it had already read */
+  if (self->priv->status == FILETEA_TRANSFER_STATUS_PAUSED)
+    {
+      if (self->priv->ring_count > 0 && filetea_transfer_drain (self))
+        filetea_transfer_ring_release_idle (self);
+      return;
+    }
+
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE)
+    return;
+
+  /* content is being fed by someone else */
+  if (self->priv->pull_func != NULL)
+    {
+      self->priv->pull_func (self, self->priv->pull_user_data);
+      return;
+    }
+
+  /* content is read from a file */
+  if (self->priv->file_fd != -1)
+    {
+      filetea_transfer_send_file (self);
+      return;
+    }
+
+  /* waiting for a source connection to take over, meanwhile write what
+     was already read */
+  if (self->priv->source_conn == NULL)
+    {
+      filetea_transfer_drain (self);
+      return;
+    }
+
+  if (self->priv->source_locked)
+    {
+      evd_connection_unlock_close (EVD_CONNECTION (self->priv->source_conn));
+      self->priv->source_locked = FALSE;
+    }
+
+  if (filetea_transfer_drain (self))
+    filetea_transfer_read (self);
+}
+
+static void
+filetea_transfer_on_read (GObject      *obj,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+  gssize size;
+  GError *error = NULL;
+
+  self->priv->reading = FALSE;
+
+  size = g_input_stream_read_finish (G_INPUT_STREAM (obj), res, &error);
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE &&
+      self->priv->status != FILETEA_TRANSFER_STATUS_PAUSED)
+    {
+      /* transfer was completed or aborted while reading */
+      if (error != NULL)
+        g_error_free (error);
+      goto out;
+    }
+
+  if (self->priv->source_conn == NULL ||
+      G_INPUT_STREAM (obj) !=
+      g_io_stream_get_input_stream (G_IO_STREAM (self->priv->source_conn)))
+    {
+      /* read from a source connection that was dropped, a new one could
+         be waiting for this read to finish */
+      if (error != NULL)
+        g_error_free (error);
+      if (self->priv->source_conn != NULL)
+        filetea_transfer_read (self);
+      goto out;
+    }
+
+  if (size < 0)
+    {
+      g_printerr ("ERROR reading from source: %s\n", error->message);
+
+      g_simple_async_result_take_error (self->priv->result, error);
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+      filetea_transfer_complete (self);
+      goto out;
+    }
+
+  /* end of a live stream */
+  if (size == 0 && self->priv->live)
+    {
+      filetea_transfer_end_live (self);
+      goto out;
+    }
+
+  /* queue the block in the ring */
+  if (size > 0)
+    {
+      guint tail;
+      RingSlot *slot;
+      EvdStreamThrottle *throttle;
+      GSList *node;
+
+      tail = (self->priv->ring_head + self->priv->ring_count) % self->priv->ring_depth;
+      slot = &self->priv->ring[tail];
+      slot->len = size;
+      slot->time = g_get_monotonic_time ();
+      self->priv->ring_count++;
+      self->priv->received += size;
+
+      /* adapt the size of next reads to how this transfer is doing */
+      throttle =
+        evd_io_stream_get_input_throttle (EVD_IO_STREAM (self->priv->source_conn));
+      self->priv->block_size =
+        filetea_transfer_adapt_block_size (self->priv->block_size,
+                   self->priv->min_block_size,
+                   self->priv->max_block_size,
+                   size,
+                   evd_connection_get_max_writable (EVD_CONNECTION (self->priv->target_conn)),
+                   evd_stream_throttle_get_actual_bandwidth (throttle),
+                   connection_is_throttled (EVD_CONNECTION (self->priv->source_conn)) ||
+                   connection_is_throttled (EVD_CONNECTION (self->priv->target_conn)));
+
+      node = self->priv->tees;
+      while (node != NULL)
+        {
+          Tee *tee = node->data;
+
+          /* a tee can remove itself */
+          node = node->next;
+
+          tee->func (self, slot->buf, size, tee->user_data);
+        }
+    }
+
+  if (! filetea_transfer_drain (self))
+    goto out;
+
+  /* the block was read while pausing, don't read any further */
+  if (self->priv->status == FILETEA_TRANSFER_STATUS_PAUSED)
+    {
+      filetea_transfer_ring_release_idle (self);
+      goto out;
+    }
+
+  /* kernel relay can only take over once the ring is empty */
+  if (self->priv->ring_count > 0 ||
+      ! filetea_transfer_can_splice (self) ||
+      ! filetea_transfer_splice_start (self))
+    {
+      filetea_transfer_read (self);
+    }
+
+ out:
+  g_object_unref (self);
+}
+
+static void
+filetea_transfer_segment_free_buf (FileteaTransfer *self, Segment *seg)
+{
+  if (seg->buf == NULL)
+    return;
+
+  if (self->priv->buffer_pool != NULL)
+    filetea_buffer_pool_free (self->priv->buffer_pool, seg->buf, seg->buf_size);
+  else
+    g_slice_free1 (seg->buf_size, seg->buf);
+
+  seg->buf = NULL;
+  seg->len = 0;
+}
+
+static Segment *
+filetea_transfer_find_segment (FileteaTransfer *self, GObject *obj)
+{
+  guint i;
+
+  for (i = 0; i < self->priv->n_segments; i++)
+    {
+      Segment *seg = &self->priv->segments[i];
+
+      if (seg->conn != NULL &&
+          (obj == G_OBJECT (seg->conn) ||
+           obj == G_OBJECT (g_io_stream_get_input_stream (G_IO_STREAM (seg->conn)))))
+        {
+          return seg;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+segment_connection_on_close (EvdHttpConnection *conn, gpointer user_data)
+{
+  FileteaTransfer *self = user_data;
+  Segment *seg;
+
+  seg = filetea_transfer_find_segment (self, G_OBJECT (conn));
+  g_assert (seg != NULL);
+
+  g_signal_handlers_disconnect_by_func (conn,
+                                        segment_connection_on_close,
+                                        self);
+
+  /* nothing was lost if the whole segment was read ahead */
+  if (seg->len == seg->end - seg->start)
+    {
+      g_object_unref (seg->conn);
+      seg->conn = NULL;
+      return;
+    }
+
+  g_simple_async_result_set_error (self->priv->result,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_CLOSED,
+                                   "Source connection dropped");
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_SOURCE_ABORTED;
+
+  filetea_transfer_complete (self);
+}
+
+static void
+filetea_transfer_on_segment_read (GObject      *obj,
+                                  GAsyncResult *res,
+                                  gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+  Segment *seg;
+  gssize size;
+  GError *error = NULL;
+
+  size = g_input_stream_read_finish (G_INPUT_STREAM (obj), res, &error);
+
+  seg = filetea_transfer_find_segment (self, obj);
+  if (seg == NULL)
+    {
+      if (error != NULL)
+        g_error_free (error);
+      goto out;
+    }
+
+  seg->reading = FALSE;
+
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_NOT_STARTED &&
+      self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE &&
+      self->priv->status != FILETEA_TRANSFER_STATUS_PAUSED)
+    {
+      /* transfer was completed or aborted while reading */
+      if (error != NULL)
+        g_error_free (error);
+      goto out;
+    }
+
+  if (size < 0)
+    {
+      g_printerr ("ERROR reading from source: %s\n", error->message);
+
+      g_simple_async_result_take_error (self->priv->result, error);
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+      filetea_transfer_complete (self);
+      goto out;
+    }
+
+  if (size == 0)
+    {
+      /* seeder ended the push early, closing the connection triggers the
+         regular abort path */
+      g_io_stream_close (G_IO_STREAM (seg->conn), NULL, NULL);
+      goto out;
+    }
+
+  seg->len += size;
+
+  /* the relay could be waiting for this segment to take over */
+  if (seg == &self->priv->segments[self->priv->segment + 1] &&
+      self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE)
+    {
+      filetea_transfer_read (self);
+    }
+
+  if (seg->conn != NULL)
+    filetea_transfer_segment_fetch (self, seg);
+
+ out:
+  g_object_unref (self);
+}
+
+/* reads the content of a segment whose turn has not come yet, until its
+   buffer is full */
+static void
+filetea_transfer_segment_fetch (FileteaTransfer *self, Segment *seg)
+{
+  GInputStream *stream;
+  gsize size;
+
+  if (seg->reading || seg->conn == NULL)
+    return;
+
+  if (seg->buf == NULL)
+    {
+      size = SEGMENT_BUFFER_SIZE;
+      if (self->priv->buffer_pool != NULL)
+        seg->buf = filetea_buffer_pool_alloc (self->priv->buffer_pool,
+                                              &size,
+                                              FALSE);
+      else
+        seg->buf = g_slice_alloc (size);
+
+      /* relay memory is short, the segment waits for its turn */
+      if (seg->buf == NULL)
+        return;
+
+      seg->buf_size = size;
+    }
+
+  size = MIN (seg->buf_size, seg->end - seg->start) - seg->len;
+  if (size == 0)
+    return;
+
+  seg->reading = TRUE;
+
+  stream = g_io_stream_get_input_stream (G_IO_STREAM (seg->conn));
+
+  g_object_ref (self);
+  g_input_stream_read_async (stream,
+                             seg->buf + seg->len,
+                             size,
+                             G_PRIORITY_DEFAULT,
+                             NULL,
+                             filetea_transfer_on_segment_read,
+                             self);
+}
+
+/* where the push currently being read from ends */
+static gsize
+filetea_transfer_get_push_end (FileteaTransfer *self)
+{
+  if (self->priv->segments == NULL)
+    return self->priv->transfer_len;
+
+  return self->priv->segments[self->priv->segment].end;
+}
+
+/* hands the relay over to the push of the next segment. Returns %FALSE if
+   it is not ready yet */
+static gboolean
+filetea_transfer_segment_next (FileteaTransfer *self)
+{
+  Segment *seg;
+  GError *error = NULL;
+
+  seg = &self->priv->segments[self->priv->segment + 1];
+
+  /* what was read ahead needs a slot in the ring, and the connection must
+     be free of reads */
+  if (self->priv->ring_count == self->priv->ring_depth || seg->reading)
+    return FALSE;
+
+  /* done with the push of the current segment */
+  if (self->priv->source_conn != NULL)
+    {
+      EvdHttpConnection *conn = self->priv->source_conn;
+
+      g_signal_handlers_disconnect_by_func (conn,
+                                            source_connection_on_close,
+                                            self);
+      if (self->priv->source_locked)
+        {
+          evd_connection_unlock_close (EVD_CONNECTION (conn));
+          self->priv->source_locked = FALSE;
+        }
+      self->priv->source_conn = NULL;
+
+      if (! evd_web_service_respond (filetea_transfer_get_conn_web_service (self,
+                                                                          conn),
+                                     conn,
+                                     SOUP_STATUS_OK,
+                                     NULL,
+                                     NULL,
+                                     0,
+                                     &error))
+        {
+          g_printerr ("Error sending response to source: %s\n", error->message);
+          g_clear_error (&error);
+        }
+
+      g_object_unref (conn);
+    }
+
+  self->priv->segment++;
+
+  if (seg->len > 0)
+    {
+      guint tail;
+      RingSlot *slot;
+      GSList *node;
+
+      /* the read-ahead buffer becomes a slot of the ring */
+      tail = (self->priv->ring_head + self->priv->ring_count) % self->priv->ring_depth;
+      slot = &self->priv->ring[tail];
+      filetea_transfer_ring_slot_release (self, slot);
+
+      slot->buf = seg->buf;
+      slot->size = seg->buf_size;
+      slot->len = seg->len;
+      slot->time = g_get_monotonic_time ();
+      self->priv->ring_count++;
+      self->priv->received += seg->len;
+
+      seg->buf = NULL;
+      seg->len = 0;
+
+      node = self->priv->tees;
+      while (node != NULL)
+        {
+          Tee *tee = node->data;
+
+          node = node->next;
+
+          tee->func (self, slot->buf, slot->len, tee->user_data);
+        }
+    }
+  else
+    {
+      filetea_transfer_segment_free_buf (self, seg);
+    }
+
+  if (seg->conn != NULL)
+    {
+      EvdHttpConnection *conn = seg->conn;
+
+      g_signal_handlers_disconnect_by_func (conn,
+                                            segment_connection_on_close,
+                                            self);
+      seg->conn = NULL;
+
+      filetea_transfer_set_source_conn (self, conn);
+      g_object_unref (conn);
+    }
+
+  return TRUE;
+}
+
+static void
+filetea_transfer_read (FileteaTransfer *self)
+{
+  GInputStream *stream;
+  gsize size;
+  guint tail;
+  gchar *buf = NULL;
+
+  if (self->priv->reading)
+    return;
+
+  /* the push of the current segment is over, the next one takes over */
+  if (self->priv->segments != NULL &&
+      self->priv->received == filetea_transfer_get_push_end (self) &&
+      self->priv->received < self->priv->transfer_len)
+    {
+      while (self->priv->received == filetea_transfer_get_push_end (self) &&
+             self->priv->received < self->priv->transfer_len)
+        {
+          if (! filetea_transfer_segment_next (self))
+            return;
+        }
+
+      if (! filetea_transfer_drain (self))
+        return;
+    }
+
+  if (self->priv->source_conn == NULL)
+    return;
+
+  stream = g_io_stream_get_input_stream (G_IO_STREAM (self->priv->source_conn));
+
+  if (g_input_stream_has_pending (stream))
+    {
+      g_warning ("has pending\n");
+      return;
+    }
+
+  size = MIN (self->priv->block_size,
+              filetea_transfer_get_push_end (self) - self->priv->received);
+  if (size == 0)
+    return;
+
+  /* a slow target of real-time content loses the oldest blocks instead
+     of holding the seeder back */
+  if (self->priv->real_time &&
+      self->priv->ring_count == self->priv->ring_depth)
+    {
+      self->priv->dropped += self->priv->ring[self->priv->ring_head].len;
+      self->priv->ring_head = (self->priv->ring_head + 1) % self->priv->ring_depth;
+      self->priv->ring_count--;
+    }
+
+  /* read the next block while the previous ones are written to target */
+  tail = (self->priv->ring_head + self->priv->ring_count) % self->priv->ring_depth;
+
+  if (self->priv->ring_count < self->priv->ring_depth)
+    buf = filetea_transfer_ring_get_buf (self, tail, &size);
+
+  if (buf == NULL)
+    {
+      /* ring is full or relay memory is short, wait for the target to
+         drain it */
+      if (! self->priv->source_locked)
+        {
+          evd_connection_lock_close (EVD_CONNECTION (self->priv->source_conn));
+          self->priv->source_locked = TRUE;
+        }
+
+      return;
+    }
+
+  self->priv->reading = TRUE;
+
+  g_object_ref (self);
+  g_input_stream_read_async (stream,
+                             buf,
+                             size,
+                             G_PRIORITY_DEFAULT,
+                             NULL,
+                             filetea_transfer_on_read,
+                             self);
+}
+
+static void
+filetea_transfer_on_target_flushed (GObject      *obj,
+                                    GAsyncResult *res,
+                                    gpointer      user_data)
+{
+  FileteaTransfer *self = user_data;
+  GError *error = NULL;
+
+  if (! g_output_stream_flush_finish (G_OUTPUT_STREAM (obj), res, &error))
+    {
+      /* if the stream was closed during flush it is not exactly an error,
+         since it can be expected depending on how fast the target closed
+         the connection after receiving all the body content */
+      if (error->code != G_IO_ERROR_CLOSED)
+        {
+          g_printerr ("ERROR flushing target: %s\n", error->message);
+          g_error_free (error);
+        }
+    }
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_COMPLETED;
+
+  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
+                                        filetea_transfer_on_target_can_write,
+                                        self);
+
+  filetea_transfer_complete (self);
+
+  g_object_unref (self);
+}
+
+static void
+filetea_transfer_flush_target (FileteaTransfer *self)
+{
+  GOutputStream *stream;
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (self->priv->target_conn));
+
+  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
+                                        target_connection_on_close,
+                                        self);
+  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
+                                        filetea_transfer_on_target_can_write,
+                                        self);
+
+  /* only one flush at a time */
+  if (self->priv->flushing_block)
+    {
+      self->priv->flush_pending = TRUE;
+      return;
+    }
+
+  g_object_ref (self);
+  g_output_stream_flush_async (stream,
+                               G_PRIORITY_DEFAULT,
+                               NULL,
+                               filetea_transfer_on_target_flushed,
+                               self);
+}
+
+/* gives the source connection away when the target is the one that ended
+   the transfer, so the seeder can stop its push without losing the
+   connection. Returns %FALSE if it must be closed instead */
+static gboolean
+filetea_transfer_hand_over_source (FileteaTransfer *self)
+{
+  gsize consumed;
+
+  /* what a read in flight takes from the connection would be lost */
+  if (self->priv->abort_func == NULL ||
+      self->priv->segments != NULL ||
+      self->priv->reading ||
+      (self->priv->status != FILETEA_TRANSFER_STATUS_TARGET_ABORTED &&
+       self->priv->status != FILETEA_TRANSFER_STATUS_STALLED))
+    {
+      return FALSE;
+    }
+
+  consumed = self->priv->received - self->priv->source_offset;
+#ifdef HAVE_SPLICE
+  consumed += self->priv->pipe_len;
+#endif
+
+  if (self->priv->source_locked)
+    {
+      evd_connection_unlock_close (EVD_CONNECTION (self->priv->source_conn));
+      self->priv->source_locked = FALSE;
+    }
+
+  self->priv->abort_func (self,
+                          self->priv->source_conn,
+                          consumed,
+                          self->priv->abort_user_data);
+
+  return TRUE;
+}
+
+static void
+filetea_transfer_complete (FileteaTransfer *self)
+{
+  guint i;
+
+  filetea_transfer_splice_stop (self);
+  filetea_transfer_stall_check_stop (self);
+
+  /* tell tees there will be no more data */
+  while (self->priv->tees != NULL)
+    {
+      Tee *tee = self->priv->tees->data;
+
+      self->priv->tees = g_slist_delete_link (self->priv->tees,
+                                              self->priv->tees);
+
+      tee->func (self, NULL, 0, tee->user_data);
+      g_slice_free (Tee, tee);
+    }
+
+  self->priv->pull_func = NULL;
+
+  /* connections are reused after the transfer, lift its limits */
+  if (self->priv->max_bw_out > 0.0)
+    connection_set_bandwidth (self->priv->target_conn, -1.0, 0.0);
+  if (self->priv->max_bw_in > 0.0 && self->priv->source_conn != NULL)
+    connection_set_bandwidth (self->priv->source_conn, 0.0, -1.0);
+
+  g_signal_handlers_disconnect_by_func (self->priv->target_conn,
+                                        target_connection_on_close,
+                                        self);
+  if (self->priv->source_conn != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (self->priv->source_conn,
+                                            source_connection_on_close,
+                                            self);
+
+      if (self->priv->status != FILETEA_TRANSFER_STATUS_COMPLETED &&
+          ! g_io_stream_is_closed (G_IO_STREAM (self->priv->source_conn)) &&
+          ! filetea_transfer_hand_over_source (self))
+        {
+          g_io_stream_close (G_IO_STREAM (self->priv->source_conn), NULL, NULL);
+        }
+    }
+
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_COMPLETED &&
+      ! g_io_stream_is_closed (G_IO_STREAM (self->priv->target_conn)))
+    {
+      g_io_stream_close (G_IO_STREAM (self->priv->target_conn), NULL, NULL);
+    }
+
+  /* pushes of segments that didn't get their turn */
+  for (i = 0; i < self->priv->n_segments; i++)
+    {
+      Segment *seg = &self->priv->segments[i];
+
+      if (seg->conn == NULL)
+        continue;
+
+      g_signal_handlers_disconnect_by_func (seg->conn,
+                                            segment_connection_on_close,
+                                            self);
+      if (! g_io_stream_is_closed (G_IO_STREAM (seg->conn)))
+        g_io_stream_close (G_IO_STREAM (seg->conn), NULL, NULL);
+    }
+
+  if (self->priv->result != NULL)
+    {
+      g_simple_async_result_complete_in_idle (self->priv->result);
+      g_object_unref (self->priv->result);
+      self->priv->result = NULL;
+    }
+}
+
+static gboolean
+on_transfer_start_timeout (gpointer user_data)
+{
+  FileteaTransfer *self = FILETEA_TRANSFER (user_data);
+  GError *error;
+
+  self->priv->timeout = NULL;
+
+  if (self->priv->headers_sent)
+    error = g_error_new (G_IO_ERROR,
+                         G_IO_ERROR_TIMED_OUT,
+                         "Timeout resuming transfer");
+  else
+    error = g_error_new (G_IO_ERROR,
+                         G_IO_ERROR_TIMED_OUT,
+                         "Timeout starting transfer");
+
+  filetea_transfer_fail (self, SOUP_STATUS_REQUEST_TIMEOUT, error);
+  g_error_free (error);
+
+  return FALSE;
+}
+
+static gboolean
+filetea_transfer_send_headers (FileteaTransfer *self)
+{
+  SoupMessageHeaders *headers;
+  GError *error = NULL;
+  gint status = SOUP_STATUS_OK;
+
+  headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+
+  if (g_strcmp0 (self->priv->action, "open") != 0)
+    {
+      gchar *st;
+      gchar *decoded_file_name;
+
+      decoded_file_name = soup_uri_decode (filetea_source_get_name (self->priv->source));
+      st = g_strdup_printf ("attachment; filename=\"%s\"", decoded_file_name);
+      g_free (decoded_file_name);
+      soup_message_headers_replace (headers, "Content-disposition", st);
+      g_free (st);
+    }
+
+  /* update transfer len */
+  if (self->priv->is_chunked)
+    {
+      goffset size;
+      guint i;
+
+      size = filetea_source_get_size (self->priv->source);
+
+      self->priv->transfer_len = 0;
+      for (i = 0; i < self->priv->n_ranges; i++)
+        {
+          SoupRange *range = &self->priv->byte_ranges[i];
+
+          if (range->end == -1)
+            range->end = size - 1;
+          else
+            range->end = MIN (range->end, size - 1);
+
+          self->priv->transfer_len += range->end - range->start + 1;
+        }
+    }
+  else if (self->priv->live)
+    {
+      /* known once the seeder ends the push */
+      self->priv->transfer_len = G_MAXSIZE;
+    }
+  else
+    {
+      self->priv->transfer_len = filetea_source_get_size (self->priv->source);
+    }
+
+  /* prepare target response headers */
+  soup_message_headers_replace (headers, "Connection", "keep-alive");
+
+  if (self->priv->live)
+    {
+      soup_message_headers_set_encoding (headers, SOUP_ENCODING_CHUNKED);
+      soup_message_headers_set_content_type (headers,
+                           filetea_source_get_content_type (self->priv->source),
+                           NULL);
+    }
+  else if (self->priv->n_ranges > 1)
+    {
+      gsize content_len;
+      gchar *st;
+      guint i;
+
+      /* each range goes in its own part of a multipart/byteranges body */
+      g_free (self->priv->boundary);
+      self->priv->boundary = g_strdup_printf ("filetea-%s", self->priv->id);
+
+      content_len = self->priv->transfer_len;
+      for (i = 0; i < self->priv->n_ranges; i++)
+        {
+          st = filetea_transfer_get_part_headers (self, i);
+          content_len += strlen (st);
+          g_free (st);
+        }
+      content_len += strlen (self->priv->boundary) + strlen (MULTIPART_CLOSE_FMT) - 2;
+
+      soup_message_headers_set_content_length (headers, content_len);
+
+      st = g_strdup_printf ("multipart/byteranges; boundary=%s",
+                            self->priv->boundary);
+      soup_message_headers_replace (headers, "Content-Type", st);
+      g_free (st);
+
+      status = SOUP_STATUS_PARTIAL_CONTENT;
+    }
+  else
+    {
+      soup_message_headers_set_content_length (headers,
+                                               self->priv->transfer_len);
+      soup_message_headers_set_content_type (headers,
+                           filetea_source_get_content_type (self->priv->source),
+                           NULL);
+
+      if (self->priv->is_chunked)
+        {
+          soup_message_headers_set_content_range (headers,
+                                    self->priv->byte_ranges[0].start,
+                                    self->priv->byte_ranges[0].end,
+                                    filetea_source_get_size (self->priv->source));
+          status = SOUP_STATUS_PARTIAL_CONTENT;
+        }
+    }
+
+  if (! evd_web_service_respond_headers (self->priv->web_service,
+                                         self->priv->target_conn,
+                                         status,
+                                         headers,
+                                         &error))
+    {
+      g_printerr ("Error sending transfer target headers: %s\n", error->message);
+      g_error_free (error);
+    }
+  else
+    {
+      self->priv->headers_sent = TRUE;
+
+      if (self->priv->real_time)
+        connection_set_no_delay (self->priv->target_conn);
+
+      if (self->priv->ring == NULL)
+        self->priv->ring = g_new0 (RingSlot, self->priv->ring_depth);
+
+      g_signal_connect (self->priv->target_conn,
+                        "write",
+                        G_CALLBACK (filetea_transfer_on_target_can_write),
+                        self);
+
+      self->priv->status = FILETEA_TRANSFER_STATUS_ACTIVE;
+
+      filetea_transfer_stall_check_start (self);
+    }
+
+  soup_message_headers_free (headers);
+
+  return self->priv->headers_sent;
+}
+
+/* the target didn't take the response headers, so it won't take content
+   either */
+static void
+filetea_transfer_abort_headers (FileteaTransfer *self)
+{
+  if (self->priv->result == NULL)
+    return;
+
+  g_simple_async_result_set_error (self->priv->result,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_BROKEN_PIPE,
+                                   "Failed to send response headers");
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+  filetea_transfer_complete (self);
+}
+
+/* public methods */
+
+FileteaTransfer *
+filetea_transfer_new (FileteaSource       *source,
+                      EvdWebService       *web_service,
+                      FileteaTimerWheel   *timer_wheel,
+                      EvdHttpConnection   *target_conn,
+                      const gchar         *action,
+                      gboolean             is_chunked,
+                      SoupRange           *ranges,
+                      guint                n_ranges,
+                      GCancellable        *cancellable,
+                      GAsyncReadyCallback  callback,
+                      gpointer             user_data)
+{
+  FileteaTransfer *self;
+
+  g_return_val_if_fail (FILETEA_IS_SOURCE (source), NULL);
+  g_return_val_if_fail (EVD_IS_WEB_SERVICE (web_service), NULL);
+  g_return_val_if_fail (FILETEA_IS_TIMER_WHEEL (timer_wheel), NULL);
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (target_conn), NULL);
+  g_return_val_if_fail (! is_chunked || n_ranges > 0, NULL);
+
+  self = g_object_new (FILETEA_TYPE_TRANSFER, NULL);
+
+  self->priv->result = g_simple_async_result_new (G_OBJECT (self),
+                                                  callback,
+                                                  user_data,
+                                                  filetea_transfer_new);
+
+  self->priv->source = g_object_ref (source);
+  self->priv->web_service = g_object_ref (web_service);
+
+  if (cancellable != NULL)
+    self->priv->cancellable = g_object_ref (cancellable);
+
+  self->priv->target_conn = g_object_ref (target_conn);
+  g_signal_connect (target_conn,
+                    "close",
+                    G_CALLBACK (target_connection_on_close),
+                    self);
+
+  self->priv->id = evd_uuid_new ();
+  self->priv->action = g_strdup (action);
+  self->priv->real_time = (filetea_source_get_flags (source) &
+                           FILETEA_SOURCE_FLAGS_REAL_TIME) != 0;
+  /* content that can be dropped has no known length either */
+  self->priv->live = self->priv->real_time ||
+    (filetea_source_get_flags (source) & FILETEA_SOURCE_FLAGS_LIVE) != 0;
+  self->priv->is_chunked = is_chunked;
+  if (is_chunked)
+    {
+      guint i;
+
+      self->priv->byte_ranges = g_new (SoupRange, n_ranges);
+      self->priv->n_ranges = n_ranges;
+
+      for (i = 0; i < n_ranges; i++)
+        {
+          self->priv->byte_ranges[i].start = MAX (ranges[i].start, 0);
+          self->priv->byte_ranges[i].end = ranges[i].end;
+        }
+    }
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_NOT_STARTED;
+
+  self->priv->timer_wheel = g_object_ref (timer_wheel);
+  filetea_transfer_set_timeout (self, START_TIMEOUT);
+
+  return self;
+}
+
+const gchar *
+filetea_transfer_get_id (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), NULL);
+
+  return self->priv->id;
+}
+
+void
+filetea_transfer_set_source_conn (FileteaTransfer   *self,
+                                  EvdHttpConnection *conn)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (EVD_IS_HTTP_CONNECTION (conn));
+
+  self->priv->source_conn = g_object_ref (conn);
+  self->priv->source_offset = self->priv->received;
+
+  if (self->priv->real_time)
+    connection_set_no_delay (conn);
+
+  if (self->priv->max_bw_in > 0.0)
+    connection_set_bandwidth (conn, self->priv->max_bw_in, -1.0);
+
+  g_signal_connect (self->priv->source_conn,
+                    "close",
+                    G_CALLBACK (source_connection_on_close),
+                    self);
+}
+
+void
+filetea_transfer_start (FileteaTransfer *self)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (self->priv->source_conn != NULL);
+
+  filetea_transfer_clear_timeout (self);
+
+  /* from now on, content comes from the source connection */
+  self->priv->pull_func = NULL;
+
+  if (self->priv->start_time == 0)
+    self->priv->start_time = g_get_monotonic_time ();
+
+  /* headers were already sent if the transfer was being fed before */
+  if (! self->priv->headers_sent && ! filetea_transfer_send_headers (self))
+    {
+      filetea_transfer_abort_headers (self);
+      return;
+    }
+
+  /* content starts flowing once the transfer is resumed */
+  if (self->priv->status == FILETEA_TRANSFER_STATUS_PAUSED)
+    return;
+
+  if (! filetea_transfer_can_splice (self) ||
+      ! filetea_transfer_splice_start (self))
+    {
+      filetea_transfer_read (self);
+    }
+}
+
+gboolean
+filetea_transfer_finish (FileteaTransfer  *self,
+                         GAsyncResult     *result,
+                         GError          **error)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
+  g_return_val_if_fail (g_simple_async_result_is_valid (result,
+                                                        G_OBJECT (self),
+                                                        filetea_transfer_new),
+                        FALSE);
+
+  return ! g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result),
+                                                  error);
+}
+
+void
+filetea_transfer_set_target_peer (FileteaTransfer *self, EvdPeer *peer)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  if (self->priv->target_peer != NULL)
+    g_object_unref (self->priv->target_peer);
+
+  self->priv->target_peer = peer;
+
+  if (peer != NULL)
+    g_object_ref (peer);
+}
+
+EvdPeer *
+filetea_transfer_get_target_peer (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), NULL);
+
+  return self->priv->target_peer;
+}
+
+void
+filetea_transfer_get_status (FileteaTransfer *self,
+                             guint           *status,
+                             gsize           *transferred,
+                             gdouble         *bandwidth)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  if (status != NULL)
+    *status = self->priv->status;
+
+  if (transferred != NULL)
+    *transferred = self->priv->transferred;
+
+  if (bandwidth != NULL)
+    {
+      if (self->priv->splicing)
+        {
+          /* spliced bytes are not seen by stream throttles */
+          *bandwidth = self->priv->bandwidth;
+        }
+      else if (self->priv->source_conn != NULL)
+        {
+          EvdStreamThrottle *throttle;
+
+          throttle =
+            evd_io_stream_get_input_throttle (EVD_IO_STREAM (self->priv->source_conn));
+
+          *bandwidth = evd_stream_throttle_get_actual_bandwidth (throttle);
+        }
+      else
+        {
+          *bandwidth = 0;
+        }
+    }
+}
+
+/**
+ * filetea_transfer_fail:
+ * @status_code: HTTP status to answer the target with
+ * @error: why the transfer failed
+ *
+ * Ends the transfer with @error. A target that didn't get the response
+ * headers yet is answered with @status_code, otherwise it already got part
+ * of the content and its connection is just dropped.
+ **/
+void
+filetea_transfer_fail (FileteaTransfer *self,
+                       guint            status_code,
+                       const GError    *error)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (error != NULL);
+
+  if (self->priv->result == NULL)
+    return;
+
+  filetea_transfer_clear_timeout (self);
+
+  g_simple_async_result_set_from_error (self->priv->result, error);
+
+  if (self->priv->headers_sent)
     {
-      g_simple_async_result_set_error (self->priv->result,
-                                       G_IO_ERROR,
-                                       G_IO_ERROR_TIMED_OUT,
-                                       "Timeout starting transfer");
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+      filetea_transfer_complete (self);
+    }
+  else
+    {
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
 
       evd_web_service_respond (self->priv->web_service,
                                self->priv->target_conn,
-                               SOUP_STATUS_REQUEST_TIMEOUT,
+                               status_code,
                                NULL,
                                NULL,
                                0,
@@ -420,263 +2794,760 @@ on_transfer_start_timeout (gpointer user_data)
 
       filetea_transfer_flush_target (self);
     }
+}
+
+void
+filetea_transfer_cancel (FileteaTransfer *self)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  if (self->priv->result == NULL)
+    return;
+
+  g_simple_async_result_set_error (self->priv->result,
+                                   G_IO_ERROR,
+                                   G_IO_ERROR_CANCELLED,
+                                   "Transfer cancelled");
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_SOURCE_ABORTED;
+
+  filetea_transfer_complete (self);
+}
+
+void
+filetea_transfer_set_zero_copy (FileteaTransfer *self, gboolean zero_copy)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  self->priv->zero_copy = zero_copy;
+}
+
+void
+filetea_transfer_set_ring_depth (FileteaTransfer *self, guint depth)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (depth > 0);
+  g_return_if_fail (self->priv->ring == NULL);
+
+  self->priv->ring_depth = depth;
+}
+
+void
+filetea_transfer_set_block_size_limits (FileteaTransfer *self,
+                                        gsize            min_size,
+                                        gsize            max_size)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (min_size > 0 && min_size <= max_size);
+
+  self->priv->min_block_size = min_size;
+  self->priv->max_block_size = max_size;
+  self->priv->block_size = CLAMP (self->priv->block_size, min_size, max_size);
+}
+
+/**
+ * filetea_transfer_adapt_block_size:
+ * @block_size: the current block size
+ * @min_size: the smallest block size allowed
+ * @max_size: the largest block size allowed
+ * @last_read: the number of bytes returned by the last read of @block_size
+ * @max_writable: what the destination can currently take without blocking
+ * @bandwidth: the actual bandwidth of the transfer, in kilobytes per second
+ * @throttled: whether any side of the transfer is throttled
+ *
+ * Computes the size of the next read of a transfer. Blocks grow while the
+ * source fills them and the destination keeps up, and shrink for slow or
+ * throttled transfers, so that no more than a fraction of a second worth
+ * of data is read at once.
+ *
+ * Returns: the block size to use for the next read.
+ **/
+gsize
+filetea_transfer_adapt_block_size (gsize    block_size,
+                                   gsize    min_size,
+                                   gsize    max_size,
+                                   gsize    last_read,
+                                   gsize    max_writable,
+                                   gdouble  bandwidth,
+                                   gboolean throttled)
+{
+  gsize new_size = block_size;
+
+  if (throttled || last_read < block_size || max_writable < block_size)
+    new_size = block_size / 2;
+  else if (max_writable / 2 >= block_size)
+    new_size = block_size * 2;
+
+  /* never read more than ~1/4 second of data */
+  if (bandwidth > 0.0)
+    {
+      gsize cap;
+
+      cap = (gsize) (bandwidth * 1024 / 4);
+      if (new_size > cap && new_size > block_size)
+        new_size = block_size;
+      else if (cap < block_size)
+        new_size = MIN (new_size, block_size / 2);
+    }
+
+  return CLAMP (new_size, min_size, max_size);
+}
+
+FileteaSource *
+filetea_transfer_get_source (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), NULL);
+
+  return self->priv->source;
+}
+
+/**
+ * filetea_transfer_add_tee:
+ * @func: function called with every block read from source
+ * @user_data: user data for @func
+ *
+ * Lets someone else see the content of the transfer as it flows. @func is
+ * called once with a %NULL buffer when the transfer stops. Transfers with
+ * tees are never relayed through the kernel.
+ **/
+void
+filetea_transfer_add_tee (FileteaTransfer        *self,
+                          FileteaTransferTeeFunc  func,
+                          gpointer                user_data)
+{
+  Tee *tee;
+
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (func != NULL);
+
+  tee = g_slice_new (Tee);
+  tee->func = func;
+  tee->user_data = user_data;
+
+  self->priv->tees = g_slist_append (self->priv->tees, tee);
+}
+
+void
+filetea_transfer_remove_tee (FileteaTransfer        *self,
+                             FileteaTransferTeeFunc  func,
+                             gpointer                user_data)
+{
+  GSList *node;
+
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  for (node = self->priv->tees; node != NULL; node = node->next)
+    {
+      Tee *tee = node->data;
+
+      if (tee->func == func && tee->user_data == user_data)
+        {
+          self->priv->tees = g_slist_delete_link (self->priv->tees, node);
+          g_slice_free (Tee, tee);
+          return;
+        }
+    }
+}
+
+/**
+ * filetea_transfer_start_fed:
+ * @pull_func: function called every time the target can take more content
+ * @user_data: user data for @pull_func
+ *
+ * Starts the transfer without a source connection. Content is then written
+ * with filetea_transfer_feed(), until the transfer is completed or a source
+ * connection takes over with filetea_transfer_start().
+ **/
+void
+filetea_transfer_start_fed (FileteaTransfer         *self,
+                            FileteaTransferPullFunc  pull_func,
+                            gpointer                 user_data)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (pull_func != NULL);
+  g_return_if_fail (! self->priv->headers_sent);
+
+  filetea_transfer_clear_timeout (self);
+
+  self->priv->pull_func = pull_func;
+  self->priv->pull_user_data = user_data;
+
+  if (! filetea_transfer_send_headers (self))
+    filetea_transfer_abort_headers (self);
+}
+
+/**
+ * filetea_transfer_feed:
+ * @buf: content to write to target
+ * @size: size of @buf
+ *
+ * Writes as much of @buf as the target can take without blocking.
+ *
+ * Returns: the number of bytes written, 0 if the target can't take more
+ * for now or the transfer is paused, or -1 if the transfer failed.
+ **/
+gssize
+filetea_transfer_feed (FileteaTransfer *self, const gchar *buf, gsize size)
+{
+  GError *error = NULL;
+  gsize max_writable;
+
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), -1);
+
+  /* takes more once resumed */
+  if (self->priv->status == FILETEA_TRANSFER_STATUS_PAUSED)
+    return 0;
+
+  /* also the case of a transfer whose headers couldn't be sent */
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE)
+    return -1;
+
+  g_return_val_if_fail (self->priv->pull_func != NULL, -1);
+
+  max_writable =
+    evd_connection_get_max_writable (EVD_CONNECTION (self->priv->target_conn));
+  size = MIN (size, max_writable);
+  size = MIN (size, self->priv->transfer_len - self->priv->transferred);
+  if (size == 0)
+    return 0;
+
+  if (! filetea_transfer_write_content (self,
+                                        buf,
+                                        size,
+                                        &error))
+    {
+      g_printerr ("ERROR writing to target: %s\n", error->message);
+
+      g_simple_async_result_take_error (self->priv->result, error);
+      self->priv->status = FILETEA_TRANSFER_STATUS_ERROR;
+      filetea_transfer_complete (self);
+
+      return -1;
+    }
+
+  self->priv->received += size;
+  self->priv->transferred += size;
+
+  if (self->priv->transferred == self->priv->transfer_len)
+    {
+      self->priv->pull_func = NULL;
+      filetea_transfer_flush_target (self);
+    }
 
-  return FALSE;
+  return size;
 }
 
-/* public methods */
-
-FileteaTransfer *
-filetea_transfer_new (FileteaSource       *source,
-                      EvdWebService       *web_service,
-                      EvdHttpConnection   *target_conn,
-                      const gchar         *action,
-                      gboolean             is_chunked,
-                      SoupRange           *range,
-                      GCancellable        *cancellable,
-                      GAsyncReadyCallback  callback,
-                      gpointer             user_data)
+/**
+ * filetea_transfer_stop_feed:
+ *
+ * Stops feeding the transfer. The rest of the content is expected from a
+ * source connection pushing from the current offset, which should arrive
+ * before the start timeout.
+ **/
+void
+filetea_transfer_stop_feed (FileteaTransfer *self)
 {
-  FileteaTransfer *self;
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
 
-  g_return_val_if_fail (FILETEA_IS_SOURCE (source), NULL);
-  g_return_val_if_fail (EVD_IS_WEB_SERVICE (web_service), NULL);
-  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (target_conn), NULL);
+  self->priv->pull_func = NULL;
 
-  self = g_object_new (FILETEA_TYPE_TRANSFER, NULL);
+  if (self->priv->timeout == NULL)
+    filetea_transfer_set_timeout (self, START_TIMEOUT);
+}
 
-  self->priv->result = g_simple_async_result_new (G_OBJECT (self),
-                                                  callback,
-                                                  user_data,
-                                                  filetea_transfer_new);
+gsize
+filetea_transfer_get_offset (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), 0);
 
-  self->priv->source = g_object_ref (source);
-  self->priv->web_service = g_object_ref (web_service);
+  return self->priv->received;
+}
 
-  if (cancellable != NULL)
-    self->priv->cancellable = g_object_ref (cancellable);
+/**
+ * filetea_transfer_start_from_file:
+ * @fd: a file descriptor holding the whole content of the source
+ *
+ * Starts the transfer serving the content from a local file instead of
+ * asking the seeder. The transfer takes ownership of @fd.
+ **/
+void
+filetea_transfer_start_from_file (FileteaTransfer *self, gint fd)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  g_return_if_fail (fd >= 0);
+  g_return_if_fail (! self->priv->headers_sent);
 
-  self->priv->target_conn = g_object_ref (target_conn);
-  g_signal_connect (target_conn,
-                    "close",
-                    G_CALLBACK (target_connection_on_close),
-                    self);
+  filetea_transfer_clear_timeout (self);
 
-  self->priv->id = evd_uuid_new ();
-  self->priv->action = g_strdup (action);
-  self->priv->is_chunked = is_chunked;
-  if (is_chunked)
+  self->priv->file_fd = fd;
+
+  if (! filetea_transfer_send_headers (self))
     {
-      g_warning ("Chunked!\n");
+      close (self->priv->file_fd);
+      self->priv->file_fd = -1;
 
-      self->priv->byte_range.start = MAX (range->start, 0);
-      self->priv->byte_range.end = range->end;
+      filetea_transfer_abort_headers (self);
+      return;
     }
 
-  self->priv->status = FILETEA_TRANSFER_STATUS_NOT_STARTED;
+#ifdef USE_SENDFILE
+  if (filetea_transfer_can_sendfile (self))
+    {
+      GOutputStream *target_stream;
 
-  self->priv->timeout_src_id = evd_timeout_add (NULL,
-                                                START_TIMEOUT,
-                                                G_PRIORITY_LOW,
-                                                on_transfer_start_timeout,
-                                                self);
+      /* response headers must reach the socket before the body */
+      target_stream =
+        g_io_stream_get_output_stream (G_IO_STREAM (self->priv->target_conn));
 
-  return self;
+      g_object_ref (self);
+      g_output_stream_flush_async (target_stream,
+                                   G_PRIORITY_DEFAULT,
+                                   NULL,
+                                   filetea_transfer_on_splice_target_flushed,
+                                   self);
+      return;
+    }
+#endif
+
+  filetea_transfer_send_file (self);
 }
 
-const gchar *
-filetea_transfer_get_id (FileteaTransfer *self)
+/**
+ * filetea_transfer_set_max_bandwidth:
+ * @max_bw_in: maximum bandwidth reading from the source, in kilobytes per
+ * second, or 0 for unlimited
+ * @max_bw_out: maximum bandwidth writing to the target, in kilobytes per
+ * second, or 0 for unlimited
+ *
+ * Limits the bandwidth of the transfer. Can be called at any time; limits
+ * apply immediately to ongoing transfers.
+ **/
+void
+filetea_transfer_set_max_bandwidth (FileteaTransfer *self,
+                                    gdouble          max_bw_in,
+                                    gdouble          max_bw_out)
 {
-  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), NULL);
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
 
-  return self->priv->id;
+  self->priv->max_bw_in = MAX (max_bw_in, 0.0);
+  self->priv->max_bw_out = MAX (max_bw_out, 0.0);
+
+  /* transfer is over */
+  if (self->priv->result == NULL)
+    return;
+
+  connection_set_bandwidth (self->priv->target_conn,
+                            -1.0,
+                            self->priv->max_bw_out);
+
+  if (self->priv->source_conn != NULL)
+    connection_set_bandwidth (self->priv->source_conn,
+                              self->priv->max_bw_in,
+                              -1.0);
 }
 
+/**
+ * filetea_transfer_set_buffer_pool:
+ * @pool: the pool relay buffers are taken from
+ *
+ * Makes the transfer take its buffers from @pool. Must be called before
+ * the transfer is started.
+ **/
 void
-filetea_transfer_set_source_conn (FileteaTransfer   *self,
-                                  EvdHttpConnection *conn)
+filetea_transfer_set_buffer_pool (FileteaTransfer   *self,
+                                  FileteaBufferPool *pool)
 {
   g_return_if_fail (FILETEA_IS_TRANSFER (self));
-  g_return_if_fail (EVD_IS_HTTP_CONNECTION (conn));
+  g_return_if_fail (FILETEA_IS_BUFFER_POOL (pool));
+  g_return_if_fail (self->priv->ring == NULL);
 
-  self->priv->source_conn = g_object_ref (conn);
+  if (self->priv->buffer_pool != NULL)
+    g_object_unref (self->priv->buffer_pool);
+  self->priv->buffer_pool = g_object_ref (pool);
+}
 
-  g_signal_connect (self->priv->source_conn,
-                    "close",
-                    G_CALLBACK (source_connection_on_close),
-                    self);
+/**
+ * filetea_transfer_set_stall_limits:
+ * @idle_timeout: longest time the target can go without taking content,
+ * in miliseconds, or 0 for no limit
+ * @min_bandwidth: lowest bandwidth to the target, in kilobytes per second
+ * averaged over 30 seconds, or 0 for no limit
+ *
+ * Sets when an active transfer is considered stalled. Only time spent
+ * waiting on the target counts, a slow seeder doesn't stall the transfer.
+ * Stalled transfers are aborted with %FILETEA_TRANSFER_STATUS_STALLED,
+ * closing the source connection too. Must be called before the transfer
+ * starts.
+ **/
+void
+filetea_transfer_set_stall_limits (FileteaTransfer *self,
+                                   guint            idle_timeout,
+                                   gdouble          min_bandwidth)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  self->priv->idle_timeout = idle_timeout;
+  self->priv->min_bandwidth = MAX (min_bandwidth, 0.0);
 }
 
+/**
+ * filetea_transfer_set_resume_func:
+ * @func: function called when the source connection drops
+ * @timeout: how long to wait for a new source connection, in miliseconds
+ * @user_data: user data for @func
+ *
+ * Lets an active transfer survive its source connection. When it drops,
+ * @func is called with the offset of the content that is missing; if it
+ * returns %TRUE, the transfer keeps writing what it already read to the
+ * target and waits up to @timeout for a new source connection pushing the
+ * ranges returned by filetea_transfer_get_remaining_ranges(), which is
+ * handed over with filetea_transfer_set_source_conn() and
+ * filetea_transfer_start() as usual.
+ **/
 void
-filetea_transfer_start (FileteaTransfer *self)
+filetea_transfer_set_resume_func (FileteaTransfer           *self,
+                                  FileteaTransferResumeFunc  func,
+                                  guint                      timeout,
+                                  gpointer                   user_data)
 {
-  SoupMessageHeaders *headers;
-  GError *error = NULL;
-  gint status = SOUP_STATUS_OK;
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+
+  self->priv->resume_func = func;
+  self->priv->resume_timeout = timeout;
+  self->priv->resume_user_data = user_data;
+}
 
+/**
+ * filetea_transfer_set_abort_func:
+ * @func: function called with the source connection of a transfer ended
+ * by its target
+ * @user_data: user data for @func
+ *
+ * When the target drops or stalls, @func takes over the source connection
+ * instead of the transfer closing it, along with how many bytes of the
+ * push were consumed from it. The push body is not delimited on the wire,
+ * so @func has to learn from the seeder how much it sent before the
+ * connection can take another request. Connections with a read in flight
+ * are closed as before.
+ **/
+void
+filetea_transfer_set_abort_func (FileteaTransfer          *self,
+                                 FileteaTransferAbortFunc  func,
+                                 gpointer                  user_data)
+{
   g_return_if_fail (FILETEA_IS_TRANSFER (self));
-  g_return_if_fail (self->priv->source_conn != NULL);
 
-  if (self->priv->timeout_src_id != 0)
-    {
-      g_source_remove (self->priv->timeout_src_id);
-      self->priv->timeout_src_id = 0;
-    }
+  self->priv->abort_func = func;
+  self->priv->abort_user_data = user_data;
+}
 
-  headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+/**
+ * filetea_transfer_get_remaining_ranges:
+ * @n_ranges: (out): return location for the number of ranges
+ *
+ * Returns: (transfer full): the byte ranges of the source that the
+ * transfer has not received yet. Free with g_free().
+ **/
+SoupRange *
+filetea_transfer_get_remaining_ranges (FileteaTransfer *self,
+                                       guint           *n_ranges)
+{
+  SoupRange *ranges;
+  gsize pos;
+  guint i;
 
-  if (g_strcmp0 (self->priv->action, "open") != 0)
-    {
-      gchar *st;
-      gchar *decoded_file_name;
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), NULL);
+  g_return_val_if_fail (n_ranges != NULL, NULL);
 
-      decoded_file_name = soup_uri_decode (filetea_source_get_name (self->priv->source));
-      st = g_strdup_printf ("attachment; filename=\"%s\"", decoded_file_name);
-      g_free (decoded_file_name);
-      soup_message_headers_replace (headers, "Content-disposition", st);
-      g_free (st);
-    }
+  pos = self->priv->received;
 
-  /* update transfer len */
-  if (self->priv->is_chunked)
+  if (! self->priv->is_chunked)
     {
-      if (self->priv->byte_range.end == -1)
-        self->priv->byte_range.end =
-          filetea_source_get_size (self->priv->source) - 1;
-      else
-        self->priv->byte_range.end =
-          MIN (self->priv->byte_range.end,
-               filetea_source_get_size (self->priv->source) - 1);
+      ranges = g_new (SoupRange, 1);
+      ranges[0].start = pos;
+      ranges[0].end = filetea_source_get_size (self->priv->source) - 1;
+      *n_ranges = 1;
 
-      self->priv->transfer_len =
-        self->priv->byte_range.end - self->priv->byte_range.start + 1;
+      return ranges;
     }
-  else
+
+  ranges = g_new (SoupRange, self->priv->n_ranges);
+  *n_ranges = 0;
+
+  for (i = 0; i < self->priv->n_ranges; i++)
     {
-      self->priv->transfer_len = filetea_source_get_size (self->priv->source);
+      SoupRange *range = &self->priv->byte_ranges[i];
+      gsize range_len = range->end - range->start + 1;
+
+      if (pos >= range_len)
+        {
+          pos -= range_len;
+          continue;
+        }
+
+      ranges[*n_ranges].start = range->start + pos;
+      ranges[*n_ranges].end = range->end;
+      (*n_ranges)++;
+
+      pos = 0;
     }
 
-  /* prepare target response headers */
-  soup_message_headers_set_content_length (headers, self->priv->transfer_len);
-  soup_message_headers_set_content_type (headers,
-                           filetea_source_get_content_type (self->priv->source),
-                           NULL);
-  soup_message_headers_replace (headers, "Connection", "keep-alive");
+  return ranges;
+}
 
-  if (self->priv->is_chunked)
+/**
+ * filetea_transfer_pause:
+ *
+ * Stops reading from the source until filetea_transfer_resume() is
+ * called. Content already read is still written to the target, and relay
+ * buffers are given back as they become empty.
+ *
+ * Returns: %TRUE if the transfer was paused, %FALSE if it is not active.
+ **/
+gboolean
+filetea_transfer_pause (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
+
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE)
+    return FALSE;
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_PAUSED;
+
+  /* content left in the pipe is relayed upon resume */
+  filetea_transfer_splice_stop (self);
+
+#ifdef HAVE_SPLICE
+  if (self->priv->pipe_fds[0] != -1 && self->priv->pipe_len == 0)
     {
-      soup_message_headers_set_content_range (headers,
-                                              self->priv->byte_range.start,
-                                              self->priv->byte_range.end,
-                                              filetea_source_get_size (self->priv->source));
-      status = SOUP_STATUS_PARTIAL_CONTENT;
+      close (self->priv->pipe_fds[0]);
+      close (self->priv->pipe_fds[1]);
+      self->priv->pipe_fds[0] = -1;
+      self->priv->pipe_fds[1] = -1;
     }
+#endif
 
-  if (! evd_web_service_respond_headers (self->priv->web_service,
-                                         self->priv->target_conn,
-                                         status,
-                                         headers,
-                                         &error))
+  filetea_transfer_ring_release_idle (self);
+
+  return TRUE;
+}
+
+/**
+ * filetea_transfer_resume:
+ *
+ * Resumes a transfer paused with filetea_transfer_pause().
+ *
+ * Returns: %TRUE if the transfer was resumed, %FALSE if it was not paused.
+ **/
+gboolean
+filetea_transfer_resume (FileteaTransfer *self)
+{
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
+
+  if (self->priv->status != FILETEA_TRANSFER_STATUS_PAUSED)
+    return FALSE;
+
+  self->priv->status = FILETEA_TRANSFER_STATUS_ACTIVE;
+
+  g_object_ref (self);
+
+#ifdef HAVE_SPLICE
+  if (self->priv->pipe_len > 0)
     {
-      g_printerr ("Error sending transfer target headers: %s\n", error->message);
-      g_error_free (error);
+      self->priv->splicing = TRUE;
+      self->priv->bw_last_time = g_get_monotonic_time ();
+      self->priv->bw_last_transferred = self->priv->transferred;
 
-      /* @TODO: abort the transfer */
+      filetea_transfer_splice (self);
     }
   else
+#endif
     {
-      if (self->priv->buf == NULL)
-        self->priv->buf = g_slice_alloc (BLOCK_SIZE);
+      /* continue as if the target had just drained */
+      filetea_transfer_on_target_can_write (EVD_CONNECTION (self->priv->target_conn),
+                                            self);
+    }
 
-      g_signal_connect (self->priv->target_conn,
-                        "write",
-                        G_CALLBACK (filetea_transfer_on_target_can_write),
-                        self);
+  g_object_unref (self);
 
-      self->priv->status = FILETEA_TRANSFER_STATUS_ACTIVE;
+  return TRUE;
+}
 
-      filetea_transfer_read (self);
-    }
+/**
+ * filetea_transfer_get_latency:
+ * @average: (out) (allow-none): average time blocks wait in the relay
+ * @max: (out) (allow-none): longest time a block waited in the relay
+ * @dropped: (out) (allow-none): bytes dropped because the target was slow
+ *
+ * Times are in microseconds, measured from a block being read from the
+ * source to it being written to the target. Only real-time transfers keep
+ * track of them.
+ **/
+void
+filetea_transfer_get_latency (FileteaTransfer *self,
+                              gdouble         *average,
+                              gint64          *max,
+                              gsize           *dropped)
+{
+  g_return_if_fail (FILETEA_IS_TRANSFER (self));
 
-  soup_message_headers_free (headers);
+  if (average != NULL)
+    *average = self->priv->latency_avg;
+  if (max != NULL)
+    *max = self->priv->latency_max;
+  if (dropped != NULL)
+    *dropped = self->priv->dropped;
 }
 
+/**
+ * filetea_transfer_split:
+ * @n_segments: number of pushes to split the content in
+ *
+ * Makes the content of a not yet started transfer of a whole source be
+ * pushed over @n_segments connections in parallel, and relayed to the
+ * target in order. The first segment is pushed to the transfer as usual,
+ * the others with filetea_transfer_set_segment_conn(). The range of each
+ * segment is given by filetea_transfer_get_segment_range().
+ *
+ * Split transfers are not resumed if a push drops.
+ *
+ * Returns: %TRUE if the transfer was split.
+ **/
 gboolean
-filetea_transfer_finish (FileteaTransfer  *self,
-                         GAsyncResult     *result,
-                         GError          **error)
+filetea_transfer_split (FileteaTransfer *self, guint n_segments)
 {
+  gsize size;
+  gsize segment_size;
+  guint i;
+
   g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
-  g_return_val_if_fail (g_simple_async_result_is_valid (result,
-                                                        G_OBJECT (self),
-                                                        filetea_transfer_new),
-                        FALSE);
 
-  return ! g_simple_async_result_propagate_error (G_SIMPLE_ASYNC_RESULT (result),
-                                                  error);
+  size = filetea_source_get_size (self->priv->source);
+
+  if (n_segments < 2 ||
+      size < n_segments ||
+      self->priv->is_chunked ||
+      self->priv->live ||
+      self->priv->segments != NULL ||
+      self->priv->status != FILETEA_TRANSFER_STATUS_NOT_STARTED)
+    {
+      return FALSE;
+    }
+
+  self->priv->segments = g_new0 (Segment, n_segments);
+  self->priv->n_segments = n_segments;
+  self->priv->segment = 0;
+
+  segment_size = size / n_segments;
+  for (i = 0; i < n_segments; i++)
+    {
+      Segment *seg = &self->priv->segments[i];
+
+      seg->start = i * segment_size;
+      seg->end = i < n_segments - 1 ? seg->start + segment_size : size;
+    }
+
+  return TRUE;
 }
 
-void
-filetea_transfer_set_target_peer (FileteaTransfer *self, EvdPeer *peer)
+gboolean
+filetea_transfer_get_segment_range (FileteaTransfer *self,
+                                    guint            index,
+                                    SoupRange       *range)
 {
-  g_return_if_fail (FILETEA_IS_TRANSFER (self));
-  g_return_if_fail (EVD_IS_PEER (peer));
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
+  g_return_val_if_fail (range != NULL, FALSE);
 
-  if (self->priv->target_peer != NULL)
-    g_object_unref (self->priv->target_peer);
+  if (index >= self->priv->n_segments)
+    return FALSE;
 
-  self->priv->target_peer = peer;
+  range->start = self->priv->segments[index].start;
+  range->end = self->priv->segments[index].end - 1;
 
-  if (peer != NULL)
-    g_object_ref (peer);
+  return TRUE;
 }
 
-void
-filetea_transfer_get_status (FileteaTransfer *self,
-                             guint           *status,
-                             gsize           *transferred,
-                             gdouble         *bandwidth)
+/**
+ * filetea_transfer_set_segment_conn:
+ * @index: the segment, other than the first
+ * @conn: the connection pushing the content of the segment
+ *
+ * Returns: %FALSE if the transfer doesn't expect a push for @index.
+ **/
+gboolean
+filetea_transfer_set_segment_conn (FileteaTransfer   *self,
+                                   guint              index,
+                                   EvdHttpConnection *conn)
 {
-  g_return_if_fail (FILETEA_IS_TRANSFER (self));
+  Segment *seg;
 
-  if (status != NULL)
-    *status = self->priv->status;
+  g_return_val_if_fail (FILETEA_IS_TRANSFER (self), FALSE);
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
+
+  if (index == 0 ||
+      index >= self->priv->n_segments ||
+      index < self->priv->segment ||
+      (self->priv->status != FILETEA_TRANSFER_STATUS_NOT_STARTED &&
+       self->priv->status != FILETEA_TRANSFER_STATUS_ACTIVE &&
+       self->priv->status != FILETEA_TRANSFER_STATUS_PAUSED))
+    {
+      return FALSE;
+    }
 
-  if (transferred != NULL)
-    *transferred = self->priv->transferred;
+  seg = &self->priv->segments[index];
 
-  if (bandwidth != NULL)
+  /* its turn came already */
+  if (index == self->priv->segment)
     {
       if (self->priv->source_conn != NULL)
-        {
-          EvdStreamThrottle *throttle;
+        return FALSE;
 
-          throttle =
-            evd_io_stream_get_input_throttle (EVD_IO_STREAM (self->priv->source_conn));
+      filetea_transfer_set_source_conn (self, conn);
+      if (self->priv->status == FILETEA_TRANSFER_STATUS_ACTIVE)
+        filetea_transfer_read (self);
 
-          *bandwidth = evd_stream_throttle_get_actual_bandwidth (throttle);
-        }
-      else
-        {
-          *bandwidth = 0;
-        }
+      return TRUE;
     }
+
+  if (seg->conn != NULL)
+    return FALSE;
+
+  seg->conn = g_object_ref (conn);
+  g_signal_connect (conn,
+                    "close",
+                    G_CALLBACK (segment_connection_on_close),
+                    self);
+
+  filetea_transfer_segment_fetch (self, seg);
+
+  return TRUE;
 }
 
+/**
+ * filetea_transfer_get_pull_stats:
+ * @n_segments: (out) (allow-none): number of pushes the content was split in
+ * @bandwidth: (out) (allow-none): average bandwidth since the transfer
+ * started, in kilobytes per second
+ **/
 void
-filetea_transfer_cancel (FileteaTransfer *self)
+filetea_transfer_get_pull_stats (FileteaTransfer *self,
+                                 guint           *n_segments,
+                                 gdouble         *bandwidth)
 {
   g_return_if_fail (FILETEA_IS_TRANSFER (self));
 
-  if (self->priv->result == NULL)
-    return;
-
-  g_simple_async_result_set_error (self->priv->result,
-                                   G_IO_ERROR,
-                                   G_IO_ERROR_CANCELLED,
-                                   "Transfer cancelled");
+  if (n_segments != NULL)
+    *n_segments = MAX (self->priv->n_segments, 1);
 
-  self->priv->status = FILETEA_TRANSFER_STATUS_SOURCE_ABORTED;
+  if (bandwidth != NULL)
+    {
+      gint64 elapsed;
 
-  filetea_transfer_complete (self);
+      elapsed = g_get_monotonic_time () - self->priv->start_time;
+      if (self->priv->start_time == 0 || elapsed <= 0)
+        *bandwidth = 0.0;
+      else
+        *bandwidth = (self->priv->transferred / 1024.0) /
+          ((gdouble) elapsed / G_USEC_PER_SEC);
+    }
 }
@@ -27,6 +27,8 @@
 #include <evd.h>
 
 #include "filetea-source.h"
+#include "filetea-buffer-pool.h"
+#include "filetea-timer-wheel.h"
 
 G_BEGIN_DECLS
 
@@ -48,6 +50,27 @@ struct _FileteaTransferClass
 
 typedef struct _FileteaTransfer FileteaTransfer;
 
+typedef void (* FileteaTransferTeeFunc)  (FileteaTransfer *self,
+                                          const gchar     *buf,
+                                          gsize            size,
+                                          gpointer         user_data);
+
+typedef void (* FileteaTransferPullFunc) (FileteaTransfer *self,
+                                          gpointer         user_data);
+
+typedef gboolean (* FileteaTransferResumeFunc) (FileteaTransfer *self,
+                                                gsize            offset,
+                                                gpointer         user_data);
+
+typedef void (* FileteaTransferAbortFunc) (FileteaTransfer   *self,
+                                           EvdHttpConnection *source_conn,
+                                           gsize              consumed,
+                                           gpointer           user_data);
+
+/* object data key of the #EvdWebService a source connection came through,
+   if other than the one of the transfer */
+#define FILETEA_TRANSFER_WEB_SERVICE_KEY "org.filetea.WebService"
+
 typedef enum
 {
   FILETEA_TRANSFER_STATUS_NOT_STARTED,
@@ -56,6 +79,7 @@ typedef enum
   FILETEA_TRANSFER_STATUS_COMPLETED,
   FILETEA_TRANSFER_STATUS_SOURCE_ABORTED,
   FILETEA_TRANSFER_STATUS_TARGET_ABORTED,
+  FILETEA_TRANSFER_STATUS_STALLED,
   FILETEA_TRANSFER_STATUS_ERROR,
 } FileteaTransferStatus;
 
@@ -70,10 +94,12 @@ GType             filetea_transfer_get_type              (void) G_GNUC_CONST;
 
 FileteaTransfer * filetea_transfer_new                   (FileteaSource       *source,
                                                           EvdWebService       *web_service,
+                                                          FileteaTimerWheel   *timer_wheel,
                                                           EvdHttpConnection   *target_conn,
                                                           const gchar         *action,
                                                           gboolean             is_chunked,
-                                                          SoupRange           *range,
+                                                          SoupRange           *ranges,
+                                                          guint                n_ranges,
                                                           GCancellable        *cancellable,
                                                           GAsyncReadyCallback  callback,
                                                           gpointer             user_data);
@@ -91,6 +117,7 @@ void              filetea_transfer_set_source_conn       (FileteaTransfer   *sel
 
 void              filetea_transfer_set_target_peer       (FileteaTransfer *self,
                                                           EvdPeer         *peer);
+EvdPeer *         filetea_transfer_get_target_peer       (FileteaTransfer *self);
 
 void              filetea_transfer_get_status            (FileteaTransfer *self,
                                                           guint           *status,
@@ -98,5 +125,84 @@ void              filetea_transfer_get_status            (FileteaTransfer *self,
                                                           gdouble         *bandwidth);
 
 void              filetea_transfer_cancel                (FileteaTransfer *self);
+void              filetea_transfer_fail                  (FileteaTransfer *self,
+                                                          guint            status_code,
+                                                          const GError    *error);
+
+void              filetea_transfer_set_zero_copy         (FileteaTransfer *self,
+                                                          gboolean         zero_copy);
+void              filetea_transfer_set_ring_depth        (FileteaTransfer *self,
+                                                          guint            depth);
+void              filetea_transfer_set_block_size_limits (FileteaTransfer *self,
+                                                          gsize            min_size,
+                                                          gsize            max_size);
+void              filetea_transfer_set_max_bandwidth     (FileteaTransfer *self,
+                                                          gdouble          max_bw_in,
+                                                          gdouble          max_bw_out);
+void              filetea_transfer_set_buffer_pool       (FileteaTransfer   *self,
+                                                          FileteaBufferPool *pool);
+void              filetea_transfer_set_stall_limits      (FileteaTransfer *self,
+                                                          guint            idle_timeout,
+                                                          gdouble          min_bandwidth);
+
+gsize             filetea_transfer_adapt_block_size      (gsize    block_size,
+                                                          gsize    min_size,
+                                                          gsize    max_size,
+                                                          gsize    last_read,
+                                                          gsize    max_writable,
+                                                          gdouble  bandwidth,
+                                                          gboolean throttled);
+
+FileteaSource *   filetea_transfer_get_source            (FileteaTransfer *self);
+
+void              filetea_transfer_add_tee               (FileteaTransfer        *self,
+                                                          FileteaTransferTeeFunc  func,
+                                                          gpointer                user_data);
+void              filetea_transfer_remove_tee            (FileteaTransfer        *self,
+                                                          FileteaTransferTeeFunc  func,
+                                                          gpointer                user_data);
+
+void              filetea_transfer_start_fed             (FileteaTransfer         *self,
+                                                          FileteaTransferPullFunc  pull_func,
+                                                          gpointer                 user_data);
+gssize            filetea_transfer_feed                  (FileteaTransfer *self,
+                                                          const gchar     *buf,
+                                                          gsize            size);
+void              filetea_transfer_stop_feed             (FileteaTransfer *self);
+
+void              filetea_transfer_start_from_file       (FileteaTransfer *self,
+                                                          gint             fd);
+
+gsize             filetea_transfer_get_offset            (FileteaTransfer *self);
+
+void              filetea_transfer_set_resume_func       (FileteaTransfer           *self,
+                                                          FileteaTransferResumeFunc  func,
+                                                          guint                      timeout,
+                                                          gpointer                   user_data);
+SoupRange *       filetea_transfer_get_remaining_ranges  (FileteaTransfer *self,
+                                                          guint           *n_ranges);
+void              filetea_transfer_set_abort_func        (FileteaTransfer          *self,
+                                                          FileteaTransferAbortFunc  func,
+                                                          gpointer                  user_data);
+
+gboolean          filetea_transfer_pause                 (FileteaTransfer *self);
+gboolean          filetea_transfer_resume                (FileteaTransfer *self);
+
+void              filetea_transfer_get_latency           (FileteaTransfer *self,
+                                                          gdouble         *average,
+                                                          gint64          *max,
+                                                          gsize           *dropped);
+
+gboolean          filetea_transfer_split                 (FileteaTransfer *self,
+                                                          guint            n_segments);
+gboolean          filetea_transfer_get_segment_range     (FileteaTransfer *self,
+                                                          guint            index,
+                                                          SoupRange       *range);
+gboolean          filetea_transfer_set_segment_conn      (FileteaTransfer   *self,
+                                                          guint              index,
+                                                          EvdHttpConnection *conn);
+void              filetea_transfer_get_pull_stats        (FileteaTransfer *self,
+                                                          guint           *n_segments,
+                                                          gdouble         *bandwidth);
 
 #endif /* _FILETEA_TRANSFER_H_ */
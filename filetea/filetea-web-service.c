@@ -52,6 +52,12 @@ struct _FileteaWebServicePrivate
 
   FileteaWebServiceContentRequestCb content_req_cb;
   gpointer user_data;
+
+  FileteaWebServiceManagementRequestCb mgmt_req_cb;
+  gpointer mgmt_user_data;
+
+  FileteaWebServiceApiRequestCb api_req_cb;
+  gpointer api_user_data;
 };
 
 static void     filetea_web_service_class_init         (FileteaWebServiceClass *class);
@@ -135,6 +141,12 @@ filetea_web_service_init (FileteaWebService *self)
   priv->log_filename = NULL;
   priv->log_output_stream = NULL;
   priv->log_queue = NULL;
+
+  priv->mgmt_req_cb = NULL;
+  priv->mgmt_user_data = NULL;
+
+  priv->api_req_cb = NULL;
+  priv->api_user_data = NULL;
 }
 
 static void
@@ -181,6 +193,29 @@ filetea_web_service_finalize (GObject *obj)
   G_OBJECT_CLASS (filetea_web_service_parent_class)->finalize (obj);
 }
 
+static gboolean
+connection_is_local (EvdHttpConnection *conn)
+{
+  EvdSocket *socket;
+  GSocketAddress *addr;
+  gboolean result = FALSE;
+
+  socket = evd_connection_get_socket (EVD_CONNECTION (conn));
+  addr = g_socket_get_remote_address (evd_socket_get_socket (socket), NULL);
+  if (addr == NULL)
+    return FALSE;
+
+  if (G_IS_INET_SOCKET_ADDRESS (addr))
+    result = g_inet_address_get_is_loopback
+      (g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (addr)));
+  else if (G_IS_UNIX_SOCKET_ADDRESS (addr))
+    result = TRUE;
+
+  g_object_unref (addr);
+
+  return result;
+}
+
 static void
 request_handler (EvdWebService     *web_service,
                  EvdHttpConnection *conn,
@@ -235,12 +270,38 @@ request_handler (EvdWebService     *web_service,
   /* request to the RESTful API */
   else if (g_strcmp0 (tokens[1], API_PATH) == 0)
     {
-      /* @TODO */
+      if (self->priv->api_req_cb == NULL)
+        evd_web_service_respond (web_service,
+                                 conn,
+                                 SOUP_STATUS_NOT_FOUND,
+                                 NULL,
+                                 NULL,
+                                 0,
+                                 NULL);
+      else
+        self->priv->api_req_cb (self,
+                                tokens[2],
+                                conn,
+                                request,
+                                self->priv->api_user_data);
     }
-  /* request to the management API */
+  /* request to the management API, only from the local host */
   else if (g_strcmp0 (tokens[1], MANAGEMENT_PATH) == 0)
     {
-      /* @TODO */
+      if (self->priv->mgmt_req_cb == NULL || ! connection_is_local (conn))
+        evd_web_service_respond (web_service,
+                                 conn,
+                                 SOUP_STATUS_FORBIDDEN,
+                                 NULL,
+                                 NULL,
+                                 0,
+                                 NULL);
+      else
+        self->priv->mgmt_req_cb (self,
+                                 tokens[2],
+                                 conn,
+                                 request,
+                                 self->priv->mgmt_user_data);
     }
   else
     {
@@ -450,6 +511,28 @@ filetea_web_service_get_transport (FileteaWebService *self)
   return EVD_TRANSPORT (self->priv->transport);
 }
 
+void
+filetea_web_service_set_management_handler (FileteaWebService                    *self,
+                                            FileteaWebServiceManagementRequestCb  mgmt_req_cb,
+                                            gpointer                              user_data)
+{
+  g_return_if_fail (FILETEA_IS_WEB_SERVICE (self));
+
+  self->priv->mgmt_req_cb = mgmt_req_cb;
+  self->priv->mgmt_user_data = user_data;
+}
+
+void
+filetea_web_service_set_api_handler (FileteaWebService             *self,
+                                     FileteaWebServiceApiRequestCb  api_req_cb,
+                                     gpointer                       user_data)
+{
+  g_return_if_fail (FILETEA_IS_WEB_SERVICE (self));
+
+  self->priv->api_req_cb = api_req_cb;
+  self->priv->api_user_data = user_data;
+}
+
 #ifdef ENABLE_TESTS
 
 #endif /* ENABLE_TESTS */
@@ -49,6 +49,18 @@ typedef void (* FileteaWebServiceContentRequestCb) (FileteaWebService *self,
                                                     EvdHttpRequest    *request,
                                                     gpointer           user_data);
 
+typedef void (* FileteaWebServiceManagementRequestCb) (FileteaWebService *self,
+                                                       const gchar       *path,
+                                                       EvdHttpConnection *conn,
+                                                       EvdHttpRequest    *request,
+                                                       gpointer           user_data);
+
+typedef void (* FileteaWebServiceApiRequestCb) (FileteaWebService *self,
+                                                const gchar       *path,
+                                                EvdHttpConnection *conn,
+                                                EvdHttpRequest    *request,
+                                                gpointer           user_data);
+
 #define FILETEA_TYPE_WEB_SERVICE           (filetea_web_service_get_type ())
 #define FILETEA_WEB_SERVICE(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), FILETEA_TYPE_WEB_SERVICE, FileteaWebService))
 #define FILETEA_WEB_SERVICE_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), FILETEA_TYPE_WEB_SERVICE, FileteaWebServiceClass))
@@ -66,6 +78,14 @@ FileteaWebService * filetea_web_service_new                     (GKeyFile
 
 EvdTransport *      filetea_web_service_get_transport           (FileteaWebService *self);
 
+void                filetea_web_service_set_management_handler  (FileteaWebService                    *self,
+                                                                 FileteaWebServiceManagementRequestCb  mgmt_req_cb,
+                                                                 gpointer                              user_data);
+
+void                filetea_web_service_set_api_handler         (FileteaWebService             *self,
+                                                                 FileteaWebServiceApiRequestCb  api_req_cb,
+                                                                 gpointer                       user_data);
+
 #ifdef ENABLE_TESTS
 
 #endif /* ENABLE_TESTS */
@@ -36,8 +36,8 @@ static guint http_port = 0;
 static guint https_port = 0;
 static GKeyFile *config = NULL;
 
-static FileteaNode *http_node = NULL;
-static FileteaNode *https_node = NULL;
+/* a single node shared by all listeners */
+static FileteaNode *node = NULL;
 
 static gint setup_pending = 0;
 
@@ -172,6 +172,21 @@ resolve_port (GKeyFile     *config,
   return TRUE;
 }
 
+/* the node is created along with the first listener, any further listener
+   is added to it */
+static FileteaWebService *
+create_web_service (GKeyFile *config, GError **error)
+{
+  if (node != NULL)
+    return filetea_node_add_web_service (node, config, error);
+
+  node = filetea_node_new (config, error);
+  if (node == NULL)
+    return NULL;
+
+  return filetea_node_get_web_service (node);
+}
+
 static gboolean
 setup_https_node (GKeyFile *config, GError **error)
 {
@@ -192,13 +207,11 @@ setup_https_node (GKeyFile *config, GError **error)
   if (key_file == NULL)
     return FALSE;
 
-  /* create Filetea node for HTTPS */
-  https_node = filetea_node_new (config, error);
-  if (https_node == NULL)
+  /* create web service for HTTPS */
+  web_service = create_web_service (config, error);
+  if (web_service == NULL)
     return FALSE;
 
-  web_service = filetea_node_get_web_service (https_node);
-
   /* activate TLS automatically in the node */
   evd_service_set_tls_autostart (EVD_SERVICE (web_service), TRUE);
 
@@ -268,13 +281,11 @@ setup_http_node (GKeyFile *config, GError **error)
   gchar *addr;
   FileteaWebService *web_service;
 
-  /* create Filetea node for HTTP */
-  http_node = filetea_node_new (config, error);
-  if (http_node == NULL)
+  /* create web service for HTTP */
+  web_service = create_web_service (config, error);
+  if (web_service == NULL)
     return FALSE;
 
-  web_service = filetea_node_get_web_service (http_node);
-
   /* obtain HTTPS listening port */
   if (! resolve_port (config,
                       "http",
@@ -385,10 +396,8 @@ main (gint argc, gchar *argv[])
     }
 
   /* free stuff */
-  if (http_node != NULL)
-    g_object_unref (http_node);
-  if (https_node != NULL)
-    g_object_unref (https_node);
+  if (node != NULL)
+    g_object_unref (node);
 
   g_object_unref (evd_daemon);
 
@@ -0,0 +1,190 @@
+#include "filetea-search-index.h"
+
+/* times queries to the search index, over sources named with words drawn
+   from a random vocabulary */
+
+static gint num_sources = 300000;
+static gint num_words = 20000;
+static gint num_queries = 1000;
+
+static GOptionEntry entries[] =
+{
+  { "sources", 'n', 0, G_OPTION_ARG_INT, &num_sources, "Number of sources, default is 300000", "N" },
+  { "words", 'w', 0, G_OPTION_ARG_INT, &num_words, "Size of the vocabulary, default is 20000", "N" },
+  { "queries", 'q', 0, G_OPTION_ARG_INT, &num_queries, "Number of queries of each kind, default is 1000", "N" },
+  { NULL }
+};
+
+typedef struct
+{
+  const gchar *name;
+  gint n_words;
+  gboolean prefix;
+} QueryKind;
+
+static QueryKind kinds[] =
+  {
+    { "word",          1, FALSE },
+    { "two words",     2, FALSE },
+    { "prefix",        0, TRUE  },
+    { "word + prefix", 1, TRUE  }
+  };
+
+static gchar **words;
+
+static gchar *
+random_word (GRand *rand)
+{
+  gchar *word;
+  gint len;
+  gint i;
+
+  len = g_rand_int_range (rand, 4, 11);
+  word = g_new (gchar, len + 1);
+  for (i=0; i<len; i++)
+    word[i] = 'a' + g_rand_int_range (rand, 0, 26);
+  word[len] = '\0';
+
+  return word;
+}
+
+/* some words are much more common than others */
+static const gchar *
+pick_word (GRand *rand)
+{
+  gdouble r = g_rand_double (rand);
+
+  return words[(gint) (r * r * num_words)];
+}
+
+static gdouble
+elapsed_us (gint64 start, gint count)
+{
+  return (gdouble) (g_get_monotonic_time () - start) / count;
+}
+
+static void
+run (FileteaSearchIndex *index, QueryKind *kind, GRand *rand)
+{
+  gchar **queries;
+  guint results = 0;
+  gint64 start;
+  gint i;
+
+  queries = g_new (gchar *, num_queries);
+  for (i=0; i<num_queries; i++)
+    {
+      GString *query;
+      gint j;
+
+      query = g_string_new ("");
+      for (j=0; j<kind->n_words; j++)
+        g_string_append_printf (query, "%s ", pick_word (rand));
+
+      /* prefixes of 3 letters match many words */
+      if (kind->prefix)
+        g_string_append_printf (query, "%.3s*", pick_word (rand));
+
+      queries[i] = g_string_free (query, FALSE);
+    }
+
+  start = g_get_monotonic_time ();
+  for (i=0; i<num_queries; i++)
+    {
+      GList *list;
+
+      list = filetea_search_index_query (index, queries[i], 50);
+      results += g_list_length (list);
+      g_list_free (list);
+    }
+  g_print ("%-14s %8.1f us/query, %5.1f results/query\n",
+           kind->name,
+           elapsed_us (start, num_queries),
+           (gdouble) results / num_queries);
+
+  for (i=0; i<num_queries; i++)
+    g_free (queries[i]);
+  g_free (queries);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GRand *rand;
+  FileteaSearchIndex *index;
+  FileteaSource **sources;
+  gint64 start;
+  gint i;
+
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  context = g_option_context_new ("- benchmark the search index");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (! g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return -1;
+    }
+  g_option_context_free (context);
+
+  num_sources = MAX (num_sources, 1);
+  num_words = MAX (num_words, 1);
+  num_queries = MAX (num_queries, 1);
+
+  rand = g_rand_new_with_seed (1);
+
+  words = g_new (gchar *, num_words);
+  for (i=0; i<num_words; i++)
+    words[i] = random_word (rand);
+
+  /* names of three words, and a tag */
+  sources = g_new (FileteaSource *, num_sources);
+  for (i=0; i<num_sources; i++)
+    {
+      const gchar *tags[2] = { NULL, NULL };
+      gchar *name;
+
+      tags[0] = pick_word (rand);
+      name = g_strdup_printf ("%s %s-%s.txt",
+                              pick_word (rand),
+                              pick_word (rand),
+                              pick_word (rand));
+
+      sources[i] = filetea_source_new (NULL,
+                                       name,
+                                       "text/plain",
+                                       123,
+                                       FILETEA_SOURCE_FLAGS_PUBLIC,
+                                       tags);
+      g_free (name);
+    }
+
+  index = filetea_search_index_new ();
+
+  start = g_get_monotonic_time ();
+  for (i=0; i<num_sources; i++)
+    filetea_search_index_add (index, sources[i]);
+  g_print ("%-14s %8.1f us/source\n", "add", elapsed_us (start, num_sources));
+
+  for (i=0; i<(gint) G_N_ELEMENTS (kinds); i++)
+    run (index, &kinds[i], rand);
+
+  g_object_unref (index);
+
+  for (i=0; i<num_sources; i++)
+    g_object_unref (sources[i]);
+  g_free (sources);
+
+  for (i=0; i<num_words; i++)
+    g_free (words[i]);
+  g_free (words);
+
+  g_rand_free (rand);
+
+  return 0;
+}
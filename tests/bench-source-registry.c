@@ -0,0 +1,271 @@
+#include "filetea-source-registry.h"
+
+/* compares the source registry against the hash tables the node used
+   before: one by id, plus one by id for each peer */
+
+static gint num_sources = 1000000;
+static gint num_peers = 1000;
+
+static GOptionEntry entries[] =
+{
+  { "sources", 'n', 0, G_OPTION_ARG_INT, &num_sources, "Number of sources, default is 1000000", "N" },
+  { "peers", 'p', 0, G_OPTION_ARG_INT, &num_peers, "Number of peers, default is 1000", "N" },
+  { NULL }
+};
+
+typedef struct
+{
+  const gchar *name;
+
+  gpointer (* new)       (void);
+  void     (* free)      (gpointer index);
+  void     (* add)       (gpointer index, FileteaSource *source);
+  gpointer (* lookup)    (gpointer index, const gchar *id);
+  void     (* drop_peer) (gpointer index, EvdPeer *peer);
+} Index;
+
+typedef struct
+{
+  GHashTable *by_id;
+  GHashTable *by_peer;
+} Tables;
+
+static gpointer
+tables_new (void)
+{
+  Tables *tables = g_slice_new (Tables);
+
+  tables->by_id = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         g_object_unref);
+  tables->by_peer = g_hash_table_new_full (g_direct_hash,
+                                           g_direct_equal,
+                                           NULL,
+                                           (GDestroyNotify) g_hash_table_unref);
+
+  return tables;
+}
+
+static void
+tables_free (gpointer index)
+{
+  Tables *tables = index;
+
+  g_hash_table_unref (tables->by_peer);
+  g_hash_table_unref (tables->by_id);
+  g_slice_free (Tables, tables);
+}
+
+static void
+tables_add (gpointer index, FileteaSource *source)
+{
+  Tables *tables = index;
+  GHashTable *of_peer;
+  EvdPeer *peer;
+
+  g_hash_table_insert (tables->by_id,
+                       g_strdup (filetea_source_get_id (source)),
+                       g_object_ref (source));
+
+  peer = filetea_source_get_peer (source);
+  of_peer = g_hash_table_lookup (tables->by_peer, peer);
+  if (of_peer == NULL)
+    {
+      of_peer = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       g_object_unref);
+      g_hash_table_insert (tables->by_peer, peer, of_peer);
+    }
+  g_hash_table_insert (of_peer,
+                       g_strdup (filetea_source_get_id (source)),
+                       g_object_ref (source));
+}
+
+static gpointer
+tables_lookup (gpointer index, const gchar *id)
+{
+  Tables *tables = index;
+
+  return g_hash_table_lookup (tables->by_id, id);
+}
+
+static gboolean
+tables_remove_foreach (gpointer key, gpointer value, gpointer user_data)
+{
+  Tables *tables = user_data;
+
+  g_hash_table_remove (tables->by_id,
+                       filetea_source_get_id (FILETEA_SOURCE (value)));
+
+  return TRUE;
+}
+
+static void
+tables_drop_peer (gpointer index, EvdPeer *peer)
+{
+  Tables *tables = index;
+  GHashTable *of_peer;
+
+  of_peer = g_hash_table_lookup (tables->by_peer, peer);
+  if (of_peer == NULL)
+    return;
+
+  g_hash_table_foreach_remove (of_peer, tables_remove_foreach, tables);
+  g_hash_table_remove (tables->by_peer, peer);
+}
+
+static gpointer
+registry_new (void)
+{
+  return filetea_source_registry_new ();
+}
+
+static void
+registry_add (gpointer index, FileteaSource *source)
+{
+  filetea_source_registry_add (index, source);
+}
+
+static gpointer
+registry_lookup (gpointer index, const gchar *id)
+{
+  return filetea_source_registry_lookup (index, id);
+}
+
+static void
+registry_drop_peer (gpointer index, EvdPeer *peer)
+{
+  FileteaSource *source;
+
+  while ((source = filetea_source_registry_peek_peer (index, peer)) != NULL)
+    filetea_source_registry_remove (index, source);
+}
+
+static Index indexes[] =
+  {
+    {
+      "hash tables",
+      tables_new,
+      tables_free,
+      tables_add,
+      tables_lookup,
+      tables_drop_peer
+    },
+
+    {
+      "registry",
+      registry_new,
+      g_object_unref,
+      registry_add,
+      registry_lookup,
+      registry_drop_peer
+    }
+  };
+
+static gdouble
+elapsed_ns (gint64 start, gint count)
+{
+  return (gdouble) (g_get_monotonic_time () - start) * 1000.0 / count;
+}
+
+static void
+run (Index *index, FileteaSource **sources, EvdPeer **peers)
+{
+  gpointer data;
+  gint64 start;
+  gint i;
+
+  data = index->new ();
+
+  start = g_get_monotonic_time ();
+  for (i=0; i<num_sources; i++)
+    index->add (data, sources[i]);
+  g_print ("%-12s insert:    %8.1f ns/source\n",
+           index->name,
+           elapsed_ns (start, num_sources));
+
+  start = g_get_monotonic_time ();
+  for (i=0; i<num_sources; i++)
+    if (index->lookup (data, filetea_source_get_id (sources[i])) != sources[i])
+      g_error ("Source %d not found", i);
+  g_print ("%-12s lookup:    %8.1f ns/source\n",
+           index->name,
+           elapsed_ns (start, num_sources));
+
+  start = g_get_monotonic_time ();
+  for (i=0; i<num_peers; i++)
+    index->drop_peer (data, peers[i]);
+  g_print ("%-12s peer drop: %8.1f ns/source\n",
+           index->name,
+           elapsed_ns (start, num_sources));
+
+  index->free (data);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  EvdWebTransportServer *transport;
+  EvdPeer **peers;
+  FileteaSource **sources;
+  gint i;
+
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  context = g_option_context_new ("- benchmark the source registry");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (! g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return -1;
+    }
+  g_option_context_free (context);
+
+  num_sources = MAX (num_sources, 1);
+  num_peers = CLAMP (num_peers, 1, num_sources);
+
+  transport = evd_web_transport_server_new (NULL);
+  peers = g_new (EvdPeer *, num_peers);
+  for (i=0; i<num_peers; i++)
+    peers[i] = g_object_new (EVD_TYPE_PEER, "transport", transport, NULL);
+
+  /* ids look like the ones the node generates */
+  sources = g_new (FileteaSource *, num_sources);
+  for (i=0; i<num_sources; i++)
+    {
+      gchar *id;
+
+      sources[i] = filetea_source_new (peers[i % num_peers],
+                                       "Some content",
+                                       "text/plain",
+                                       123,
+                                       0,
+                                       NULL);
+
+      id = g_strdup_printf ("1a0%08x%08x", g_random_int (), i);
+      filetea_source_set_id (sources[i], id);
+      g_free (id);
+    }
+
+  for (i=0; i<(gint) G_N_ELEMENTS (indexes); i++)
+    run (&indexes[i], sources, peers);
+
+  for (i=0; i<num_sources; i++)
+    g_object_unref (sources[i]);
+  g_free (sources);
+
+  for (i=0; i<num_peers; i++)
+    g_object_unref (peers[i]);
+  g_free (peers);
+
+  g_object_unref (transport);
+
+  return 0;
+}
@@ -1,5 +1,8 @@
 #include "filetea-node.h"
 
+/* milliseconds to wait for the response to a call */
+#define RESPONSE_TIMEOUT 5000
+
 typedef struct
 {
   gchar *test_name;
@@ -107,6 +110,16 @@ fixture_teardown (Fixture       *f,
   g_object_unref (f->peer2);
 }
 
+static gboolean
+on_timeout (gpointer user_data)
+{
+  gboolean *timed_out = user_data;
+
+  *timed_out = TRUE;
+
+  return FALSE;
+}
+
 static void
 test_func (Fixture       *f,
            gconstpointer  data)
@@ -118,6 +131,11 @@ test_func (Fixture       *f,
 
   GError *error = NULL;
 
+  gchar *msg;
+  gsize size;
+  gboolean timed_out = FALSE;
+  guint timeout_src_id;
+
   GList *sources;
 
   protocol = filetea_node_get_protocol (f->node);
@@ -126,9 +144,22 @@ test_func (Fixture       *f,
   evd_jsonrpc_transport_receive (rpc, test_case->out_msg, f->peer1, 1, &error);
   g_assert_no_error (error);
 
+  /* sources are signed in a thread, and registered back in the main loop
+     right before the response is sent */
+  timeout_src_id = g_timeout_add (RESPONSE_TIMEOUT, on_timeout, &timed_out);
+  while ((msg = evd_peer_pop_message (f->peer1, &size, NULL)) == NULL &&
+         ! timed_out)
+    {
+      g_main_context_iteration (NULL, TRUE);
+    }
+  if (! timed_out)
+    g_source_remove (timeout_src_id);
+
+  g_assert (msg != NULL);
+  g_free (msg);
+
   sources = filetea_node_get_all_sources (f->node);
   g_assert_cmpuint (g_list_length (sources), ==, test_case->num_sources);
-
   g_list_free (sources);
 }
 
@@ -0,0 +1,234 @@
+#include "filetea-search-index.h"
+
+typedef struct
+{
+  FileteaSearchIndex *index;
+  FileteaSource *sources[4];
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  data)
+{
+  const gchar *tags1[] = { "Holidays", "beach", NULL };
+  const gchar *tags2[] = { "holidays", "mountain", NULL };
+  const gchar *tags3[] = { "work", NULL };
+  guint i;
+
+  f->index = filetea_search_index_new ();
+
+  f->sources[0] = filetea_source_new (NULL,
+                                      "Summer in Lisbon.jpg",
+                                      "image/jpeg",
+                                      100,
+                                      FILETEA_SOURCE_FLAGS_PUBLIC,
+                                      tags1);
+  f->sources[1] = filetea_source_new (NULL,
+                                      "Winter-summary.pdf",
+                                      "application/pdf",
+                                      200,
+                                      FILETEA_SOURCE_FLAGS_PUBLIC,
+                                      tags2);
+  f->sources[2] = filetea_source_new (NULL,
+                                      "summary summary.txt",
+                                      "text/plain",
+                                      300,
+                                      FILETEA_SOURCE_FLAGS_PUBLIC,
+                                      tags3);
+  f->sources[3] = filetea_source_new (NULL,
+                                      "Café Lisboa.ogg",
+                                      "audio/ogg",
+                                      400,
+                                      FILETEA_SOURCE_FLAGS_PUBLIC,
+                                      NULL);
+
+  for (i=0; i<G_N_ELEMENTS (f->sources); i++)
+    filetea_search_index_add (f->index, f->sources[i]);
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  data)
+{
+  guint i;
+
+  g_assert (G_OBJECT (f->index)->ref_count == 1);
+  g_object_unref (f->index);
+
+  for (i=0; i<G_N_ELEMENTS (f->sources); i++)
+    g_object_unref (f->sources[i]);
+}
+
+static void
+assert_results (Fixture     *f,
+                const gchar *query,
+                guint        max_results,
+                guint        n_expected,
+                ...)
+{
+  GList *results;
+  va_list args;
+  guint i;
+
+  results = filetea_search_index_query (f->index, query, max_results);
+  g_assert_cmpuint (g_list_length (results), ==, n_expected);
+
+  va_start (args, n_expected);
+  for (i=0; i<n_expected; i++)
+    {
+      guint index = va_arg (args, guint);
+
+      g_assert (g_list_find (results, f->sources[index]) != NULL);
+    }
+  va_end (args);
+
+  g_list_free (results);
+}
+
+static void
+test_term (Fixture       *f,
+           gconstpointer  data)
+{
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 4);
+
+  assert_results (f, "holidays", 10, 2, 0, 1);
+  assert_results (f, "HOLIDAYS", 10, 2, 0, 1);
+  assert_results (f, "summary", 10, 2, 1, 2);
+  assert_results (f, "café", 10, 1, 3);
+  assert_results (f, "summ", 10, 0);
+  assert_results (f, "nothing", 10, 0);
+  assert_results (f, "", 10, 0);
+  assert_results (f, " - ", 10, 0);
+}
+
+static void
+test_prefix (Fixture       *f,
+             gconstpointer  data)
+{
+  assert_results (f, "summ*", 10, 3, 0, 1, 2);
+  assert_results (f, "lisb*", 10, 2, 0, 3);
+  assert_results (f, "x*", 10, 0);
+}
+
+static void
+test_all_words (Fixture       *f,
+                gconstpointer  data)
+{
+  assert_results (f, "holidays beach", 10, 1, 0);
+  assert_results (f, "holidays summ*", 10, 2, 0, 1);
+  assert_results (f, "summ* win*", 10, 1, 1);
+  assert_results (f, "summary nothing", 10, 0);
+}
+
+static void
+test_max_results (Fixture       *f,
+                  gconstpointer  data)
+{
+  GList *results;
+
+  results = filetea_search_index_query (f->index, "summ*", 2);
+  g_assert_cmpuint (g_list_length (results), ==, 2);
+  g_list_free (results);
+
+  assert_results (f, "holidays", 0, 0);
+}
+
+static void
+test_remove (Fixture       *f,
+             gconstpointer  data)
+{
+  filetea_search_index_remove (f->index, f->sources[0]);
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 3);
+
+  assert_results (f, "holidays", 10, 1, 1);
+  assert_results (f, "beach", 10, 0);
+  assert_results (f, "summ*", 10, 2, 1, 2);
+
+  filetea_search_index_remove (f->index, f->sources[2]);
+  assert_results (f, "summary", 10, 1, 1);
+  assert_results (f, "work", 10, 0);
+
+  filetea_search_index_add (f->index, f->sources[0]);
+  assert_results (f, "beach", 10, 1, 0);
+}
+
+static void
+test_size (Fixture       *f,
+           gconstpointer  data)
+{
+  FileteaSource *source;
+
+  filetea_search_index_remove (f->index, f->sources[0]);
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 3);
+
+  /* not in the index anymore */
+  filetea_search_index_remove (f->index, f->sources[0]);
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 3);
+
+  /* no words to index it by */
+  source = filetea_source_new (NULL,
+                               "- ... -",
+                               "text/plain",
+                               1,
+                               FILETEA_SOURCE_FLAGS_PUBLIC,
+                               NULL);
+  filetea_search_index_add (f->index, source);
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 3);
+  filetea_search_index_remove (f->index, source);
+  g_assert_cmpuint (filetea_search_index_get_size (f->index), ==, 3);
+  g_object_unref (source);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/search-index/term",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_term,
+              fixture_teardown);
+
+  g_test_add ("/search-index/prefix",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_prefix,
+              fixture_teardown);
+
+  g_test_add ("/search-index/all-words",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_all_words,
+              fixture_teardown);
+
+  g_test_add ("/search-index/max-results",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_max_results,
+              fixture_teardown);
+
+  g_test_add ("/search-index/remove",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_remove,
+              fixture_teardown);
+
+  g_test_add ("/search-index/size",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_size,
+              fixture_teardown);
+
+  return g_test_run ();
+}
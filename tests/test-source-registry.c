@@ -0,0 +1,281 @@
+#include "filetea-source-registry.h"
+
+/* size and hashing of a new registry, to pick ids that collide in it */
+#define SLOTS_BITS      6
+#define HASH_MULTIPLIER 0x9E3779B1
+
+#define LAST_SLOT ((1 << SLOTS_BITS) - 1)
+
+typedef struct
+{
+  FileteaSourceRegistry *registry;
+  EvdPeer *peer1;
+  EvdPeer *peer2;
+  GPtrArray *sources;
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  data)
+{
+  EvdWebTransportServer *transport;
+
+  f->registry = filetea_source_registry_new ();
+
+  transport = evd_web_transport_server_new (NULL);
+  f->peer1 = g_object_new (EVD_TYPE_PEER,
+                           "transport", transport,
+                           NULL);
+  f->peer2 = g_object_new (EVD_TYPE_PEER,
+                           "transport", transport,
+                           NULL);
+  g_object_unref (transport);
+
+  f->sources = g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  data)
+{
+  g_assert (G_OBJECT (f->registry)->ref_count == 1);
+  g_object_unref (f->registry);
+
+  g_ptr_array_unref (f->sources);
+
+  g_object_unref (f->peer1);
+  g_object_unref (f->peer2);
+}
+
+static guint
+home_of (const gchar *id)
+{
+  return (guint32) (g_str_hash (id) * HASH_MULTIPLIER) >> (32 - SLOTS_BITS);
+}
+
+static FileteaSource *
+new_source (Fixture *f, EvdPeer *peer, const gchar *id)
+{
+  FileteaSource *source;
+
+  source = filetea_source_new (peer,
+                               "Some content",
+                               "text/plain",
+                               123,
+                               0,
+                               NULL);
+  filetea_source_set_id (source, id);
+
+  g_ptr_array_add (f->sources, source);
+
+  return source;
+}
+
+/* a source whose id has its home at @home, and is not taken yet */
+static FileteaSource *
+new_source_at (Fixture *f, guint home, guint *seed)
+{
+  gchar *id;
+  FileteaSource *source;
+
+  while (TRUE)
+    {
+      id = g_strdup_printf ("1a0%08x", (*seed)++);
+      if (home_of (id) == home)
+        break;
+      g_free (id);
+    }
+
+  source = new_source (f, f->peer1, id);
+  g_free (id);
+
+  return source;
+}
+
+static void
+assert_registered (Fixture *f, FileteaSource *source, gboolean registered)
+{
+  FileteaSource *found;
+
+  found = filetea_source_registry_lookup (f->registry,
+                                          filetea_source_get_id (source));
+  g_assert (found == (registered ? source : NULL));
+}
+
+static void
+test_cluster (Fixture       *f,
+              gconstpointer  data)
+{
+  FileteaSource *s[6];
+  guint seed = 0;
+  guint i;
+
+  /* four ids at the last slot wrap around to the first ones, where two
+     more ids have their home */
+  for (i=0; i<4; i++)
+    s[i] = new_source_at (f, LAST_SLOT, &seed);
+  for (i=4; i<6; i++)
+    s[i] = new_source_at (f, 0, &seed);
+
+  for (i=0; i<6; i++)
+    g_assert (filetea_source_registry_add (f->registry, s[i]));
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 6);
+
+  for (i=0; i<6; i++)
+    assert_registered (f, s[i], TRUE);
+
+  /* already there */
+  g_assert (! filetea_source_registry_add (f->registry, s[2]));
+
+  /* a hole in the middle of the cluster, past the end of the table */
+  g_assert (filetea_source_registry_remove (f->registry, s[1]));
+  assert_registered (f, s[1], FALSE);
+  for (i=0; i<6; i++)
+    if (i != 1)
+      assert_registered (f, s[i], TRUE);
+
+  /* not there anymore */
+  g_assert (! filetea_source_registry_remove (f->registry, s[1]));
+
+  /* the head of the cluster, at the end of the table */
+  g_assert (filetea_source_registry_remove (f->registry, s[0]));
+  for (i=2; i<6; i++)
+    assert_registered (f, s[i], TRUE);
+
+  /* ids homed after the wraparound */
+  g_assert (filetea_source_registry_remove (f->registry, s[4]));
+  assert_registered (f, s[2], TRUE);
+  assert_registered (f, s[3], TRUE);
+  assert_registered (f, s[5], TRUE);
+
+  g_assert (filetea_source_registry_add (f->registry, s[0]));
+  g_assert (filetea_source_registry_add (f->registry, s[1]));
+  g_assert (filetea_source_registry_add (f->registry, s[4]));
+  for (i=0; i<6; i++)
+    assert_registered (f, s[i], TRUE);
+
+  for (i=0; i<6; i++)
+    g_assert (filetea_source_registry_remove (f->registry, s[i]));
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 0);
+
+  for (i=0; i<6; i++)
+    assert_registered (f, s[i], FALSE);
+}
+
+static void
+test_grow (Fixture       *f,
+           gconstpointer  data)
+{
+  FileteaSource *source;
+  GList *all;
+  guint i;
+
+  /* way past the load of the initial table */
+  for (i=0; i<1000; i++)
+    {
+      gchar *id;
+
+      id = g_strdup_printf ("1a0%08x", i);
+      source = new_source (f, i % 2 == 0 ? f->peer1 : f->peer2, id);
+      g_free (id);
+
+      g_assert (filetea_source_registry_add (f->registry, source));
+    }
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 1000);
+
+  for (i=0; i<f->sources->len; i++)
+    assert_registered (f, g_ptr_array_index (f->sources, i), TRUE);
+
+  for (i=1; i<f->sources->len; i+=2)
+    g_assert (filetea_source_registry_remove (f->registry,
+                                         g_ptr_array_index (f->sources, i)));
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 500);
+
+  for (i=0; i<f->sources->len; i++)
+    assert_registered (f, g_ptr_array_index (f->sources, i), i % 2 == 0);
+
+  all = filetea_source_registry_get_all (f->registry);
+  g_assert_cmpuint (g_list_length (all), ==, 500);
+  g_list_free (all);
+}
+
+static void
+test_peer (Fixture       *f,
+           gconstpointer  data)
+{
+  FileteaSource *source;
+  FileteaSource *moved;
+  guint i;
+
+  for (i=0; i<100; i++)
+    {
+      gchar *id;
+
+      id = g_strdup_printf ("1a0%08x", i);
+      source = new_source (f, i % 3 == 0 ? f->peer2 : f->peer1, id);
+      g_free (id);
+
+      filetea_source_registry_add (f->registry, source);
+    }
+
+  /* one of peer1 goes to peer2 */
+  moved = g_ptr_array_index (f->sources, 1);
+  filetea_source_registry_set_peer (f->registry, moved, f->peer2);
+  g_assert (filetea_source_get_peer (moved) == f->peer2);
+
+  /* drop all sources of peer1 */
+  while ((source = filetea_source_registry_peek_peer (f->registry,
+                                                      f->peer1)) != NULL)
+    {
+      g_assert (filetea_source_get_peer (source) == f->peer1);
+      g_assert (filetea_source_registry_remove (f->registry, source));
+    }
+
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 35);
+
+  for (i=0; i<f->sources->len; i++)
+    assert_registered (f,
+                       g_ptr_array_index (f->sources, i),
+                       i % 3 == 0 || i == 1);
+
+  while ((source = filetea_source_registry_peek_peer (f->registry,
+                                                      f->peer2)) != NULL)
+    {
+      g_assert (filetea_source_registry_remove (f->registry, source));
+    }
+
+  g_assert_cmpuint (filetea_source_registry_get_size (f->registry), ==, 0);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/source-registry/cluster",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_cluster,
+              fixture_teardown);
+
+  g_test_add ("/source-registry/grow",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_grow,
+              fixture_teardown);
+
+  g_test_add ("/source-registry/peer",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_peer,
+              fixture_teardown);
+
+  return g_test_run ();
+}
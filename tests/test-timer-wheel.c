@@ -0,0 +1,164 @@
+#include "filetea-timer-wheel.h"
+
+#define RESOLUTION 10
+#define SLOTS       4
+
+typedef struct
+{
+  FileteaTimerWheel *wheel;
+  GMainLoop *main_loop;
+
+  GString *fired;
+  guint repeat;
+  FileteaTimer *victim;
+} Fixture;
+
+typedef struct
+{
+  Fixture *f;
+  gchar name;
+} Timer;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  data)
+{
+  f->wheel = filetea_timer_wheel_new (RESOLUTION, SLOTS);
+  f->main_loop = g_main_loop_new (NULL, FALSE);
+  f->fired = g_string_new ("");
+  f->repeat = 0;
+  f->victim = NULL;
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  data)
+{
+  g_assert (G_OBJECT (f->wheel)->ref_count == 1);
+  g_object_unref (f->wheel);
+
+  g_main_loop_unref (f->main_loop);
+  g_string_free (f->fired, TRUE);
+}
+
+static gboolean
+on_timer (gpointer user_data)
+{
+  Timer *timer = user_data;
+  Fixture *f = timer->f;
+
+  g_string_append_c (f->fired, timer->name);
+
+  if (f->victim != NULL)
+    {
+      filetea_timer_wheel_cancel (f->wheel, f->victim);
+      f->victim = NULL;
+    }
+
+  if (timer->name == 'r' && f->repeat > 1)
+    {
+      f->repeat--;
+      return TRUE;
+    }
+
+  if (filetea_timer_wheel_get_size (f->wheel) == 0)
+    g_main_loop_quit (f->main_loop);
+
+  return FALSE;
+}
+
+static void
+test_order (Fixture       *f,
+            gconstpointer  data)
+{
+  /* the last one takes more than one round of the wheel */
+  Timer c = { f, 'c' };
+  Timer a = { f, 'a' };
+  Timer b = { f, 'b' };
+  Timer d = { f, 'd' };
+
+  filetea_timer_wheel_add (f->wheel, RESOLUTION * 3 + 1, on_timer, &c);
+  filetea_timer_wheel_add (f->wheel, 0, on_timer, &a);
+  filetea_timer_wheel_add (f->wheel, RESOLUTION * 2, on_timer, &b);
+  filetea_timer_wheel_add (f->wheel, RESOLUTION * SLOTS * 2, on_timer, &d);
+  g_assert_cmpuint (filetea_timer_wheel_get_size (f->wheel), ==, 4);
+
+  g_main_loop_run (f->main_loop);
+
+  g_assert_cmpstr (f->fired->str, ==, "abcd");
+  g_assert_cmpuint (filetea_timer_wheel_get_size (f->wheel), ==, 0);
+}
+
+static void
+test_cancel (Fixture       *f,
+             gconstpointer  data)
+{
+  Timer a = { f, 'a' };
+  Timer b = { f, 'b' };
+  Timer c = { f, 'c' };
+  FileteaTimer *timer;
+
+  timer = filetea_timer_wheel_add (f->wheel, RESOLUTION, on_timer, &b);
+  filetea_timer_wheel_add (f->wheel, RESOLUTION * 2, on_timer, &a);
+  filetea_timer_wheel_cancel (f->wheel, timer);
+  g_assert_cmpuint (filetea_timer_wheel_get_size (f->wheel), ==, 1);
+
+  /* cancelled by a timer firing before it */
+  f->victim = filetea_timer_wheel_add (f->wheel,
+                                       RESOLUTION * 4,
+                                       on_timer,
+                                       &c);
+
+  g_main_loop_run (f->main_loop);
+
+  g_assert_cmpstr (f->fired->str, ==, "a");
+  g_assert_cmpuint (filetea_timer_wheel_get_size (f->wheel), ==, 0);
+}
+
+static void
+test_repeat (Fixture       *f,
+             gconstpointer  data)
+{
+  Timer r = { f, 'r' };
+
+  f->repeat = 3;
+  filetea_timer_wheel_add (f->wheel, RESOLUTION, on_timer, &r);
+
+  g_main_loop_run (f->main_loop);
+
+  g_assert_cmpstr (f->fired->str, ==, "rrr");
+  g_assert_cmpuint (filetea_timer_wheel_get_size (f->wheel), ==, 0);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/timer-wheel/order",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_order,
+              fixture_teardown);
+
+  g_test_add ("/timer-wheel/cancel",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_cancel,
+              fixture_teardown);
+
+  g_test_add ("/timer-wheel/repeat",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_repeat,
+              fixture_teardown);
+
+  return g_test_run ();
+}